@@ -4,37 +4,146 @@
  * 1) Reads a CSV "svd_data.csv" with lines:
  *      user_id,movie_id,rating
  *    mapped so 0 <= user_id < num_rows and 0 <= movie_id < num_cols.
+ *    The file is mmap'ed and parsed by all OpenMP threads (csv_loader.c).
+ *    --save-cache=FILE also writes the ingested matrix to a binary cache
+ *    (matrix_io.c); passing that cache instead of the CSV on later runs maps
+ *    it straight into A with no parsing, in the format (dense or sparse) it
+ *    was saved with.
  *
  * 2) Fills a 'mat' structure (from THU-numbda's svds.h), where
- *    mat has fields: int nrows, ncols; double *d;    // stored in row-major order.
+ *    mat has fields: int nrows, ncols; double *d;    // stored in column-major order.
  *
  * 3) Calls the function:
  *    void svds_C_dense(mat *A, mat **Uk, mat **Sk, mat **Vk, int k);
  *    which is provided by THU-numbda's svds.c (the HPC code, internally using OpenMP).
+ *    With --sparse the ratings go CSV -> mat_coo -> mat_csr instead and
+ *    svds_C is called, so memory and matvec cost scale with nnz.
+ *    --transpose-copy additionally keeps a CSR copy of A^T, so that A^T*u
+ *    is a conflict-free row-parallel SpMV, for twice the index memory.
+ *    --sparse-format=sell (double-precision Lanczos) converts the CSR to
+ *    SELL-C-sigma (sell_matrix_from_csr, rows sorted by length within
+ *    windows of --sell-sigma=S rows, default 4096) for A and A^T and calls
+ *    svds_C_sell_opt: both products run as SIMD gathers over chunks of
+ *    rows, split between threads by nonzeros (build with -march=native).
+ *    --reorth=full|cgs2|partial picks how the Lanczos solver keeps its basis
+ *    orthogonal (svds_C_opt / svds_C_dense_opt, default full).
+ *    --solver=block --blocksize=P switches to the block Lanczos variants
+ *    (svds_C_block_opt / svds_C_dense_block_opt), which stream A once per P
+ *    vectors.
+ *    --solver=randomized [--oversample=P] [--power=Q] uses the randomized
+ *    range finder (svds_C_randomized / svds_C_dense_randomized): a fixed
+ *    2Q+2 block passes over A at a looser accuracy than Lanczos.
+ *    --precision=mixed (Lanczos only) keeps a float copy of A instead and
+ *    calls svds_C_mixed_opt / svds_C_dense_mixed_opt: the matvecs stream
+ *    half the bytes while the recurrences stay in double.
+ *    --mode=auto estimates the footprint of A (from the CSV size) and of the
+ *    solver workspace before allocating anything, and picks dense storage if
+ *    it fits in --mem-budget=GB (default: the physical memory), sparse if
+ *    only that fits, and otherwise stops and suggests the MPI driver or a
+ *    binary cache with --mode=stream.
+ *    --mode=dense|sparse force the format (--sparse = --mode=sparse).
+ *    --mode=stream (binary cache input only) keeps A on disk: the block or
+ *    randomized solver reads it by panels of --panel-mb=MB (default 256),
+ *    prefetching the next panel while the current one is multiplied, and
+ *    only the bases stay in memory (svds_C_stream_block_opt /
+ *    svds_C_stream_randomized). The Lanczos solver is replaced by the block
+ *    one (--blocksize default 16 there), which takes --tol, --maxiter and
+ *    --maxbasis like Lanczos does. --mode=auto falls back to it when a
+ *    cache does not fit in the budget.
+ *    A and the solver bases are first touched by row blocks from the threads
+ *    that stream them, so on multi-socket nodes each thread reads local
+ *    memory; --numa=interleave spreads their pages over all nodes instead
+ *    (build with -DSVD_USE_NUMA ... -lnuma).
+ *    --tol=EPS (default 1e-10), --maxiter=N (default 10) and
+ *    --time-budget=SEC (default none) set when the Lanczos solver stops:
+ *    converged triplets are locked, the basis of --maxbasis=B (default
+ *    max(3K, 15)) shrinks as they converge, and the solve ends when all K
+ *    residuals are below EPS, after N passes, or before a pass that would
+ *    overrun SEC seconds. The block solver (also the streamed one) stops at
+ *    EPS or after N restarts (default 20) of a basis of B columns, cut down
+ *    to K plus whole blocks (default svds_block_basis); a solve that stops
+ *    short is logged with its converged count. --time-budget is for Lanczos
+ *    only, and the randomized solver takes none of the four.
+ *    --backend=cuda runs the Lanczos solve on a GPU (build with
+ *    -DSVD_USE_CUDA ... -lcudart -lcublas -lcusparse): A and the bases stay
+ *    in device memory, only the small projected SVD runs on the host. The
+ *    device loop always reorthogonalizes fully (--reorth is not used) and
+ *    neither locks converged triplets nor shrinks the basis. The other
+ *    solvers and --precision=mixed stay on the CPU (--backend=cpu, the
+ *    default).
+ *    --ranks=R1,R2,... (e.g. 20,50,100,200) replaces a sweep of jobs over K:
+ *    one solve at the largest rank (K is raised to it), whose leading
+ *    triplets are the factorization of every smaller rank
+ *    (svds_split_ranks). Each rank is saved to "svd_mpi_results_K<R>.dat",
+ *    and the captured energy s_1^2 + ... + s_r^2 of every r, also as a
+ *    fraction of ||A||_F^2, to "svd_energy.csv".
+ *    --center=rows|cols|both (sparse, Lanczos in double) factorizes the
+ *    mean-centered ratings, A minus the user means, the movie means, or the
+ *    baseline user mean + movie mean - global mean, on every entry, without
+ *    densifying A: svds_C_centered_opt applies the centering as rank-one
+ *    corrections inside each product. The means are saved next to the
+ *    factors to "svd_means.dat" (user means, movie means and global mean,
+ *    as three matrices in the same format).
+ *    --checkpoint=FILE makes the Lanczos solve write its state to FILE at a
+ *    restart every --checkpoint-every=SEC seconds (default 60) from a
+ *    background thread while it goes on (svds_workspace_checkpoint). A job
+ *    stopped by its walltime is resubmitted with --resume and the same
+ *    arguments: if FILE exists the solve continues from it
+ *    (svds_workspace_resume) instead of starting over. FILE is removed once
+ *    the results of a converged solve are saved, and kept when the solve
+ *    stopped short (--time-budget, --maxiter) so that it can be resumed.
+ *    --segments=S replaces the global factorization by S independent ones
+ *    (sparse, Lanczos in double): the users are cut into S blocks of
+ *    consecutive rows and every block gets its own rank-K SVD, saved to
+ *    "svd_segment_<s>.dat". svds_C_batch runs the small solves concurrently,
+ *    one per thread; segments of at least --segment-split=NNZ nonzeros
+ *    (default 2^20) get the whole team instead.
+ *    Built with -DSVDS_STATS, the Lanczos solvers also log time, calls,
+ *    GFLOP/s and GB/s per phase, and the converged count and basis length
+ *    of every restart.
+ *    --update-from=FILE (a previous svd_mpi_results.dat) reuses an earlier
+ *    factorization when new ratings arrive. With --update=brand (default)
+ *    the CSV holds only the new ratings (for a changed rating the difference
+ *    to the old one), NUM_ROWS x NUM_COLS may have grown, and svds_update
+ *    folds them into the old factors without touching the full matrix:
+ *    exactly (Brand's update) if they touch at most SVDS_UPDATE_EXACT_MAX
+ *    rows or columns, otherwise by the randomized range finder with
+ *    --oversample and --power.
+ *    With --update=warm the CSV is the whole updated matrix and the Lanczos
+ *    solve starts from the old Vk (svds_workspace_warm_start), which
+ *    usually saves restarts.
  *
  * 4) Logs (prints) time taken for each step and a success message.
  *
  * 5) Saves Uk, Sk, Vk to a single binary file "svd_mpi_results.dat" in row-major format.
  *
  * Compilation (example):
- *   gcc -fopenmp main.c svds.c matrix_funs.c -o svd_shared -lm -lopenblas -llapacke
+ *   gcc -fopenmp main.c svds.c matrix_funcs.c csv_loader.c matrix_io.c recommend.c -o svd_shared -lm -lopenblas -llapacke
  *
  * Run (shared-memory approach):
- *   ./svd_shared svd_data.csv NUM_ROWS NUM_COLS K
+ *   ./svd_shared svd_data.csv NUM_ROWS NUM_COLS K [--sparse] [--transpose-copy] [--solver=lanczos|block|randomized] [--blocksize=P] [--oversample=P] [--power=Q] [--reorth=full|cgs2|partial] [--tol=EPS] [--maxiter=N] [--maxbasis=B] [--time-budget=SEC] [--precision=double|mixed] [--mode=dense|sparse|auto|stream] [--mem-budget=GB] [--panel-mb=MB] [--numa=first-touch|interleave] [--save-cache=FILE] [--update-from=FILE] [--update=brand|warm] [--ranks=R1,R2,...] [--backend=cpu|cuda] [--sparse-format=csr|sell] [--sell-sigma=S] [--segments=S] [--segment-split=NNZ] [--center=none|rows|cols|both] [--checkpoint=FILE] [--checkpoint-every=SEC] [--resume]
  *****************************************************************************/
 
  #include <stdio.h>
  #include <stdlib.h>
  #include <string.h>
+ #include <unistd.h>
  #include <omp.h>
  #include "../common/svds.h"  // This header includes the definition of mat and the svds_C_dense function
+ #include "../common/csv_loader.h"
+ #include "../common/matrix_io.h"
+ #include "../common/recommend.h"
+ 
+ #define SWEEP_MAX_RANKS 64
  
  /*****************************************************************************
   * log_message:
-  *   Logs messages into a log file "svd_log.txt".
+  *   Logs messages into the log file (--log=FILE, default below).
   *****************************************************************************/
+ static const char *log_path = "svd_multi_threaded_log16M_2C.txt";
+ 
  static void log_message(const char *message) {
-     FILE *logfile = fopen("svd_multi_threaded_log16M_2C.txt", "a");
+     FILE *logfile = fopen(log_path, "a");
      if (!logfile) {
          fprintf(stderr, "Error opening log file.\n");
          return;
@@ -43,53 +152,6 @@
      fclose(logfile);
  }
  
- /*****************************************************************************
-  * fill_matrix_from_csv:
-  *   Reads lines "user_id,movie_id,rating" from 'filename',
-  *   and places each rating in row-major order:
-  *     A->d[row * A->ncols + col] = rating
-  *   Skips one header line if present.
-  * Returns 0 on success, nonzero on error.
-  *****************************************************************************/
- static int fill_matrix_from_csv(const char *filename, mat *A, int num_rows, int num_cols) {
-     if (!A || !A->d) {
-         log_message("[fill_matrix_from_csv] Error: invalid 'mat' pointer.");
-         return 1;
-     }
-     // Check dimensions.
-     if (A->nrows != num_rows || A->ncols != num_cols) {
-         log_message("[fill_matrix_from_csv] Mismatch: A->nrows/ncols vs. function args.");
-         return 2;
-     }
- 
-     FILE *fp = fopen(filename, "r");
-     if (!fp) {
-         log_message("[fill_matrix_from_csv] Error: cannot open CSV file.");
-         return 3;
-     }
- 
-     // Skip header line (if any).
-     char line[256];
-     if (fgets(line, sizeof(line), fp) == NULL) {
-         fclose(fp);
-         return 4; // Possibly empty file.
-     }
- 
-     // Read each subsequent line.
-     while (fgets(line, sizeof(line), fp)) {
-         int uid, mid;
-         double rating;
-         if (sscanf(line, "%d,%d,%lf", &uid, &mid, &rating) == 3) {
-             if (uid >= 0 && uid < num_rows && mid >= 0 && mid < num_cols) {
-                 int idx = uid * A->ncols + mid;
-                 A->d[idx] = rating;
-             }
-         }
-     }
-     fclose(fp);
-     return 0;
- }
- 
  /*****************************************************************************
   * save_one_matrix:
   *   Helper function to write one matrix M to file fp in binary format.
@@ -104,24 +166,189 @@
      }
      fwrite(&M->nrows, sizeof(int), 1, fp);
      fwrite(&M->ncols, sizeof(int), 1, fp);
-     fwrite(M->d, sizeof(double), (size_t)(M->nrows * M->ncols), fp);
+     fwrite(M->d, sizeof(double), (size_t)M->nrows * M->ncols, fp);
  }
  
  /*****************************************************************************
   * save_matrices:
-  *   Writes Uk, Sk, Vk to "svd_mpi_results.dat" in binary format.
+  *   Writes Uk, Sk, Vk to path ("svd_mpi_results.dat") in binary format.
   *****************************************************************************/
- static void save_matrices(const mat *Uk, const mat *Sk, const mat *Vk) {
-     FILE *fp = fopen("svd_mpi_results.dat", "wb");
+ static void save_matrices(const char *path, const mat *Uk, const mat *Sk, const mat *Vk) {
+     char msg[256];
+     FILE *fp = fopen(path, "wb");
      if (!fp) {
-         log_message("[save_matrices] Could not open svd_mpi_results.dat for writing.");
+         snprintf(msg, sizeof(msg), "[save_matrices] Could not open %s for writing.", path);
+         log_message(msg);
          return;
      }
      save_one_matrix(Uk, fp);
      save_one_matrix(Sk, fp);
      save_one_matrix(Vk, fp);
      fclose(fp);
-     log_message("[save_matrices] Saved Uk, Sk, Vk to 'svd_mpi_results.dat'.");
+     snprintf(msg, sizeof(msg), "[save_matrices] Saved Uk, Sk, Vk to '%s'.", path);
+     log_message(msg);
+ }
+ 
+ /*****************************************************************************
+  * save_rank_sweep:
+  *   Writes the factors of every rank of --ranks and the energy curve.
+  *   fro2 = ||A||_F^2, or 0 when A was not kept in memory.
+  *****************************************************************************/
+ static void save_rank_sweep(const mat *Uk, const mat *Sk, const mat *Vk, const int *ranks, int nranks, double fro2) {
+     char path[64], msg[256];
+     mat *Ur[SWEEP_MAX_RANKS], *Sr[SWEEP_MAX_RANKS], *Vr[SWEEP_MAX_RANKS];
+     double *energy = (double*)malloc(Sk->nrows * sizeof(double));
+     int i;
+     if (svds_split_ranks(Uk, Sk, Vk, ranks, nranks, Ur, Sr, Vr, energy) != 0) {
+         log_message("[save_rank_sweep] A rank is larger than the solve; nothing saved.");
+         free(energy);
+         return;
+     }
+     for (i = 0; i < nranks; i++) {
+         snprintf(path, sizeof(path), "svd_mpi_results_K%d.dat", ranks[i]);
+         save_matrices(path, Ur[i], Sr[i], Vr[i]);
+         if (fro2 > 0)
+             snprintf(msg, sizeof(msg), "Rank %d captures energy %.6e (%.4f%% of ||A||_F^2).", ranks[i], energy[ranks[i]-1], 100.0 * energy[ranks[i]-1] / fro2);
+         else
+             snprintf(msg, sizeof(msg), "Rank %d captures energy %.6e.", ranks[i], energy[ranks[i]-1]);
+         log_message(msg);
+         matrix_delete(Ur[i]);
+         matrix_delete(Sr[i]);
+         matrix_delete(Vr[i]);
+     }
+     FILE *fp = fopen("svd_energy.csv", "w");
+     if (!fp) {
+         log_message("[save_rank_sweep] Could not open svd_energy.csv for writing.");
+     } else {
+         fprintf(fp, "rank,singular_value,energy,fraction\n");
+         for (i = 0; i < Sk->nrows; i++) {
+             if (fro2 > 0)
+                 fprintf(fp, "%d,%.10g,%.10g,%.8f\n", i + 1, Sk->d[i], energy[i], energy[i] / fro2);
+             else
+                 fprintf(fp, "%d,%.10g,%.10g,\n", i + 1, Sk->d[i], energy[i]);
+         }
+         fclose(fp);
+         log_message("[save_rank_sweep] Saved the energy curve to 'svd_energy.csv'.");
+     }
+     free(energy);
+ }
+ 
+ /*****************************************************************************
+  * solve_segments:
+  *   Factorizes the nseg row blocks of A independently at rank K in one
+  *   batch and saves each to "svd_segment_<s>.dat". Returns the number of
+  *   segments that could not be solved.
+  *****************************************************************************/
+ static int solve_segments(const mat_csr *A, int nseg, int K, double tol, int maxiter, svds_reorth reorth, long long split_nnz) {
+     char msg[256];
+     svds_batch_item *items = (svds_batch_item*)calloc(nseg, sizeof(svds_batch_item));
+     int s, failed;
+     for (s = 0; s < nseg; s++) {
+         int r0 = (int)((long long)A->nrows * s / nseg), r1 = (int)((long long)A->nrows * (s + 1) / nseg), r;
+         // a view of rows r0..r1-1: the row pointers are copied, the entries shared
+         mat_csr *B = csr_matrix_new();
+         B->nrows = r1 - r0;
+         B->ncols = A->ncols;
+         B->nnz = A->pointerE[r1 - 1] - A->pointerB[r0];
+         B->values = A->values;
+         B->cols = A->cols;
+         B->pointerB = (long long*)malloc(max(B->nrows, 1) * sizeof(long long));
+         B->pointerE = (long long*)malloc(max(B->nrows, 1) * sizeof(long long));
+         for (r = r0; r < r1; r++) {
+             B->pointerB[r - r0] = A->pointerB[r];
+             B->pointerE[r - r0] = A->pointerE[r];
+         }
+         items[s].A = B;
+         items[s].k = K;
+     }
+     double t = omp_get_wtime();
+     failed = svds_C_batch(items, nseg, tol, maxiter, reorth, split_nnz);
+     t = omp_get_wtime() - t;
+     double busy = 0;
+     for (s = 0; s < nseg; s++)
+         busy += items[s].seconds;
+     snprintf(msg, sizeof(msg), "Solved %d of %d segments at rank %d in %.6f sec (%.2f solves/sec, %.6f sec summed over the solves).", nseg - failed, nseg, K, t, t > 0 ? (nseg - failed) / t : 0.0, busy);
+     log_message(msg);
+     for (s = 0; s < nseg; s++) {
+         char path[64];
+         if (items[s].status) {
+             snprintf(msg, sizeof(msg), "Segment %d (%d users, %lld ratings) is too small for rank %d, skipped.", s, items[s].A->nrows, items[s].A->nnz, K);
+             log_message(msg);
+         } else {
+             snprintf(path, sizeof(path), "svd_segment_%d.dat", s);
+             save_matrices(path, items[s].Uk, items[s].Sk, items[s].Vk);
+             matrix_delete(items[s].Uk);
+             matrix_delete(items[s].Sk);
+             matrix_delete(items[s].Vk);
+         }
+         free(items[s].A->pointerB);
+         free(items[s].A->pointerE);
+         free(items[s].A);
+     }
+     free(items);
+     return failed;
+ }
+ 
+ /*****************************************************************************
+  * release_input:
+  *   Frees the double-precision input matrix; safe to call twice.
+  *****************************************************************************/
+ static void release_input(int from_cache, mat *A, mat_csr **Acsr, mapped_file *cache) {
+     if (from_cache) {
+         // A points into the mapping, only the CSR shell (and A^T) is ours.
+         if (*Acsr && (*Acsr)->At) csr_matrix_delete((*Acsr)->At);
+         free(*Acsr);
+         matrix_cache_unmap(cache);
+     } else {
+         free(A->d);
+         if (*Acsr) csr_matrix_delete(*Acsr);
+     }
+     A->d = NULL;
+     *Acsr = NULL;
+ }
+ 
+ /*****************************************************************************
+  * log_stats:
+  *   Logs the per-phase breakdown of a Lanczos solve (library built with
+  *   -DSVDS_STATS).
+  *****************************************************************************/
+ static void log_stats(const svds_stats *st) {
+     char msg[256];
+     int p, r, len;
+     snprintf(msg, sizeof(msg), "Lanczos phases (%.6f sec in the solver, %d restarts):", st->total_seconds, st->restarts);
+     log_message(msg);
+     for (p = 0; p < SVDS_NPHASES; p++) {
+         snprintf(msg, sizeof(msg), "  %-10s %10.6f sec %8lld calls %8.2f GFLOP/s %8.2f GB/s",
+                  svds_phase_name((svds_phase)p), st->seconds[p], st->calls[p],
+                  svds_stats_gflops(st, (svds_phase)p), svds_stats_gbs(st, (svds_phase)p));
+         log_message(msg);
+     }
+     len = snprintf(msg, sizeof(msg), "  converged/basis after each pass:");
+     for (r = 0; r <= st->restarts && r < SVDS_STATS_MAX_RESTARTS && len < (int)sizeof(msg) - 16; r++)
+         len += snprintf(msg + len, sizeof(msg) - len, " %d/%d", st->converged[r], st->basis[r]);
+     log_message(msg);
+     snprintf(msg, sizeof(msg), "  %d triplets locked at the end.", st->locked);
+     log_message(msg);
+ }
+ 
+ /*****************************************************************************
+  * input_bytes:
+  *   Peak memory of loading A in the given format and keeping it for the
+  *   solve: the COO triplets and the CSR arrays coexist while converting, a
+  *   transposed copy doubles the CSR arrays, and mixed precision briefly
+  *   holds both copies of A.
+  *****************************************************************************/
+ static size_t input_bytes(int sparse, int nrows, int ncols, long long nnz, int transpose_copy, int mixed) {
+     if (!sparse) {
+         size_t dense = matrix_bytes(nrows, ncols);
+         return mixed ? dense + dense / 2 : dense;
+     }
+     size_t csr = csr_matrix_bytes(nrows, nnz);
+     size_t coo = (size_t)nnz * (2 * sizeof(int) + sizeof(double));
+     size_t held = csr + (transpose_copy ? csr_matrix_bytes(ncols, nnz) : 0);
+     if (mixed)
+         held += held / 2;
+     return max(coo + csr, held);
  }
  
  /*****************************************************************************
@@ -131,8 +358,13 @@
  int main(int argc, char *argv[]) {
      double total_time_start = omp_get_wtime();
  
+     // first, so that every later message (usage included) goes to the chosen log
+     for (int a = 1; a < argc; a++) {
+         if (strncmp(argv[a], "--log=", 6) == 0)
+             log_path = argv[a] + 6;
+     }
      if (argc < 5) {
-         log_message("Usage: <csv_file> <num_rows> <num_cols> <K>");
+         log_message("Usage: <csv_file> <num_rows> <num_cols> <K> [--sparse] [--transpose-copy] [--solver=lanczos|block|randomized] [--blocksize=P] [--oversample=P] [--power=Q] [--reorth=full|cgs2|partial] [--tol=EPS] [--maxiter=N] [--maxbasis=B] [--time-budget=SEC] [--precision=double|mixed] [--mode=dense|sparse|auto|stream] [--mem-budget=GB] [--panel-mb=MB] [--numa=first-touch|interleave] [--save-cache=FILE] [--update-from=FILE] [--update=brand|warm] [--ranks=R1,R2,...] [--backend=cpu|cuda] [--sparse-format=csr|sell] [--sell-sigma=S] [--segments=S] [--segment-split=NNZ] [--center=none|rows|cols|both] [--checkpoint=FILE] [--checkpoint-every=SEC] [--resume] [--log=FILE]");
          return 1;
      }
  
@@ -140,53 +372,640 @@
      int num_rows = atoi(argv[2]);
      int num_cols = atoi(argv[3]);
      int K = atoi(argv[4]);
+     int sparse = 0;
+     int transpose_copy = 0;
+     const char *solver = "lanczos";
+     int blocksize = 8;
+     int oversample = 10;
+     int power_iters = 2;
+     const char *save_cache = NULL;
+     const char *reorth_name = "full";
+     const char *precision = "double";
+     const char *mode = NULL;
+     double mem_budget_gb = 0;
+     double panel_mb = 256;
+     const char *numa = "first-touch";
+     const char *update_from = NULL;
+     const char *update = "brand";
+     double tol = 1e-10;
+     int maxiter = 0; // 10, 20 for the block solver
+     int maxbasis = 0; // max(3*K, 15), svds_block_basis for the block solver
+     int stop_set = 0; // any of the three given
+     int ranks[SWEEP_MAX_RANKS];
+     int nranks = 0;
+     const char *backend = "cpu";
+     double time_budget = 0;
+     const char *sparse_format = "csr";
+     int sell_sigma = 4096;
+     int segments = 0;
+     const char *center_name = "none";
+     const char *checkpoint = NULL;
+     double checkpoint_every = 60;
+     int resume = 0;
+     long long segment_split = 0;
+     for (int a = 5; a < argc; a++) {
+         if (strcmp(argv[a], "--sparse") == 0) {
+             sparse = 1;
+         } else if (strcmp(argv[a], "--transpose-copy") == 0) {
+             transpose_copy = 1;
+         } else if (strncmp(argv[a], "--solver=", 9) == 0) {
+             solver = argv[a] + 9;
+         } else if (strncmp(argv[a], "--blocksize=", 12) == 0) {
+             blocksize = atoi(argv[a] + 12);
+         } else if (strncmp(argv[a], "--oversample=", 13) == 0) {
+             oversample = atoi(argv[a] + 13);
+         } else if (strncmp(argv[a], "--power=", 8) == 0) {
+             power_iters = atoi(argv[a] + 8);
+         } else if (strncmp(argv[a], "--reorth=", 9) == 0) {
+             reorth_name = argv[a] + 9;
+         } else if (strncmp(argv[a], "--tol=", 6) == 0) {
+             tol = atof(argv[a] + 6);
+             stop_set = 1;
+         } else if (strncmp(argv[a], "--maxiter=", 10) == 0) {
+             maxiter = atoi(argv[a] + 10);
+             stop_set = 1;
+         } else if (strncmp(argv[a], "--maxbasis=", 11) == 0) {
+             maxbasis = atoi(argv[a] + 11);
+             stop_set = 1;
+         } else if (strncmp(argv[a], "--time-budget=", 14) == 0) {
+             time_budget = atof(argv[a] + 14);
+         } else if (strncmp(argv[a], "--sparse-format=", 16) == 0) {
+             sparse_format = argv[a] + 16;
+         } else if (strncmp(argv[a], "--sell-sigma=", 13) == 0) {
+             sell_sigma = atoi(argv[a] + 13);
+         } else if (strncmp(argv[a], "--checkpoint=", 13) == 0) {
+             checkpoint = argv[a] + 13;
+         } else if (strncmp(argv[a], "--checkpoint-every=", 19) == 0) {
+             checkpoint_every = atof(argv[a] + 19);
+         } else if (strcmp(argv[a], "--resume") == 0) {
+             resume = 1;
+         } else if (strncmp(argv[a], "--center=", 9) == 0) {
+             center_name = argv[a] + 9;
+         } else if (strncmp(argv[a], "--segments=", 11) == 0) {
+             segments = atoi(argv[a] + 11);
+         } else if (strncmp(argv[a], "--segment-split=", 16) == 0) {
+             segment_split = atoll(argv[a] + 16);
+         } else if (strncmp(argv[a], "--backend=", 10) == 0) {
+             backend = argv[a] + 10;
+         } else if (strncmp(argv[a], "--ranks=", 8) == 0) {
+             const char *p = argv[a] + 8;
+             char *end;
+             nranks = 0;
+             while (*p && nranks < SWEEP_MAX_RANKS) {
+                 ranks[nranks++] = (int)strtol(p, &end, 10);
+                 if (end == p || ranks[nranks-1] < 1) {
+                     log_message("Error: --ranks must be a comma-separated list of positive ranks.");
+                     return 1;
+                 }
+                 p = *end == ',' ? end + 1 : end;
+             }
+         } else if (strncmp(argv[a], "--precision=", 12) == 0) {
+             precision = argv[a] + 12;
+         } else if (strncmp(argv[a], "--mode=", 7) == 0) {
+             mode = argv[a] + 7;
+         } else if (strncmp(argv[a], "--mem-budget=", 13) == 0) {
+             mem_budget_gb = atof(argv[a] + 13);
+         } else if (strncmp(argv[a], "--panel-mb=", 11) == 0) {
+             panel_mb = atof(argv[a] + 11);
+         } else if (strncmp(argv[a], "--numa=", 7) == 0) {
+             numa = argv[a] + 7;
+         } else if (strncmp(argv[a], "--save-cache=", 13) == 0) {
+             save_cache = argv[a] + 13;
+         } else if (strncmp(argv[a], "--update-from=", 14) == 0) {
+             update_from = argv[a] + 14;
+         } else if (strncmp(argv[a], "--update=", 9) == 0) {
+             update = argv[a] + 9;
+         }
+     }
+     for (int r = 0; r < nranks; r++)
+         K = max(K, ranks[r]);
+     int block_basis = maxbasis; // 0 until the block size is known
+     if (maxbasis == 0)
+         maxbasis = max(3*K, 15);
+     int block = strcmp(solver, "block") == 0;
+     int randomized = strcmp(solver, "randomized") == 0;
+     if (!block && !randomized && strcmp(solver, "lanczos") != 0) {
+         log_message("Error: --solver must be 'lanczos', 'block' or 'randomized'.");
+         return 1;
+     }
+     svds_reorth reorth;
+     if (strcmp(reorth_name, "full") == 0) {
+         reorth = SVDS_REORTH_FULL;
+     } else if (strcmp(reorth_name, "cgs2") == 0) {
+         reorth = SVDS_REORTH_CGS2;
+     } else if (strcmp(reorth_name, "partial") == 0) {
+         reorth = SVDS_REORTH_PARTIAL;
+     } else {
+         log_message("Error: --reorth must be 'full', 'cgs2' or 'partial'.");
+         return 1;
+     }
+     int mixed = strcmp(precision, "mixed") == 0;
+     if (!mixed && strcmp(precision, "double") != 0) {
+         log_message("Error: --precision must be 'double' or 'mixed'.");
+         return 1;
+     }
+     if (mixed && (block || randomized)) {
+         log_message("Error: --precision=mixed is only available with --solver=lanczos.");
+         return 1;
+     }
+     int sell = strcmp(sparse_format, "sell") == 0;
+     if (!sell && strcmp(sparse_format, "csr") != 0) {
+         log_message("Error: --sparse-format must be 'csr' or 'sell'.");
+         return 1;
+     }
+     if (sell && (block || randomized || mixed || sell_sigma < 1)) {
+         log_message("Error: --sparse-format=sell needs the Lanczos solver in double precision and --sell-sigma >= 1.");
+         return 1;
+     }
+     if (sell)
+         sparse = 1;
+     if (segments < 0 || segments > num_rows || (segments > 0 && (block || randomized || mixed || sell || nranks > 0))) {
+         log_message("Error: --segments needs 0..num_rows segments and the default Lanczos solver in double precision, without --ranks.");
+         return 1;
+     }
+     if (segments > 0)
+         sparse = 1;
+     int center_rows = strcmp(center_name, "rows") == 0 || strcmp(center_name, "both") == 0;
+     int center_cols = strcmp(center_name, "cols") == 0 || strcmp(center_name, "both") == 0;
+     int center = center_rows || center_cols;
+     if (!center && strcmp(center_name, "none") != 0) {
+         log_message("Error: --center must be 'none', 'rows', 'cols' or 'both'.");
+         return 1;
+     }
+     if (center && (block || randomized || mixed || sell || segments > 0)) {
+         log_message("Error: --center needs the default Lanczos solver in double precision on a CSR matrix.");
+         return 1;
+     }
+     if (center)
+         sparse = 1;
+     if ((checkpoint || resume) && (block || randomized || mixed || segments > 0 || !checkpoint || checkpoint_every < 0)) {
+         log_message("Error: --checkpoint=FILE (and --resume) need the default Lanczos solver in double precision and --checkpoint-every >= 0.");
+         return 1;
+     }
+     if (tol <= 0 || maxiter < 0 || maxbasis <= K || maxbasis > min(num_rows, num_cols)) {
+         log_message("Error: need --tol > 0, --maxiter >= 0 and K < --maxbasis <= min(num_rows, num_cols).");
+         return 1;
+     }
+     if (randomized && (stop_set || time_budget > 0)) {
+         log_message("Error: the randomized solver makes a fixed number of passes; --tol, --maxiter, --maxbasis and --time-budget do not apply.");
+         return 1;
+     }
+     if (block && time_budget > 0) {
+         log_message("Error: --time-budget needs the Lanczos solver; bound the block solver with --maxiter.");
+         return 1;
+     }
+     if (block && (blocksize < 1 || blocksize > num_cols)) {
+         log_message("Error: --blocksize must be between 1 and num_cols.");
+         return 1;
+     }
+     if (strcmp(backend, "cuda") == 0) {
+         if (svds_set_backend(SVDS_BACKEND_CUDA) != 0)
+             log_message("Warning: --backend=cuda needs a build with -DSVD_USE_CUDA and a CUDA device; solving on the CPU.");
+         else if (block || randomized || mixed || sell || center || checkpoint || (update_from && strcmp(update, "warm") != 0))
+             log_message("Warning: only the double-precision Lanczos solve runs on the GPU; this one stays on the CPU.");
+         else if (reorth != SVDS_REORTH_FULL)
+             log_message("Warning: the GPU solve always reorthogonalizes fully, keeps a fixed basis and locks nothing; --reorth is not used.");
+         else
+             log_message("Note: the GPU solve keeps a fixed basis of --maxbasis and locks nothing.");
+     } else if (strcmp(backend, "cpu") != 0) {
+         log_message("Error: --backend must be 'cpu' or 'cuda'.");
+         return 1;
+     }
+     if (strcmp(numa, "interleave") == 0) {
+         if (matrix_set_interleave(1) != 0)
+             log_message("Warning: --numa=interleave needs a build with -DSVD_USE_NUMA and a NUMA kernel; using first touch.");
+     } else if (strcmp(numa, "first-touch") != 0) {
+         log_message("Error: --numa must be 'first-touch' or 'interleave'.");
+         return 1;
+     }
+     int auto_mode = 0;
+     int stream = 0;
+     if (mode) {
+         if (strcmp(mode, "auto") == 0) {
+             auto_mode = 1;
+         } else if (strcmp(mode, "stream") == 0) {
+             stream = 1;
+         } else if (strcmp(mode, "sparse") == 0) {
+             sparse = 1;
+         } else if (strcmp(mode, "dense") == 0) {
+             sparse = 0;
+         } else {
+             log_message("Error: --mode must be 'dense', 'sparse', 'auto' or 'stream'.");
+             return 1;
+         }
+     }
+     int brand = 0, warm = 0;
+     if (update_from) {
+         brand = strcmp(update, "brand") == 0;
+         warm = strcmp(update, "warm") == 0;
+         if (!brand && !warm) {
+             log_message("Error: --update must be 'brand' or 'warm'.");
+             return 1;
+         }
+         if (block || randomized || mixed || stream || segments > 0 || (brand && (sell || center || checkpoint))) {
+             log_message("Error: --update-from needs the default Lanczos solver in double precision, in memory.");
+             return 1;
+         }
+         if (brand)
+             sparse = 1; // the new ratings are a sparse delta
+     }
+     size_t panel_bytes = (size_t)(panel_mb * 1e6);
+     if (panel_bytes < 4096) {
+         log_message("Error: --panel-mb must be at least 0.004.");
+         return 1;
+     }
  
      char log_msg[256];
-     snprintf(log_msg, sizeof(log_msg), "Building matrix from '%s' with dimensions %dx%d, computing rank-%d truncated SVD.", csv_file, num_rows, num_cols, K);
-     log_message(log_msg);
+     // A binary cache carries its own format, which overrides --sparse.
+     matrix_cache_header cache_hdr;
+     int cache_kind = matrix_cache_kind(csv_file, &cache_hdr);
+     if (cache_kind >= 0) {
+         if (cache_hdr.nrows != num_rows || cache_hdr.ncols != num_cols) {
+             snprintf(log_msg, sizeof(log_msg), "Error: cache '%s' holds a %dx%d matrix, expected %dx%d.", csv_file, cache_hdr.nrows, cache_hdr.ncols, num_rows, num_cols);
+             log_message(log_msg);
+             return 1;
+         }
+         sparse = cache_kind == MATRIX_CACHE_CSR;
+         if ((sell || segments > 0 || center) && !sparse) {
+             log_message("Error: --sparse-format=sell, --segments and --center need sparse input, not a dense cache.");
+             return 1;
+         }
+         if (brand && !sparse) {
+             log_message("Error: --update=brand reads the new ratings as a CSV or a sparse cache.");
+             return 1;
+         }
+     } else if (stream) {
+         log_message("Error: --mode=stream reads a binary cache; write one first with --save-cache=FILE.");
+         return 1;
+     }
  
-     // 1) Allocate the dense matrix A.
-     mat A;
-     A.nrows = num_rows;
-     A.ncols = num_cols;
-     A.d = (double*) calloc((size_t)(A.nrows * A.ncols), sizeof(double));
-     if (!A.d) {
-         log_message("Error: allocation failed for A->d");
+     // Estimate the footprint before allocating anything.
+     size_t budget = (size_t)(mem_budget_gb * 1e9);
+     if (budget == 0)
+         budget = (size_t)sysconf(_SC_PHYS_PAGES) * (size_t)sysconf(_SC_PAGESIZE);
+     long long nnz_est = cache_kind >= 0 ? cache_hdr.nnz : 0;
+     if (cache_kind < 0 && csv_estimate_nnz(csv_file, &nnz_est) != 0)
+         nnz_est = 0; // unreadable, reported by the loader below
+     size_t ws_bytes = svds_workspace_bytes(num_rows, num_cols, K, maxbasis);
+     size_t dense_bytes = input_bytes(0, num_rows, num_cols, nnz_est, transpose_copy || sell, mixed) + ws_bytes;
+     size_t sparse_bytes = input_bytes(1, num_rows, num_cols, nnz_est, transpose_copy || sell, mixed) + ws_bytes;
+     if (auto_mode && cache_kind < 0 && !brand && !sell && segments == 0 && !center) {
+         if (dense_bytes <= budget) {
+             sparse = 0;
+         } else if (sparse_bytes <= budget) {
+             sparse = 1;
+         } else {
+             snprintf(log_msg, sizeof(log_msg), "Error: ~%lld nonzeros need %.3f GB even as CSR, over the %.3f GB budget; run the MPI driver on at least %d ranks, or a binary cache with --mode=stream.",
+                      nnz_est, sparse_bytes / 1e9, budget / 1e9, (int)((sparse_bytes + budget - 1) / budget));
+             log_message(log_msg);
+             return 1;
+         }
+     }
+     // Out of core: the block solver's bases and blocks plus two panels.
+     // U, V, one block each and the K + P Ritz vectors kept over restarts
+     int stream_p = block ? blocksize : min(16, num_cols);
+     int stream_b = block_basis ? max(block_basis, K + stream_p) : svds_block_basis(num_rows, num_cols, K, stream_p);
+     size_t stream_bytes = matrix_bytes(num_rows, stream_b + 2*stream_p + K) + matrix_bytes(num_cols, stream_b + 3*stream_p + K)
+         + matrix_stream_bytes(num_rows, num_cols, nnz_est, sparse, panel_bytes);
+     if (auto_mode && cache_kind >= 0 && !update_from && (sparse ? sparse_bytes : dense_bytes) > budget)
+         stream = 1;
+     if (stream && checkpoint) {
+         log_message("Error: --checkpoint is not available with --mode=stream.");
+         return 1;
+     }
+     if (stream && center) {
+         log_message("Error: --center is not available with --mode=stream.");
+         return 1;
+     }
+     if (stream && segments > 0) {
+         log_message("Error: --segments is not available with --mode=stream.");
          return 1;
      }
+     if (stream && sell) {
+         log_message("Error: --sparse-format=sell is not available with --mode=stream.");
+         return 1;
+     }
+     if (stream && mixed) {
+         log_message("Error: --precision=mixed is not available with --mode=stream.");
+         return 1;
+     }
+     if (stream && (block || !randomized) && time_budget > 0) {
+         log_message("Error: --time-budget is not available with --mode=stream, whose block solver stops after --maxiter restarts.");
+         return 1;
+     }
+     if (stream && !block && !randomized) {
+         // one scan of the file per Lanczos vector would be far too slow
+         block = 1;
+         blocksize = stream_p;
+         snprintf(log_msg, sizeof(log_msg), "Streaming A from disk: switching to the block solver with block size %d.", blocksize);
+         log_message(log_msg);
+     }
+     if (block && block_basis == 0)
+         block_basis = svds_block_basis(num_rows, num_cols, K, blocksize);
+     else if (block) // K plus whole blocks, as the solver cuts it
+         block_basis = K + max((block_basis - K) / blocksize, 1) * blocksize;
+     if (maxiter == 0)
+         maxiter = block ? 20 : 10;
+     size_t need = stream ? stream_bytes : sparse ? sparse_bytes : dense_bytes;
+     snprintf(log_msg, sizeof(log_msg), "Estimated memory: %.3f GB dense, %.3f GB sparse, %.3f GB streamed (~%lld nonzeros), budget %.3f GB.", dense_bytes / 1e9, sparse_bytes / 1e9, stream_bytes / 1e9, nnz_est, budget / 1e9);
+     log_message(log_msg);
+     if (need > budget) {
+         snprintf(log_msg, sizeof(log_msg), "Warning: the %s format needs ~%.3f GB, more than the %.3f GB budget.", stream ? "streamed" : sparse ? "sparse" : "dense", need / 1e9, budget / 1e9);
+         log_message(log_msg);
+     }
+     snprintf(log_msg, sizeof(log_msg), "%s %s matrix from '%s' with dimensions %dx%d, computing rank-%d truncated SVD.", stream ? "Streaming" : "Building", sparse ? "sparse" : "dense", csv_file, num_rows, num_cols, K);
+     log_message(log_msg);
+ 
+     // The previous factors, users x movies of at most the current shape.
+     svd_model prev;
+     memset(&prev, 0, sizeof(prev));
+     if (update_from) {
+         int merr = svd_model_load(update_from, &prev);
+         if (merr || prev.nusers > num_rows || prev.nmovies > num_cols || (brand && prev.k != K)) {
+             snprintf(log_msg, sizeof(log_msg), "Error: '%s' is not a rank-%d factorization of at most %dx%d (code=%d).", update_from, K, num_rows, num_cols, merr);
+             log_message(log_msg);
+             if (!merr)
+                 svd_model_free(&prev);
+             return 1;
+         }
+         snprintf(log_msg, sizeof(log_msg), "Updating the rank-%d factorization of %dx%d from '%s' (%s).", prev.k, prev.nusers, prev.nmovies, update_from, brand ? "new ratings folded in" : "warm-started solve");
+         log_message(log_msg);
+     }
  
-     // 2) Fill matrix from CSV.
+     mat A;
+     A.d = NULL;
+     mat_csr *Acsr = NULL;
+     mapped_file cache = {NULL, 0, NULL};
+     matrix_stream As;
+     memset(&As, 0, sizeof(As));
+     As.fd = -1;
      double t_csv = omp_get_wtime();
-     int err = fill_matrix_from_csv(csv_file, &A, num_rows, num_cols);
+     int err;
+     if (stream) {
+         // 1-2) Only the row pointers are read now, A itself during the solve.
+         err = matrix_stream_open(csv_file, panel_bytes, &As);
+     } else if (cache_kind == MATRIX_CACHE_CSR) {
+         // 1-2) Map the CSR arrays straight from the cache.
+         Acsr = csr_matrix_new();
+         err = matrix_cache_map_csr(csv_file, 0, num_rows, Acsr, &cache);
+     } else if (cache_kind == MATRIX_CACHE_DENSE) {
+         err = matrix_cache_map_dense(csv_file, 0, num_rows, &A, &cache);
+     } else if (sparse) {
+         // 1-2) Read the ratings as triplets and convert them to CSR.
+         mat_coo *Acoo = NULL;
+         err = csv_read_coo(csv_file, 0, num_rows, num_cols, &Acoo);
+         if (!err) {
+             Acsr = csr_matrix_new();
+             csr_init_from_coo(Acsr, Acoo);
+             coo_matrix_delete(Acoo);
+         }
+     } else {
+         // 1) Allocate the dense matrix A.
+         A.nrows = num_rows;
+         A.ncols = num_cols;
+         A.d = matrix_alloc_placed(A.nrows, A.ncols);
+         if (!A.d) {
+             log_message("Error: allocation failed for A->d");
+             return 1;
+         }
+ 
+         // 2) Fill matrix from CSV.
+         err = csv_read_dense(csv_file, 0, &A);
+     }
      t_csv = omp_get_wtime() - t_csv;
      if (err) {
-         snprintf(log_msg, sizeof(log_msg), "Error reading CSV (code=%d)", err);
+         snprintf(log_msg, sizeof(log_msg), "Error reading %s (code=%d)", cache_kind >= 0 ? "cache" : "CSV", err);
          log_message(log_msg);
-         free(A.d);
+         if (stream) {
+             matrix_stream_close(&As);
+         } else if (cache_kind >= 0) {
+             free(Acsr);
+         } else {
+             free(A.d);
+             if (Acsr) csr_matrix_delete(Acsr);
+         }
+         if (update_from) svd_model_free(&prev);
          return 1;
      }
-     snprintf(log_msg, sizeof(log_msg), "CSV reading & matrix filling took %.6f sec.", t_csv);
+     snprintf(log_msg, sizeof(log_msg), "%s took %.6f sec.", stream ? "Opening the binary cache" : cache_kind >= 0 ? "Mapping the binary cache" : "CSV reading & matrix filling", t_csv);
      log_message(log_msg);
+     if (stream) {
+         snprintf(log_msg, sizeof(log_msg), "Streaming %s in %d panels of up to %.1f MB.", sparse ? "row panels" : "column panels", As.npanels, As.buf_bytes / 1e6);
+         log_message(log_msg);
+     }
+     if (save_cache && cache_kind < 0) {
+         double t_cache = omp_get_wtime();
+         err = sparse ? matrix_cache_save_csr(save_cache, Acsr) : matrix_cache_save_dense(save_cache, &A);
+         t_cache = omp_get_wtime() - t_cache;
+         if (err)
+             snprintf(log_msg, sizeof(log_msg), "Error writing cache '%s' (code=%d)", save_cache, err);
+         else
+             snprintf(log_msg, sizeof(log_msg), "Saved binary cache '%s' in %.6f sec.", save_cache, t_cache);
+         log_message(log_msg);
+     }
+     if (sparse && !stream) {
+         snprintf(log_msg, sizeof(log_msg), "Sparse matrix holds %lld nonzeros (density %.4f%%).", Acsr->nnz, 100.0 * Acsr->nnz / ((double)num_rows * num_cols));
+         log_message(log_msg);
+         if (transpose_copy) {
+             double t_tr = omp_get_wtime();
+             csr_matrix_build_transpose(Acsr);
+             t_tr = omp_get_wtime() - t_tr;
+             snprintf(log_msg, sizeof(log_msg), "Building the transposed copy took %.6f sec.", t_tr);
+             log_message(log_msg);
+         }
+     }
+     if (segments > 0) {
+         err = solve_segments(Acsr, segments, K, tol, maxiter, reorth, segment_split);
+         release_input(cache_kind >= 0, &A, &Acsr, &cache);
+         snprintf(log_msg, sizeof(log_msg), "Total program time: %.6f sec.", omp_get_wtime() - total_time_start);
+         log_message(log_msg);
+         return err == segments ? 1 : 0;
+     }
+     // The means behind --center, kept as n x 1 matrices for saving.
+     svds_centering cen;
+     mat row_mean = {0, 0, NULL}, col_mean = {0, 0, NULL}, global_mean = {1, 1, NULL};
+     double g = 0;
+     if (center) {
+         double t_mean = omp_get_wtime();
+         row_mean.nrows = num_rows;
+         col_mean.nrows = num_cols;
+         row_mean.ncols = col_mean.ncols = 1;
+         row_mean.d = (double*)malloc(num_rows * sizeof(double));
+         col_mean.d = (double*)malloc(num_cols * sizeof(double));
+         csr_matrix_means(Acsr, row_mean.d, col_mean.d, &g);
+         global_mean.d = &g;
+         cen.row = center_rows ? row_mean.d : NULL;
+         cen.col = center_cols ? col_mean.d : NULL;
+         cen.bias = center_rows && center_cols ? -g : 0;
+         t_mean = omp_get_wtime() - t_mean;
+         snprintf(log_msg, sizeof(log_msg), "Centering by the %s means (global mean %.6f), computed in %.6f sec.", center_name, g, t_mean);
+         log_message(log_msg);
+     }
+     // ||A||_F^2 for the captured fraction of a rank sweep, while A is at hand
+     // (not that of the centered matrix, so no fraction then)
+     double fro2 = 0;
+     if (nranks > 0 && !stream && !brand && !center) {
+         long long e, len = sparse ? Acsr->nnz : (long long)num_rows * num_cols;
+         const double *vals = sparse ? Acsr->values : A.d;
+         #pragma omp parallel for reduction(+:fro2)
+         for (e = 0; e < len; e++)
+             fro2 += vals[e] * vals[e];
+     }
+     mat_sell *Asell = NULL;
+     if (sell) {
+         // Only the SELL copies of A and A^T are kept for the solve.
+         double t_sl = omp_get_wtime();
+         Asell = sell_matrix_from_csr(Acsr, sell_sigma);
+         release_input(cache_kind >= 0, &A, &Acsr, &cache);
+         t_sl = omp_get_wtime() - t_sl;
+         long long stored = Asell->chunk_ptr[Asell->nchunks];
+         snprintf(log_msg, sizeof(log_msg), "Converting A to SELL-%d-%d took %.6f sec (%.3f MB with A^T, %.2f%% padding in A).", SELL_C, Asell->sigma, t_sl,
+                  sell_matrix_bytes(Asell) / 1e6, stored > 0 ? 100.0 * (stored - Asell->nnz) / stored : 0.0);
+         log_message(log_msg);
+     }
+     mat_f *Af = NULL;
+     mat_csr_f *Acsr_f = NULL;
+     if (mixed) {
+         // Only the float copy is kept for the solve.
+         double t_cv = omp_get_wtime();
+         if (sparse)
+             Acsr_f = csr_matrix_to_float(Acsr);
+         else
+             Af = matrix_to_float(&A);
+         release_input(cache_kind >= 0, &A, &Acsr, &cache);
+         t_cv = omp_get_wtime() - t_cv;
+         snprintf(log_msg, sizeof(log_msg), "Converting A to single precision took %.6f sec.", t_cv);
+         log_message(log_msg);
+     }
  
      // 3) Prepare placeholders for the SVD outputs.
      mat *Uk = NULL, *Sk = NULL, *Vk = NULL;
  
      // 4) Compute the truncated SVD.
      double t_svd = omp_get_wtime();
-     svds_C_dense(&A, &Uk, &Sk, &Vk, K); // This function is internally parallelized.
+     if (brand) {
+         snprintf(log_msg, sizeof(log_msg), "Folding %lld new ratings into the old factors.", Acsr->nnz);
+         log_message(log_msg);
+     } else if (block) {
+         snprintf(log_msg, sizeof(log_msg), "Using block Lanczos with block size %d (tol %g, up to %d restarts of a basis of %d).", blocksize, tol, maxiter, block_basis);
+         log_message(log_msg);
+     } else if (randomized) {
+         snprintf(log_msg, sizeof(log_msg), "Using randomized SVD with oversampling %d and %d power iterations.", oversample, power_iters);
+         log_message(log_msg);
+     } else {
+         snprintf(log_msg, sizeof(log_msg), "Using Lanczos with %s reorthogonalization in %s precision (tol %g, up to %d passes over a basis of %d) on the %s backend.", reorth_name, precision, tol, maxiter, maxbasis, mixed || sell ? "cpu" : svds_backend_name(svds_get_backend()));
+         log_message(log_msg);
+     }
+     // These functions are internally parallelized.
+     svds_stats stats;
+     memset(&stats, 0, sizeof(stats));
+     svds_workspace *ws = NULL;
+     int nconv = K;
+     if (warm || checkpoint) {
+         // the results then live in ws
+         ws = svds_workspace_new(num_rows, num_cols, K, maxbasis);
+         if (warm)
+             svds_workspace_warm_start(ws, &prev.V);
+     }
+     if (checkpoint) {
+         if (resume && access(checkpoint, F_OK) == 0) {
+             err = svds_workspace_resume(ws, checkpoint);
+             if (err)
+                 snprintf(log_msg, sizeof(log_msg), "Warning: cannot resume from '%s' (code=%d), starting afresh.", checkpoint, err);
+             else
+                 snprintf(log_msg, sizeof(log_msg), "Resuming the solve from checkpoint '%s'.", checkpoint);
+             log_message(log_msg);
+         } else if (resume) {
+             snprintf(log_msg, sizeof(log_msg), "No checkpoint '%s' yet, starting afresh.", checkpoint);
+             log_message(log_msg);
+         }
+         if (svds_workspace_checkpoint(ws, checkpoint, checkpoint_every) != 0)
+             log_message("Warning: cannot set up checkpointing, continuing without.");
+     }
+     if (brand) {
+         if (svds_update(&prev.US, &prev.V, Acsr, &Uk, &Sk, &Vk, oversample, power_iters) != 0) {
+             snprintf(log_msg, sizeof(log_msg), "Note: the new ratings touch more than %d rows and columns; approximated with oversampling %d and %d power iterations.", SVDS_UPDATE_EXACT_MAX, oversample, power_iters);
+             log_message(log_msg);
+         }
+     } else if (stream) {
+         if (block)
+             err = svds_C_stream_block_opt(&As, &Uk, &Sk, &Vk, K, blocksize, tol, block_basis, maxiter, &nconv);
+         else
+             err = svds_C_stream_randomized(&As, &Uk, &Sk, &Vk, K, oversample, power_iters);
+     } else if (sparse) {
+         if (block)
+             svds_C_block_opt(Acsr, &Uk, &Sk, &Vk, K, blocksize, tol, block_basis, maxiter, &nconv);
+         else if (randomized)
+             svds_C_randomized(Acsr, &Uk, &Sk, &Vk, K, oversample, power_iters);
+         else if (center)
+             svds_C_centered_opt(Acsr, &cen, &Uk, &Sk, &Vk, K, tol, maxbasis, maxiter, time_budget, reorth, ws, &stats);
+         else if (sell)
+             svds_C_sell_opt(Asell, &Uk, &Sk, &Vk, K, tol, maxbasis, maxiter, time_budget, reorth, ws, &stats);
+         else if (mixed)
+             svds_C_mixed_opt(Acsr_f, &Uk, &Sk, &Vk, K, tol, maxbasis, maxiter, time_budget, reorth, NULL, &stats);
+         else
+             svds_C_opt(Acsr, &Uk, &Sk, &Vk, K, tol, maxbasis, maxiter, time_budget, reorth, ws, &stats);
+     } else {
+         if (block)
+             svds_C_dense_block_opt(&A, &Uk, &Sk, &Vk, K, blocksize, tol, block_basis, maxiter, &nconv);
+         else if (randomized)
+             svds_C_dense_randomized(&A, &Uk, &Sk, &Vk, K, oversample, power_iters);
+         else if (mixed)
+             svds_C_dense_mixed_opt(Af, &Uk, &Sk, &Vk, K, tol, maxbasis, maxiter, time_budget, reorth, NULL, &stats);
+         else
+             svds_C_dense_opt(&A, &Uk, &Sk, &Vk, K, tol, maxbasis, maxiter, time_budget, reorth, ws, &stats);
+     }
      t_svd = omp_get_wtime() - t_svd;
      snprintf(log_msg, sizeof(log_msg), "SVD computation took %.6f sec.", t_svd);
      log_message(log_msg);
+     if (stats.enabled)
+         log_stats(&stats);
+     if (block && nconv < K) {
+         snprintf(log_msg, sizeof(log_msg), "Warning: the block solve stopped after %d restarts with %d of %d triplets within --tol %g; raise --maxiter or --maxbasis.", maxiter, nconv, K, tol);
+         log_message(log_msg);
+     }
+     if (stream) {
+         snprintf(log_msg, sizeof(log_msg), "Streamed %lld scans, %.3f GB: %.6f sec reading, %.6f sec waiting for panels.", As.passes, As.bytes_read / 1e9, As.read_seconds, As.wait_seconds);
+         log_message(log_msg);
+         matrix_stream_close(&As);
+         if (err) {
+             snprintf(log_msg, sizeof(log_msg), "Error reading the cache while streaming (code=%d), no results saved.", err);
+             log_message(log_msg);
+             return 1;
+         }
+     }
  
      // 5) Save the SVD results to a binary file.
      double t_save = omp_get_wtime();
-     save_matrices(Uk, Sk, Vk);
+     save_matrices("svd_mpi_results.dat", Uk, Sk, Vk);
+     if (nranks > 0)
+         save_rank_sweep(Uk, Sk, Vk, ranks, nranks, fro2);
+     if (center)
+         save_matrices("svd_means.dat", &row_mean, &col_mean, &global_mean);
+     // an unconverged solve (walltime, --maxiter) can still be resumed
+     if (checkpoint && ws->nconv < K && access(checkpoint, F_OK) == 0) {
+         snprintf(log_msg, sizeof(log_msg), "Kept checkpoint '%s': %d of %d triplets converged.", checkpoint, ws->nconv, K);
+         log_message(log_msg);
+     } else if (checkpoint && ws->nconv == K && remove(checkpoint) == 0) {
+         snprintf(log_msg, sizeof(log_msg), "Removed checkpoint '%s'.", checkpoint);
+         log_message(log_msg);
+     }
      t_save = omp_get_wtime() - t_save;
      snprintf(log_msg, sizeof(log_msg), "Saving Uk, Sk, Vk took %.6f sec.", t_save);
      log_message(log_msg);
  
      // 6) Free memory.
-     free(A.d);
+     release_input(cache_kind >= 0, &A, &Acsr, &cache);
+     if (Asell) sell_matrix_delete(Asell);
+     free(row_mean.d);
+     free(col_mean.d);
+     if (Af) matrix_f_delete(Af);
+     if (Acsr_f) csr_matrix_f_delete(Acsr_f);
+     if (update_from) svd_model_free(&prev);
+     if (ws) {
+         svds_workspace_delete(ws);
+         Uk = Sk = Vk = NULL;
+     }
      if (Uk) {
          if (Uk->d) free(Uk->d);
          free(Uk);
@@ -14,6 +14,9 @@ module load OpenBLAS-0.3.7
 module load mpich-3.2 
 # Set the number of OpenMP threads to use
 export OMP_NUM_THREADS=2 
+# Pin the threads, so that the row blocks they first touch stay on their socket
+export OMP_PROC_BIND=spread
+export OMP_PLACES=cores
 echo "Using OMP_NUM_THREADS=$OMP_NUM_THREADS"
 
 # Move to the working directory (where you submitted the job)
@@ -21,7 +24,11 @@ cd $PBS_O_WORKDIR
 
 # Compile the code using a shared-memory (OpenMP) compiler
 # Note: You might switch from mpicc to gcc if you are not using MPI calls anymore.
-gcc -fopenmp -o svd_shared_16M_2 multi_threaded.c svds.c matrix_funcs.c \
+# Add -DSVD_USE_NUMA ... -lnuma to enable --numa=interleave.
+# Add -DSVDS_STATS to log a per-phase breakdown (matvec, reorth, small SVD, ...) of the Lanczos solve.
+# Add -march=native (or -mavx2 -mfma) so that --sparse-format=sell uses the AVX2 / AVX-512 gather kernels.
+# Add -DSVD_USE_CUDA (with the CUDA include path) ... -lcudart -lcublas -lcusparse to enable --backend=cuda on a GPU queue.
+gcc -fopenmp -o svd_shared_16M_2 multi_threaded.c svds.c matrix_funcs.c csv_loader.c matrix_io.c recommend.c \
   -I/apps/OpenBLAS-0.3.7/include \
   -I/apps/lapack-3.8.0/include \
   -L/apps/OpenBLAS-0.3.7/lib \
@@ -29,4 +36,29 @@ gcc -fopenmp -o svd_shared_16M_2 multi_threaded.c svds.c matrix_funcs.c \
   -lopenblas -llapacke -lm
 
 # Run the executable (no need for mpirun if using pure OpenMP)
+# Append --sparse to build a CSR matrix and call svds_C instead of the dense solver.
+# With --sparse, --transpose-copy also stores A^T so the A^T*u products scale with threads.
+# --reorth=partial reorthogonalizes the Lanczos basis only when orthogonality is being lost.
+# --sparse-format=sell converts the CSR to SELL-C-sigma for vectorized SpMV in A*v and A^T*u (--sell-sigma=S sets the sort window).
+# --center=both factorizes the ratings minus the user/movie baseline, keeping A sparse (means in svd_means.dat).
+# --checkpoint=svd_checkpoint.bin --resume saves the Lanczos state every --checkpoint-every=SEC (default 60);
+# if the job hits the walltime, resubmit it unchanged and it continues from the last checkpoint.
+# --segments=S factorizes S user blocks independently instead of A as a whole, many solves at once.
+# --precision=mixed stores A in single precision for the Lanczos matvecs (about half the traffic).
+# --numa=interleave spreads A and the bases over both sockets instead of first-touch placement.
+# --mode=auto picks dense or sparse storage from a memory estimate; --mem-budget=GB caps it (default: physical memory).
+# --mode=stream keeps a binary cache on disk and streams it by panels (--panel-mb=MB) through the block
+# or randomized solver, for inputs larger than the node's memory; a large --blocksize means fewer scans.
+# Add --solver=block --blocksize=16 to multiply A by 16 vectors per pass (GEMM/SpMM).
+# Or --solver=randomized --oversample=10 --power=2 for a fixed number of GEMM passes.
+# Add --save-cache=mapped_merged_data_16M.bin once, then pass the .bin file
+# instead of the CSV to skip parsing on later runs.
+# --log=FILE replaces the default log file name (svd_multi_threaded_log16M_2C.txt).
 ./svd_shared_16M_2 mapped_merged_data_16M.csv 139723 906 100
+
+# For thread / solver / K sweeps use ../benchmark/bench_svd.sh, which runs the
+# whole matrix in one job and writes a single CSV of results.
+
+# This driver runs on a single node. For several nodes use the hybrid
+# MPI+OpenMP driver in ../serial_mpi_implementation (serial_svd.sh shows a
+# multi-node configuration with one rank per node and these threads in it).
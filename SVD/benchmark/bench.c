@@ -0,0 +1,637 @@
+/*****************************************************************************
+ * bench.c
+ *
+ * Benchmark harness for the svds solvers, replacing hand-edited job scripts
+ * and scraped text logs with one machine-readable result file.
+ *
+ * 1) Builds the test matrix, either
+ *      --matrix=synthetic: an m x n matrix with a planted spectrum,
+ *        A = sum_r s_r x_r y_r^T (+ noise), s_r = 100*decay^r, x_r and y_r
+ *        Gaussian. Sparse matrices keep each entry with probability
+ *        'density' (scaled by 1/density, so the spectrum is that of the
+ *        dense matrix up to the sampling noise). Every entry is a hash of
+ *        (seed, row, column), so dense and sparse, any thread count and
+ *        any row block of any number of ranks see the same matrix.
+ *      --matrix=FILE: a binary cache written by the drivers' --save-cache
+ *        (matrix_io.c), mapped in the format it was saved with.
+ *
+ * 2) Sweeps solver x threads x k x basis size, repeating each point
+ *    --repeat times. One svds_workspace is made per (threads, k, basis)
+ *    point, after the thread count is set, so its first-touch placement
+ *    matches the run. The MPI build (-DBENCH_MPI) adds the ranks axis:
+ *    mpirun -np R runs the distributed Lanczos solver on R row blocks, and
+ *    the job script sweeps R.
+ *
+ * 3) Appends one record per run to --out (CSV with a header line when the
+ *    file is new, or JSON lines with --json): the configuration, wall time,
+ *    residual max_i max(||A*v_i - s_i*u_i||, ||A^T*u_i - s_i*v_i||) / s_i,
+ *    s_1 and s_k, and, with -DSVDS_STATS, the per-phase time, calls,
+ *    GFLOP/s and GB/s of the Lanczos solvers, the MPI one included (plus
+ *    its collective count, Lanczos steps and time in collectives).
+ *    --weak scales the synthetic row count with ranks x threads.
+ *
+ * Compilation (example):
+ *   gcc -O2 -fopenmp -DSVDS_STATS bench.c ../common/svds.c ../common/matrix_funcs.c ../common/csv_loader.c ../common/matrix_io.c -o svd_bench -lopenblas -llapacke -lm
+ *   mpicc -O2 -fopenmp -DSVDS_STATS -DBENCH_MPI bench.c ../common/svds.c ../common/svds_mpi.c ../common/matrix_funcs.c ../common/csv_loader.c ../common/matrix_io.c -o svd_bench_mpi -lopenblas -llapacke -lm
+ *
+ * Run:
+ *   ./svd_bench [--matrix=synthetic|FILE] [--rows=M] [--cols=N] [--density=P] [--rank=R] [--decay=Q] [--noise=E] [--seed=S]
+ *               [--format=sparse|dense] [--weak] [--solver=lanczos,mixed,block,randomized] [--threads=1,2,4] [--k=10,100]
+ *               [--basis=0] [--blocksize=8] [--repeat=3] [--out=bench_results.csv] [--json] [--tag=NAME]
+ *   (--basis=0 is the default max(3k, 15), svds_block_basis for the block
+ *   solver; for the randomized solver the basis size is k + oversample)
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <omp.h>
+#include <cblas.h>
+#ifdef BENCH_MPI
+#include "../common/svds_mpi.h"
+#else
+#include "../common/svds.h"
+#endif
+#include "../common/matrix_io.h"
+
+#define MAX_LIST 32
+
+typedef struct {
+    int n;
+    int v[MAX_LIST];
+} int_list;
+
+typedef struct {
+    const char *matrix;
+    int rows, cols, rank;
+    double density, decay, noise;
+    unsigned long long seed;
+    int sparse, weak;
+    char solvers[256];
+    int_list threads, ks, bases;
+    int blocksize, repeat, json;
+    const char *out, *tag;
+} bench_opts;
+
+/* the matrix under test: exactly one of Ad / As is set, Af / Asf are the
+   float copies made on first use by the mixed solver */
+typedef struct {
+    int m_global, m, n, row_begin;
+    long long nnz; // over all ranks
+    mat Ad;
+    mat_csr *As;
+    mat_f *Af;
+    mat_csr_f *Asf;
+    mapped_file cache;
+    int from_cache;
+} bench_matrix;
+
+static int rank_id = 0, nranks = 1;
+
+static void parse_list(const char *s, int_list *l)
+{
+    l->n = 0;
+    while (*s && l->n < MAX_LIST) {
+        l->v[l->n++] = atoi(s);
+        s = strchr(s, ',');
+        if (!s)
+            break;
+        s++;
+    }
+}
+
+/* ---- deterministic synthetic entries -------------------------------- */
+
+static uint64_t mix64(uint64_t x)
+{
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+static double next_unif(uint64_t *s)
+{
+    *s = mix64(*s);
+    return ((*s >> 11) + 0.5) * (1.0 / 9007199254740992.0);
+}
+
+static double next_gauss(uint64_t *s)
+{
+    double u1 = next_unif(s), u2 = next_unif(s);
+    return sqrt(-2.0*log(u1)) * cos(6.283185307179586*u2);
+}
+
+static uint64_t stream(uint64_t seed, uint64_t kind, uint64_t index)
+{
+    return mix64(seed ^ mix64(kind * 0x100000001B3ULL + index));
+}
+
+typedef struct {
+    const bench_opts *o;
+    int m, n;
+    double *sy; // n x rank, column factors already multiplied by s_r
+} synth;
+
+static void synth_init(synth *g, const bench_opts *o, int m, int n)
+{
+    int j, r;
+    g->o = o;
+    g->m = m;
+    g->n = n;
+    g->sy = (double*)malloc((size_t)n * o->rank * sizeof(double));
+    for (j = 0; j < n; j++) {
+        uint64_t s = stream(o->seed, 2, j);
+        for (r = 0; r < o->rank; r++)
+            g->sy[(size_t)j*o->rank + r] = 100.0 * pow(o->decay, r) * next_gauss(&s) / sqrt((double)n);
+    }
+}
+
+/* the row factors of global row i, scaled for the sampling density */
+static void synth_row(const synth *g, int i, double scale, double *x)
+{
+    int r;
+    uint64_t s = stream(g->o->seed, 1, i);
+    for (r = 0; r < g->o->rank; r++)
+        x[r] = scale * next_gauss(&s) / sqrt((double)g->m);
+}
+
+static double synth_entry(const synth *g, const double *x, int i, int j, double scale)
+{
+    int r;
+    double v = 0;
+    const double *y = g->sy + (size_t)j*g->o->rank;
+    for (r = 0; r < g->o->rank; r++)
+        v += x[r]*y[r];
+    if (g->o->noise > 0) {
+        uint64_t s = stream(g->o->seed ^ 3, (uint64_t)i, j);
+        v += scale * g->o->noise * next_gauss(&s) / sqrt((double)g->m);
+    }
+    return v;
+}
+
+/* next kept column after j in row i (geometric gaps), n when done */
+static int synth_next_col(uint64_t *s, int j, int n, double p)
+{
+    if (p >= 1)
+        return j + 1;
+    double gap = floor(log(next_unif(s)) / log(1.0 - p));
+    return gap >= n ? n : (int)min((double)n, j + 1 + gap);
+}
+
+static void synth_build(bench_matrix *A, const bench_opts *o, int m_global)
+{
+    synth g;
+    int n = o->cols, rank = o->rank;
+    synth_init(&g, o, m_global, n);
+    A->m_global = m_global;
+    A->row_begin = (int)((long long)m_global * rank_id / nranks);
+    A->m = (int)((long long)m_global * (rank_id + 1) / nranks) - A->row_begin;
+    A->n = n;
+    A->from_cache = 0;
+    if (!o->sparse) {
+        A->Ad.nrows = A->m;
+        A->Ad.ncols = n;
+        A->Ad.d = matrix_alloc_placed(A->m, n);
+        A->nnz = (long long)A->m * n;
+        #pragma omp parallel
+        {
+            double *x = (double*)malloc(rank * sizeof(double));
+            int i, j;
+            #pragma omp for schedule(static)
+            for (i = 0; i < A->m; i++) {
+                synth_row(&g, A->row_begin + i, 1.0, x);
+                for (j = 0; j < n; j++)
+                    A->Ad.d[(long long)j*A->m + i] = synth_entry(&g, x, A->row_begin + i, j, 1.0);
+            }
+            free(x);
+        }
+    } else {
+        const double p = o->density, scale = 1.0 / p;
+        mat_csr *S = csr_matrix_new();
+        long long *count = (long long*)calloc((size_t)A->m + 1, sizeof(long long));
+        int i;
+        // count, prefix, fill: the column stream of a row is replayed
+        #pragma omp parallel for schedule(static)
+        for (i = 0; i < A->m; i++) {
+            uint64_t s = stream(o->seed, 4, A->row_begin + i);
+            int j;
+            for (j = synth_next_col(&s, -1, n, p); j < n; j = synth_next_col(&s, j, n, p))
+                count[i+1]++;
+        }
+        for (i = 0; i < A->m; i++)
+            count[i+1] += count[i];
+        S->nrows = A->m;
+        S->ncols = n;
+        S->nnz = count[A->m];
+        S->pointerB = (long long*)malloc(max(A->m, 1) * sizeof(long long));
+        S->pointerE = (long long*)malloc(max(A->m, 1) * sizeof(long long));
+        S->cols = (int*)malloc(max(S->nnz, 1) * sizeof(int));
+        S->values = (double*)malloc(max(S->nnz, 1) * sizeof(double));
+        matrix_place(S->cols, S->nnz * sizeof(int));
+        matrix_place(S->values, S->nnz * sizeof(double));
+        #pragma omp parallel
+        {
+            double *x = (double*)malloc(rank * sizeof(double));
+            int r;
+            #pragma omp for schedule(static)
+            for (r = 0; r < A->m; r++) {
+                uint64_t s = stream(o->seed, 4, A->row_begin + r);
+                long long q = count[r];
+                int j;
+                synth_row(&g, A->row_begin + r, scale, x);
+                S->pointerB[r] = count[r] + 1;
+                S->pointerE[r] = count[r+1] + 1;
+                for (j = synth_next_col(&s, -1, n, p); j < n; j = synth_next_col(&s, j, n, p), q++) {
+                    S->cols[q] = j + 1;
+                    S->values[q] = synth_entry(&g, x, A->row_begin + r, j, scale);
+                }
+            }
+            free(x);
+        }
+        free(count);
+        A->As = S;
+        A->nnz = S->nnz;
+    }
+    free(g.sy);
+}
+
+/* this rank's rows of a binary cache; returns nonzero on error */
+static int cache_build(bench_matrix *A, const char *file)
+{
+    matrix_cache_header h;
+    int kind = matrix_cache_kind(file, &h);
+    if (kind < 0)
+        return 1;
+    A->m_global = h.nrows;
+    A->row_begin = (int)((long long)h.nrows * rank_id / nranks);
+    int row_end = (int)((long long)h.nrows * (rank_id + 1) / nranks);
+    A->from_cache = 1;
+    if (kind == MATRIX_CACHE_CSR) {
+        A->As = csr_matrix_new();
+        if (matrix_cache_map_csr(file, A->row_begin, row_end, A->As, &A->cache) != 0)
+            return 2;
+        A->m = A->As->nrows;
+        A->n = A->As->ncols;
+        A->nnz = A->As->nnz;
+    } else {
+        if (matrix_cache_map_dense(file, A->row_begin, row_end, &A->Ad, &A->cache) != 0)
+            return 2;
+        A->m = A->Ad.nrows;
+        A->n = A->Ad.ncols;
+        A->nnz = (long long)A->m * A->n;
+    }
+    return 0;
+}
+
+static void bench_matrix_free(bench_matrix *A)
+{
+    if (A->Af) matrix_f_delete(A->Af);
+    if (A->Asf) csr_matrix_f_delete(A->Asf);
+    if (A->from_cache) {
+        free(A->As);
+        matrix_cache_unmap(&A->cache);
+    } else {
+        free(A->Ad.d);
+        if (A->As) csr_matrix_delete(A->As);
+    }
+    memset(A, 0, sizeof(*A));
+}
+
+/* max_i max(||A*v_i - s_i*u_i||, ||A^T*u_i - s_i*v_i||) / s_i over all
+   ranks (U holds the local rows). The Golub-Kahan recurrence makes the
+   first side small by construction, so the A^T side is the one that shows
+   an unconverged or non-orthogonal basis. */
+static double residual(bench_matrix *A, mat *Uk, mat *Sk, mat *Vk)
+{
+    int k = Sk->nrows, i;
+    long long r;
+    mat *AV = matrix_new(A->m, k), *AtU = matrix_new(A->n, k);
+    double worst = 0, *ss = (double*)calloc(2*k, sizeof(double)), *st = ss + k;
+    if (A->As) {
+        csr_matrix_matrix_mult(A->As, Vk, AV);
+        csr_matrix_transpose_matrix_mult(A->As, Uk, AtU);
+    } else {
+        matrix_matrix_mult(&A->Ad, Vk, AV);
+        matrix_transpose_matrix_mult(&A->Ad, Uk, AtU);
+    }
+#ifdef BENCH_MPI
+    // A^T*U is a sum over the row blocks
+    MPI_Allreduce(MPI_IN_PLACE, AtU->d, (int)((long long)A->n * k), MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+#endif
+    for (i = 0; i < k; i++) {
+        for (r = 0; r < A->m; r++) {
+            double d = AV->d[(long long)i*A->m + r] - Sk->d[i]*Uk->d[(long long)i*Uk->nrows + r];
+            ss[i] += d*d;
+        }
+        // V is replicated, so only rank 0 adds the A^T side
+        for (r = 0; r < A->n && rank_id == 0; r++) {
+            double d = AtU->d[(long long)i*A->n + r] - Sk->d[i]*Vk->d[(long long)i*Vk->nrows + r];
+            st[i] += d*d;
+        }
+    }
+#ifdef BENCH_MPI
+    MPI_Allreduce(MPI_IN_PLACE, ss, 2*k, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+#endif
+    for (i = 0; i < k; i++)
+        worst = max(worst, Sk->d[i] > 0 ? sqrt(max(ss[i], st[i])) / Sk->d[i] : 0);
+    free(ss);
+    matrix_delete(AV);
+    matrix_delete(AtU);
+    return worst;
+}
+
+/* ---- result records --------------------------------------------------- */
+
+static const char *phase_keys[SVDS_NPHASES] = {"matvec", "rmatvec", "reorth", "small_svd", "ritz"};
+
+typedef struct {
+    const char *solver;
+    int threads, k, b;
+    int rep;
+    double seconds, resid, s1, sk;
+    svds_stats st;
+    long long collectives, steps;
+    double comm_seconds;
+} bench_record;
+
+static void write_record(const bench_opts *o, const bench_matrix *A, const bench_record *r, long long run_id, const char *host)
+{
+    FILE *fp = fopen(o->out, "a");
+    int p;
+    if (!fp) {
+        fprintf(stderr, "bench: cannot open '%s' for appending\n", o->out);
+        return;
+    }
+    const char *fmt = A->As ? "sparse" : "dense";
+    if (o->json) {
+        fprintf(fp, "{\"run_id\":%lld,\"host\":\"%s\",\"tag\":\"%s\",\"matrix\":\"%s\",\"m\":%d,\"n\":%d,\"nnz\":%lld,\"format\":\"%s\","
+                    "\"solver\":\"%s\",\"ranks\":%d,\"threads\":%d,\"k\":%d,\"basis\":%d,\"rep\":%d,\"seconds\":%.6f,"
+                    "\"restarts\":%d,\"resid\":%.3e,\"s1\":%.9g,\"sk\":%.9g,\"stats\":%d",
+                run_id, host, o->tag, o->matrix, A->m_global, A->n, A->nnz, fmt, r->solver, nranks, r->threads,
+                r->k, r->b, r->rep, r->seconds, r->st.restarts, r->resid, r->s1, r->sk, r->st.enabled);
+        for (p = 0; p < SVDS_NPHASES; p++)
+            fprintf(fp, ",\"%s_s\":%.6f,\"%s_calls\":%lld,\"%s_gflops\":%.3f,\"%s_gbs\":%.3f",
+                    phase_keys[p], r->st.seconds[p], phase_keys[p], r->st.calls[p],
+                    phase_keys[p], svds_stats_gflops(&r->st, (svds_phase)p), phase_keys[p], svds_stats_gbs(&r->st, (svds_phase)p));
+        fprintf(fp, ",\"collectives\":%lld,\"steps\":%lld,\"comm_s\":%.6f}\n", r->collectives, r->steps, r->comm_seconds);
+    } else {
+        if (ftell(fp) == 0) {
+            fprintf(fp, "run_id,host,tag,matrix,m,n,nnz,format,solver,ranks,threads,k,basis,rep,seconds,restarts,resid,s1,sk,stats");
+            for (p = 0; p < SVDS_NPHASES; p++)
+                fprintf(fp, ",%s_s,%s_calls,%s_gflops,%s_gbs", phase_keys[p], phase_keys[p], phase_keys[p], phase_keys[p]);
+            fprintf(fp, ",collectives,steps,comm_s\n");
+        }
+        fprintf(fp, "%lld,%s,%s,%s,%d,%d,%lld,%s,%s,%d,%d,%d,%d,%d,%.6f,%d,%.3e,%.9g,%.9g,%d",
+                run_id, host, o->tag, o->matrix, A->m_global, A->n, A->nnz, fmt, r->solver, nranks, r->threads,
+                r->k, r->b, r->rep, r->seconds, r->st.restarts, r->resid, r->s1, r->sk, r->st.enabled);
+        for (p = 0; p < SVDS_NPHASES; p++)
+            fprintf(fp, ",%.6f,%lld,%.3f,%.3f", r->st.seconds[p], r->st.calls[p],
+                    svds_stats_gflops(&r->st, (svds_phase)p), svds_stats_gbs(&r->st, (svds_phase)p));
+        fprintf(fp, ",%lld,%lld,%.6f\n", r->collectives, r->steps, r->comm_seconds);
+    }
+    fclose(fp);
+}
+
+/* ---- one sweep point -------------------------------------------------- */
+
+/* runs one solve and fills *r; returns nonzero for an unknown solver */
+static int run_solver(const bench_opts *o, bench_matrix *A, const char *solver, int k, int b, svds_workspace *ws, bench_record *r)
+{
+    mat *Uk = NULL, *Sk = NULL, *Vk = NULL;
+    int owned = 1;
+    memset(&r->st, 0, sizeof(r->st));
+    r->collectives = r->steps = 0;
+    r->comm_seconds = 0;
+    double t = omp_get_wtime();
+#ifdef BENCH_MPI
+    (void)o;
+    (void)ws;
+    if (strcmp(solver, "lanczos") != 0)
+        return 1;
+    MPI_Barrier(MPI_COMM_WORLD);
+    t = MPI_Wtime();
+    if (A->As)
+        svds_C_mpi_opt(A->As, &Uk, &Sk, &Vk, k, 1e-10, b, 10, 0, SVDS_REORTH_FULL, NULL, &r->st, MPI_COMM_WORLD);
+    else
+        svds_C_dense_mpi_opt(&A->Ad, &Uk, &Sk, &Vk, k, 1e-10, b, 10, 0, SVDS_REORTH_FULL, NULL, &r->st, MPI_COMM_WORLD);
+    r->seconds = MPI_Wtime() - t;
+    MPI_Allreduce(MPI_IN_PLACE, &r->seconds, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+    svds_mpi_stats ms;
+    svds_mpi_get_stats(&ms);
+    r->collectives = ms.collectives;
+    r->steps = r->st.calls[SVDS_PHASE_RMATVEC]; // one A^T*u per step, 0 without SVDS_STATS
+    r->comm_seconds = ms.comm_seconds;
+    MPI_Allreduce(MPI_IN_PLACE, &r->comm_seconds, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+#else
+    if (strcmp(solver, "lanczos") == 0) {
+        if (A->As)
+            svds_C_opt(A->As, &Uk, &Sk, &Vk, k, 1e-10, b, 10, 0, SVDS_REORTH_FULL, ws, &r->st);
+        else
+            svds_C_dense_opt(&A->Ad, &Uk, &Sk, &Vk, k, 1e-10, b, 10, 0, SVDS_REORTH_FULL, ws, &r->st);
+        owned = 0;
+    } else if (strcmp(solver, "mixed") == 0) {
+        // the float copy is made once per matrix, outside the timing
+        if (A->As && !A->Asf)
+            A->Asf = csr_matrix_to_float(A->As);
+        if (!A->As && !A->Af)
+            A->Af = matrix_to_float(&A->Ad);
+        t = omp_get_wtime();
+        if (A->As)
+            svds_C_mixed_opt(A->Asf, &Uk, &Sk, &Vk, k, 1e-10, b, 10, 0, SVDS_REORTH_FULL, ws, &r->st);
+        else
+            svds_C_dense_mixed_opt(A->Af, &Uk, &Sk, &Vk, k, 1e-10, b, 10, 0, SVDS_REORTH_FULL, ws, &r->st);
+        owned = 0;
+    } else if (strcmp(solver, "block") == 0) {
+        if (A->As)
+            svds_C_block_opt(A->As, &Uk, &Sk, &Vk, k, o->blocksize, 1e-10, b, 10, NULL);
+        else
+            svds_C_dense_block_opt(&A->Ad, &Uk, &Sk, &Vk, k, o->blocksize, 1e-10, b, 10, NULL);
+    } else if (strcmp(solver, "randomized") == 0) {
+        if (A->As)
+            svds_C_randomized(A->As, &Uk, &Sk, &Vk, k, b - k, 2);
+        else
+            svds_C_dense_randomized(&A->Ad, &Uk, &Sk, &Vk, k, b - k, 2);
+    } else {
+        return 1;
+    }
+    r->seconds = omp_get_wtime() - t;
+#endif
+    r->resid = residual(A, Uk, Sk, Vk);
+    r->s1 = Sk->d[0];
+    r->sk = Sk->d[k-1];
+    if (owned) {
+        matrix_delete(Uk);
+        matrix_delete(Sk);
+        matrix_delete(Vk);
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    bench_opts o;
+    int a, ti, ki, bi, rep;
+#ifdef BENCH_MPI
+    int provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank_id);
+    MPI_Comm_size(MPI_COMM_WORLD, &nranks);
+#endif
+    memset(&o, 0, sizeof(o));
+    o.matrix = "synthetic";
+    o.rows = 20000;
+    o.cols = 1000;
+    o.density = 0.01;
+    o.rank = 20;
+    o.decay = 0.9;
+    o.noise = 1.0;
+    o.seed = 12345;
+    o.sparse = 1;
+    strcpy(o.solvers, "lanczos");
+    o.threads.n = 1;
+    o.threads.v[0] = omp_get_max_threads();
+    o.ks.n = 1;
+    o.ks.v[0] = 10;
+    o.bases.n = 1;
+    o.bases.v[0] = 0;
+    o.blocksize = 8;
+    o.repeat = 3;
+    o.out = "bench_results.csv";
+    o.tag = "";
+    for (a = 1; a < argc; a++) {
+        const char *s = argv[a];
+        if (strncmp(s, "--matrix=", 9) == 0) o.matrix = s + 9;
+        else if (strncmp(s, "--rows=", 7) == 0) o.rows = atoi(s + 7);
+        else if (strncmp(s, "--cols=", 7) == 0) o.cols = atoi(s + 7);
+        else if (strncmp(s, "--density=", 10) == 0) o.density = atof(s + 10);
+        else if (strncmp(s, "--rank=", 7) == 0) o.rank = atoi(s + 7);
+        else if (strncmp(s, "--decay=", 8) == 0) o.decay = atof(s + 8);
+        else if (strncmp(s, "--noise=", 8) == 0) o.noise = atof(s + 8);
+        else if (strncmp(s, "--seed=", 7) == 0) o.seed = strtoull(s + 7, NULL, 10);
+        else if (strcmp(s, "--format=dense") == 0) o.sparse = 0;
+        else if (strcmp(s, "--format=sparse") == 0) o.sparse = 1;
+        else if (strcmp(s, "--weak") == 0) o.weak = 1;
+        else if (strncmp(s, "--solver=", 9) == 0) snprintf(o.solvers, sizeof(o.solvers), "%s", s + 9);
+        else if (strncmp(s, "--threads=", 10) == 0) parse_list(s + 10, &o.threads);
+        else if (strncmp(s, "--k=", 4) == 0) parse_list(s + 4, &o.ks);
+        else if (strncmp(s, "--basis=", 8) == 0) parse_list(s + 8, &o.bases);
+        else if (strncmp(s, "--blocksize=", 12) == 0) o.blocksize = atoi(s + 12);
+        else if (strncmp(s, "--repeat=", 9) == 0) o.repeat = atoi(s + 9);
+        else if (strncmp(s, "--out=", 6) == 0) o.out = s + 6;
+        else if (strcmp(s, "--json") == 0) o.json = 1;
+        else if (strncmp(s, "--tag=", 6) == 0) o.tag = s + 6;
+        else {
+            if (rank_id == 0)
+                fprintf(stderr, "bench: unknown option '%s'\n", s);
+#ifdef BENCH_MPI
+            MPI_Finalize();
+#endif
+            return 1;
+        }
+    }
+    int synthetic = strcmp(o.matrix, "synthetic") == 0;
+    if (synthetic && (o.rows < nranks || o.cols < 1 || o.density <= 0 || o.density > 1 || o.rank < 1)) {
+        if (rank_id == 0)
+            fprintf(stderr, "bench: need rows >= ranks, cols >= 1, 0 < density <= 1 and rank >= 1\n");
+#ifdef BENCH_MPI
+        MPI_Finalize();
+#endif
+        return 1;
+    }
+
+    char host[64] = "unknown";
+    gethostname(host, sizeof(host) - 1);
+    long long run_id = (long long)time(NULL);
+#ifdef BENCH_MPI
+    MPI_Bcast(&run_id, 1, MPI_LONG_LONG, 0, MPI_COMM_WORLD);
+#endif
+
+    bench_matrix A;
+    memset(&A, 0, sizeof(A));
+    int built_for = -1; // processes the synthetic matrix was sized for (weak scaling)
+    for (ti = 0; ti < o.threads.n; ti++) {
+        int nt = o.threads.v[ti];
+        omp_set_num_threads(nt);
+#ifdef OPENBLAS_VERSION
+        openblas_set_num_threads(nt);
+#endif
+        // (re)build the matrix: once, or per thread count for weak scaling
+        int procs = o.weak ? nt * nranks : 1;
+        if (built_for != procs) {
+            if (built_for >= 0)
+                bench_matrix_free(&A);
+            int err = 0;
+            if (synthetic)
+                synth_build(&A, &o, o.rows * procs);
+            else
+                err = cache_build(&A, o.matrix);
+            if (err) {
+                fprintf(stderr, "bench: rank %d cannot load '%s' (code=%d)\n", rank_id, o.matrix, err);
+#ifdef BENCH_MPI
+                MPI_Abort(MPI_COMM_WORLD, 1);
+#endif
+                return 1;
+            }
+#ifdef BENCH_MPI
+            MPI_Allreduce(MPI_IN_PLACE, &A.nnz, 1, MPI_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
+#endif
+            built_for = synthetic ? procs : 1;
+        }
+        for (ki = 0; ki < o.ks.n; ki++) {
+            int k = o.ks.v[ki];
+            for (bi = 0; bi < o.bases.n; bi++) {
+                int b = o.bases.v[bi] > 0 ? o.bases.v[bi] : max(3*k, 15), seen = 0, bj;
+                for (bj = 0; bj < bi; bj++)
+                    seen |= (o.bases.v[bj] > 0 ? o.bases.v[bj] : max(3*k, 15)) == b;
+                if (seen)
+                    continue;
+                if (k < 1 || b <= k || b > min(A.m_global, A.n)) {
+                    if (rank_id == 0)
+                        fprintf(stderr, "bench: skipping k=%d basis=%d for a %dx%d matrix\n", k, b, A.m_global, A.n);
+                    continue;
+                }
+                svds_workspace *ws = NULL;
+#ifndef BENCH_MPI
+                ws = svds_workspace_new(A.m, A.n, k, b);
+#endif
+                char solvers[256], *save = NULL, *solver;
+                strcpy(solvers, o.solvers);
+                for (solver = strtok_r(solvers, ",", &save); solver; solver = strtok_r(NULL, ",", &save)) {
+                    for (rep = 0; rep < o.repeat; rep++) {
+                        bench_record r;
+                        memset(&r, 0, sizeof(r));
+                        r.solver = solver;
+                        r.threads = nt;
+                        r.k = k;
+                        r.b = b;
+                        if (strcmp(solver, "block") == 0 && o.bases.v[bi] <= 0)
+                            r.b = svds_block_basis(A.m_global, A.n, k, o.blocksize);
+                        r.rep = rep;
+                        if (run_solver(&o, &A, solver, k, r.b, ws, &r) != 0) {
+                            if (rank_id == 0)
+                                fprintf(stderr, "bench: solver '%s' is not available in this build\n", solver);
+                            break;
+                        }
+                        if (rank_id == 0) {
+                            write_record(&o, &A, &r, run_id, host);
+                            printf("%-10s ranks=%d threads=%d k=%d basis=%d rep=%d: %.6f sec, resid %.2e\n",
+                                   solver, nranks, nt, k, r.b, rep, r.seconds, r.resid);
+                        }
+                    }
+                }
+                if (ws)
+                    svds_workspace_delete(ws);
+            }
+        }
+    }
+    bench_matrix_free(&A);
+#ifdef BENCH_MPI
+    MPI_Finalize();
+#endif
+    return 0;
+}
@@ -0,0 +1,45 @@
+#!/bin/bash
+# Summary of a bench.c result file (CSV): the median time of the repeats of
+# every configuration, and its speedup and parallel efficiency against the
+# run of the same tag / matrix / format / solver / k / basis on the fewest
+# processes (ranks x threads). The speedup is scaled by the row count, so
+# for --weak runs (the matrix grows with the processes) it is the scaled
+# speedup, and ideal strong and weak scaling both keep the efficiency at 1.
+#
+# Usage: ./bench_report.sh [bench_results.csv]
+
+awk -F, '
+NR == 1 { for (i = 1; i <= NF; i++) col[$i] = i; next }
+{
+    group = $col["tag"] "," $col["matrix"] "," $col["format"] "," $col["solver"] "," $col["k"] "," $col["basis"]
+    procs = $col["ranks"] * $col["threads"]
+    key = group SUBSEP $col["m"] SUBSEP $col["ranks"] SUBSEP $col["threads"]
+    if (!(key in reps)) { order[++nkeys] = key; kgroup[key] = group; kprocs[key] = procs }
+    times[key, ++reps[key]] = $col["seconds"]
+    resid[key] = $col["resid"] > resid[key] ? $col["resid"] : resid[key]
+}
+function median(key,    n, i, j, t, a) {
+    n = reps[key]
+    for (i = 1; i <= n; i++) a[i] = times[key, i]
+    for (i = 2; i <= n; i++)
+        for (j = i; j > 1 && a[j-1] > a[j]; j--) { t = a[j]; a[j] = a[j-1]; a[j-1] = t }
+    return n % 2 ? a[(n+1)/2] : (a[n/2] + a[n/2+1]) / 2
+}
+END {
+    for (i = 1; i <= nkeys; i++) {
+        key = order[i]
+        med[key] = median(key)
+        g = kgroup[key]
+        split(key, f, SUBSEP)
+        if (!(g in base_procs) || kprocs[key] < base_procs[g]) { base_procs[g] = kprocs[key]; base_time[g] = med[key]; base_m[g] = f[2] }
+    }
+    print "tag,matrix,format,solver,k,basis,m,ranks,threads,repeats,median_s,speedup,efficiency,max_resid"
+    for (i = 1; i <= nkeys; i++) {
+        key = order[i]
+        split(key, f, SUBSEP)
+        g = kgroup[key]
+        speedup = base_time[g] / med[key] * f[2] / base_m[g]
+        printf "%s,%s,%s,%s,%d,%.6f,%.2f,%.2f,%.1e\n", g, f[2], f[3], f[4], reps[key], med[key],
+               speedup, speedup * base_procs[g] / kprocs[key], resid[key]
+    }
+}' "${1:-bench_results.csv}"
@@ -0,0 +1,61 @@
+#!/bin/bash
+#PBS -l select=2:ncpus=16:mpiprocs=4:mem=32gb
+#PBS -l walltime=2:00:00
+#PBS -q short_cpuQ
+#PBS -N svd_bench_job
+
+# Output and error file paths
+#PBS -o bench_output.out
+#PBS -e bench_error.err
+
+# One job for the whole sweep (solver x threads x ranks x k x basis, with
+# repeats); every run appends a record to $OUT, so the scaling curves come
+# from bench_report.sh instead of from hand-edited jobs and their text logs.
+
+# Load required modules (adjust versions if needed)
+module load lapack-3.8.0
+module load OpenBLAS-0.3.7
+module load mpich-3.2
+
+export OMP_PROC_BIND=spread
+export OMP_PLACES=cores
+
+cd $PBS_O_WORKDIR
+
+OUT=bench_results.csv
+TAG=${PBS_JOBID:-manual}
+SRC="bench.c ../common/svds.c ../common/matrix_funcs.c ../common/csv_loader.c ../common/matrix_io.c"
+LIBS="-I/apps/OpenBLAS-0.3.7/include -I/apps/lapack-3.8.0/include -L/apps/OpenBLAS-0.3.7/lib -L/apps/lapack-3.8.0/lib -lopenblas -llapacke -lm"
+
+# -DSVDS_STATS adds the per-phase columns (matvec, rmatvec, reorth, small_svd, ritz)
+gcc -O2 -fopenmp -DSVDS_STATS -o svd_bench $SRC $LIBS
+mpicc -O2 -fopenmp -DSVDS_STATS -DBENCH_MPI -o svd_bench_mpi $SRC ../common/svds_mpi.c $LIBS
+
+# Synthetic matrix shape: 200k x 2000 at 1% density, rank-20 signal decaying by 0.9.
+MATRIX="--rows=200000 --cols=2000 --density=0.01 --rank=20 --decay=0.9"
+
+# Shared memory, strong scaling: all solvers over the thread counts, two K.
+./svd_bench $MATRIX --solver=lanczos,mixed,block,randomized --threads=1,2,4,8,16 \
+  --k=10,100 --repeat=3 --out=$OUT --tag=$TAG
+
+# The same on the dense format of a smaller matrix.
+./svd_bench --rows=50000 --cols=1000 --format=dense --solver=lanczos,mixed,block \
+  --threads=1,4,16 --k=10,100 --repeat=3 --out=$OUT --tag=$TAG
+
+# Basis size sweep at fixed threads (0 = the default 3K).
+./svd_bench $MATRIX --threads=16 --k=50 --basis=0,75,100,200 --repeat=3 --out=$OUT --tag=$TAG
+
+# Distributed Lanczos, strong and weak scaling over ranks (4 threads each).
+for R in 1 2 4 8; do
+  mpirun -np $R ./svd_bench_mpi $MATRIX --threads=4 --k=10,100 --repeat=3 --out=$OUT --tag=$TAG
+  mpirun -np $R ./svd_bench_mpi $MATRIX --weak --rows=25000 --threads=4 --k=10 --repeat=3 --out=$OUT --tag=$TAG-weak
+done
+
+# Reuse a cached dataset (written once by the drivers' --save-cache) instead
+# of a synthetic matrix.
+if [ -f mapped_merged_data_16M.bin ]; then
+  ./svd_bench --matrix=mapped_merged_data_16M.bin --threads=1,4,16 --k=100 --repeat=3 --out=$OUT --tag=$TAG
+  mpirun -np 8 ./svd_bench_mpi --matrix=mapped_merged_data_16M.bin --threads=4 --k=100 --repeat=3 --out=$OUT --tag=$TAG
+fi
+
+./bench_report.sh $OUT
@@ -0,0 +1,243 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "csv_loader.h"
+#include "omp.h"
+
+typedef struct {
+    const char *data;
+    size_t size;
+    size_t begin;   // first byte after the header line
+} csv_map;
+
+static int csv_map_open(const char *filename, csv_map *f)
+{
+    struct stat st;
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return 3;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return 4; // Possibly empty file.
+    }
+    f->size = (size_t)st.st_size;
+    f->data = (const char*)mmap(NULL, f->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (f->data == MAP_FAILED)
+        return 5;
+    madvise((void*)f->data, f->size, MADV_SEQUENTIAL);
+
+    // skip the header line if the file does not start with a number
+    f->begin = 0;
+    char c = f->data[0];
+    if (!((c >= '0' && c <= '9') || c == '-' || c == '+')) {
+        const char *nl = memchr(f->data, '\n', f->size);
+        f->begin = nl ? (size_t)(nl - f->data) + 1 : f->size;
+    }
+    return 0;
+}
+
+static void csv_map_close(csv_map *f)
+{
+    munmap((void*)f->data, f->size);
+}
+
+/* byte range [*b, *e) of chunk t out of nt, both ends moved past a newline */
+static void csv_chunk(const csv_map *f, int t, int nt, size_t *b, size_t *e)
+{
+    size_t len = f->size - f->begin;
+    size_t pos[2];
+    int s;
+    for (s = 0; s < 2; s++) {
+        size_t p = f->begin + len / nt * (t + s);
+        if (t + s == nt)
+            p = f->size;
+        else if (t + s > 0 && p > 0) {
+            const char *nl = memchr(f->data + p - 1, '\n', f->size - p + 1);
+            p = nl ? (size_t)(nl - f->data) + 1 : f->size;
+        }
+        pos[s] = p;
+    }
+    *b = pos[0];
+    *e = pos[1];
+}
+
+static const char * parse_int(const char *p, const char *end, int *val)
+{
+    int neg = 0;
+    long long v = 0;
+    if (p < end && (*p == '-' || *p == '+'))
+        neg = (*p++ == '-');
+    const char *start = p;
+    while (p < end && *p >= '0' && *p <= '9')
+        v = 10*v + (*p++ - '0');
+    if (p == start)
+        return NULL;
+    *val = (int)(neg ? -v : v);
+    return p;
+}
+
+/* decimal with optional fraction and exponent, e.g. 3.5, 4, 1e-2 */
+static const char * parse_double(const char *p, const char *end, double *val)
+{
+    static const double pow10[19] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9,
+                                     1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18};
+    int neg = 0, digits = 0, fdigits = 0;
+    double v = 0;
+    long long frac = 0;
+    if (p < end && (*p == '-' || *p == '+'))
+        neg = (*p++ == '-');
+    while (p < end && *p >= '0' && *p <= '9') {
+        v = 10*v + (*p++ - '0');
+        digits++;
+    }
+    if (p < end && *p == '.') {
+        p++;
+        while (p < end && *p >= '0' && *p <= '9') {
+            if (fdigits < 18) {
+                frac = 10*frac + (*p - '0');
+                fdigits++;
+            }
+            p++;
+            digits++;
+        }
+        v += frac / pow10[fdigits];
+    }
+    if (digits == 0)
+        return NULL;
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        int ex;
+        const char *q = parse_int(p + 1, end, &ex);
+        if (q) {
+            double f = 1;
+            int i;
+            for (i = 0; i < (ex < 0 ? -ex : ex); i++)
+                f *= 10;
+            v = ex < 0 ? v/f : v*f;
+            p = q;
+        }
+    }
+    *val = neg ? -v : v;
+    return p;
+}
+
+/* parses one "uid,mid,rating" line starting at p; returns the start of the
+   next line and sets *ok when all three fields were read */
+static const char * parse_line(const char *p, const char *end, int *uid, int *mid, double *rating, int *ok)
+{
+    const char *q = parse_int(p, end, uid);
+    *ok = 0;
+    if (q && q < end && *q == ',') {
+        q = parse_int(q + 1, end, mid);
+        if (q && q < end && *q == ',') {
+            q = parse_double(q + 1, end, rating);
+            *ok = (q != NULL);
+        }
+    }
+    const char *nl = memchr(p, '\n', end - p);
+    return nl ? nl + 1 : end;
+}
+
+int csv_read_coo(const char *filename, int row_begin, int row_end, int ncols, mat_coo **M)
+{
+    csv_map f;
+    int err = csv_map_open(filename, &f);
+    if (err)
+        return err;
+
+    int nt = omp_get_max_threads();
+    mat_coo **parts = (mat_coo**)malloc(nt * sizeof(mat_coo*));
+    long long *offset = (long long*)malloc((nt + 1) * sizeof(long long));
+    int nrows = row_end - row_begin;
+
+    #pragma omp parallel num_threads(nt)
+    {
+        int t = omp_get_thread_num();
+        size_t b, e;
+        csv_chunk(&f, t, nt, &b, &e);
+        // rough guess of ~20 bytes per line, the buffer grows if needed
+        mat_coo *part = coo_matrix_new(nrows, ncols, min((e - b) / 20 + 16, 1 << 28));
+        const char *p = f.data + b, *end = f.data + e;
+        while (p < end) {
+            int uid, mid, ok;
+            double rating;
+            p = parse_line(p, end, &uid, &mid, &rating, &ok);
+            if (ok && uid >= row_begin && uid < row_end && mid >= 0 && mid < ncols)
+                coo_matrix_append(part, uid - row_begin + 1, mid + 1, rating);
+        }
+        parts[t] = part;
+
+        // concatenate the per-thread triplets in file order
+        #pragma omp barrier
+        #pragma omp single
+        {
+            int s;
+            offset[0] = 0;
+            for (s = 0; s < nt; s++)
+                offset[s+1] = offset[s] + parts[s]->nnz;
+            *M = coo_matrix_new(nrows, ncols, max(offset[nt], 1));
+            (*M)->nnz = offset[nt];
+        }
+        memcpy((*M)->rows + offset[t], part->rows, part->nnz * sizeof(int));
+        memcpy((*M)->cols + offset[t], part->cols, part->nnz * sizeof(int));
+        memcpy((*M)->values + offset[t], part->values, part->nnz * sizeof(double));
+        coo_matrix_delete(part);
+    }
+
+    free(parts);
+    free(offset);
+    csv_map_close(&f);
+    return 0;
+}
+
+int csv_estimate_nnz(const char *filename, long long *nnz)
+{
+    const size_t sample = (size_t)4 << 20;
+    csv_map f;
+    int err = csv_map_open(filename, &f);
+    if (err)
+        return err;
+    size_t len = f.size - f.begin, n = min(len, sample), lines = 0;
+    const char *p = f.data + f.begin, *end = p + n;
+    while ((p = memchr(p, '\n', end - p)) != NULL) {
+        lines++;
+        p++;
+    }
+    // a sample without a newline is (part of) a single line
+    if (n == len && n > 0 && f.data[f.size - 1] != '\n')
+        lines++;
+    *nnz = lines == 0 ? (len > 0) : (long long)((double)lines / n * len + 0.5);
+    csv_map_close(&f);
+    return 0;
+}
+
+int csv_read_dense(const char *filename, int row_begin, mat *A)
+{
+    if (!A || !A->d)
+        return 1;
+    csv_map f;
+    int err = csv_map_open(filename, &f);
+    if (err)
+        return err;
+
+    #pragma omp parallel
+    {
+        size_t b, e;
+        csv_chunk(&f, omp_get_thread_num(), omp_get_num_threads(), &b, &e);
+        const char *p = f.data + b, *end = f.data + e;
+        while (p < end) {
+            int uid, mid, ok;
+            double rating;
+            p = parse_line(p, end, &uid, &mid, &rating, &ok);
+            if (ok && uid >= row_begin && uid < row_begin + A->nrows && mid >= 0 && mid < A->ncols)
+                matrix_set_element(A, uid - row_begin, mid, rating);
+        }
+    }
+
+    csv_map_close(&f);
+    return 0;
+}
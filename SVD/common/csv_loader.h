@@ -0,0 +1,23 @@
+#pragma once
+
+#include "matrix_funcs.h"
+
+/* Parallel loaders for rating files with lines "user_id,movie_id,rating"
+   (0-based ids, an optional header line). The file is mmap'ed, split into
+   newline-aligned chunks, one per OpenMP thread, and parsed without stdio.
+   Only users row_begin <= user_id < row_end and movies 0 <= movie_id < ncols
+   are kept, so distributed drivers can load just their own row block.
+   Both return 0 on success, nonzero on error. */
+
+/* *M receives a new mat_coo of (row_end-row_begin) x ncols holding 1-based
+   local triplets in file order */
+int csv_read_coo(const char *filename, int row_begin, int row_end, int ncols, mat_coo **M);
+
+/* fills the preallocated A (rows row_begin .. row_begin+A->nrows-1) in the
+   column-major layout the solvers read */
+int csv_read_dense(const char *filename, int row_begin, mat *A);
+
+/* *nnz receives an estimate of the number of rating lines, extrapolated from
+   the line length of the first few MB, so that a driver can size its
+   in-memory format before reading the file */
+int csv_estimate_nnz(const char *filename, long long *nnz);
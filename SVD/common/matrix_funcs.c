@@ -1,444 +1,1050 @@
-#include <stdio.h>
-#include <lapacke.h>
-#include <cblas.h>
-#include <stdlib.h>
-#include <time.h>
-#include "matrix_funcs.h"
-#include "omp.h"
-
-mat * matrix_new(int nrows, int ncols)
-{
-    mat *M = malloc(sizeof(mat));
-    //M->d = (double*)mkl_calloc(nrows*ncols, sizeof(double), 64);
-    long long Size = nrows;
-    Size *= ncols;
-    M->d = (double*)calloc(Size, sizeof(double));
-    M->nrows = nrows;
-    M->ncols = ncols;
-    return M;
-}
-
-
-/* initialize new vector and set all entries to zero */
-vec * vector_new(int nrows)
-{
-    vec *v = malloc(sizeof(vec));
-    //v->d = (double*)mkl_calloc(nrows,sizeof(double), 64);
-    v->d = (double*)calloc(nrows,sizeof(double));
-    v->nrows = nrows;
-    return v;
-}
-
-
-void matrix_delete(mat *M)
-{
-    //mkl_free(M->d);
-    free(M->d);
-    free(M);
-}
-
-
-void vector_delete(vec *v)
-{
-    //mkl_free(v->d);
-    free(v->d);
-    free(v);
-}
-
-void matrix_print(mat * M){
-    int i,j;
-    double val;
-    for(i=0; i<M->nrows; i++){
-        for(j=0; j<M->ncols; j++){
-            val = matrix_get_element(M, i, j);
-            printf("%.16f  ", val);
-        }
-        printf("\n");
-    }
-}
-
-double get_seconds_frac(struct timeval start_timeval, struct timeval end_timeval){
-    long secs_used, micros_used;
-    secs_used=(end_timeval.tv_sec - start_timeval.tv_sec);
-    micros_used= ((secs_used*1000000) + end_timeval.tv_usec) - (start_timeval.tv_usec);
-    return (micros_used/1e6); 
-}
-
-void vector_copy(vec *d, vec *s){
-    int i;
-    //#pragma omp parallel for
-    #pragma omp parallel shared(d,s) private(i) 
-    {
-    #pragma omp for 
-    for(i=0; i<(s->nrows); i++){
-        d->d[i] = s->d[i];
-    }
-    }
-}
-
-double vector_dot_product(vec *u, vec *v){
-    int i;
-    double dotval = 0;
-    #pragma omp parallel shared(u,v,dotval) private(i) 
-    {
-    #pragma omp for reduction(+:dotval)
-    for(i=0; i<u->nrows; i++){
-        dotval += (u->d[i])*(v->d[i]);
-    }
-    }
-    return dotval;
-}
-
-/* C = A*B ; column major */
-void matrix_matrix_mult(mat *A, mat *B, mat *C){
-    double alpha, beta;
-    alpha = 1.0; beta = 0.0;
-    //cblas_dgemm(CblasColMajor, CblasNoTrans, CblasNoTrans, A->nrows, B->ncols, A->ncols, alpha, A->d, A->ncols, B->d, B->ncols, beta, C->d, C->ncols);
-    cblas_dgemm(CblasColMajor, CblasNoTrans, CblasNoTrans, A->nrows, B->ncols, A->ncols, alpha, A->d, A->nrows, B->d, B->nrows, beta, C->d, C->nrows);
-}
-
-
-/* C = A^T*B ; column major */
-void matrix_transpose_matrix_mult(mat *A, mat *B, mat *C){
-    double alpha, beta;
-    alpha = 1.0; beta = 0.0;
-    //cblas_dgemm(CblasColMajor, CblasTrans, CblasNoTrans, A->ncols, B->ncols, A->nrows, alpha, A->d, A->ncols, B->d, B->ncols, beta, C->d, C->ncols);
-    cblas_dgemm(CblasColMajor, CblasTrans, CblasNoTrans, A->ncols, B->ncols, A->nrows, alpha, A->d, A->nrows, B->d, B->nrows, beta, C->d, C->nrows);
-}
-
-
-/* C = A*B^T ; column major */
-void matrix_matrix_transpose_mult(mat *A, mat *B, mat *C){
-    double alpha, beta;
-    alpha = 1.0; beta = 0.0;
-    //cblas_dgemm(CblasColMajor, CblasNoTrans, CblasTrans, A->nrows, B->nrows, A->ncols, alpha, A->d, A->ncols, B->d, B->ncols, beta, C->d, C->ncols);
-    cblas_dgemm(CblasColMajor, CblasNoTrans, CblasTrans, A->nrows, B->nrows, A->ncols, alpha, A->d, A->nrows, B->d, B->nrows, beta, C->d, C->nrows);
-}
-
-/* y = M*x ; column major */
-void matrix_vector_mult(mat *M, vec *x, vec *y){
-    double alpha, beta;
-    alpha = 1.0; beta = 0.0;
-    cblas_dgemv (CblasColMajor, CblasNoTrans, M->nrows, M->ncols, alpha, M->d, M->nrows, x->d, 1, beta, y->d, 1);
-}
-
-
-/* y = M^T*x ; column major */
-void matrix_transpose_vector_mult(mat *M, vec *x, vec *y){
-    double alpha, beta;
-    alpha = 1.0; beta = 0.0;
-    cblas_dgemv (CblasColMajor, CblasTrans, M->nrows, M->ncols, alpha, M->d, M->nrows, x->d, 1, beta, y->d, 1);
-}
-
-void initialize_random_vector(vec *M){
-    int i,m;
-    double val;
-    m = M->nrows;
-    int N = m;
-    srand((unsigned)time(NULL));
-    for(i=0;i<N;i++)
-        M->d[i] = 1.0*(rand())/RAND_MAX;
-}
-
-void initialize_random_matrix_double(mat *M){
-    int i,m,n;
-    double val;
-    m = M->nrows;
-    n = M->ncols;
-    int N = m*n;
-    srand((unsigned)time(NULL));
-    for(i=0;i<N;i++)
-        M->d[i] = 1.0*(rand())/RAND_MAX;
-}
-
-void vector_set_element(vec *v, int row_num, double val){
-    v->d[row_num] = val;
-}
-
-
-double vector_get_element(vec *v, int row_num){
-    return v->d[row_num];
-}
-
-void matrix_set_element(mat *M, int row_num, int col_num, double val){
-    //M->d[row_num*(M->ncols) + col_num] = val;
-    long long index = col_num;
-    index *= M->nrows;
-    index += row_num;
-    M->d[index] = val; 
-    //M->d[col_num*(M->nrows) + row_num] = val;
-}
-
-double matrix_get_element(mat *M, int row_num, int col_num){
-    //return M->d[row_num*(M->ncols) + col_num];
-    long long index = col_num;
-    index *= M->nrows;
-    index += row_num;
-    return M->d[index];
-    //return M->d[col_num*(M->nrows) + row_num];
-}
-
-void matrix_build_transpose(mat *Mt, mat *M){
-    int i,j;
-    for(i=0; i<(M->nrows); i++){
-        for(j=0; j<(M->ncols); j++){
-            matrix_set_element(Mt,j,i,matrix_get_element(M,i,j)); 
-        }
-    }
-}
-
-void matrix_copy(mat *D, mat *S){
-    int i;
-    //#pragma omp parallel for
-    #pragma omp parallel shared(D,S) private(i) 
-    {
-    #pragma omp for 
-    for(i=0; i<((S->nrows)*(S->ncols)); i++){
-        D->d[i] = S->d[i];
-    }
-    }
-}
-
-void initialize_diagonal_matrix(mat *D, vec *data){
-    int i;
-    #pragma omp parallel shared(D) private(i)
-    { 
-    #pragma omp parallel for
-    for(i=0; i<(D->nrows); i++){
-        matrix_set_element(D,i,i,data->d[i]);
-    }
-    }
-}
-
-/* computes SVD: M = U*S*Vt; note Vt = V^T */
-void singular_value_decomposition(mat *M, mat *U, mat *S, mat *Vt){
-    int m,n,k;
-    m = M->nrows; n = M->ncols;
-    k = min(m,n);
-    vec * work = vector_new(2*max(3*min(m, n)+max(m, n), 5*min(m,n)));
-    vec * svals = vector_new(k);
-
-    LAPACKE_dgesvd( LAPACK_COL_MAJOR, 'S', 'S', m, n, M->d, m, svals->d, U->d, m, Vt->d, k, work->d );
-
-    initialize_diagonal_matrix(S, svals);
-
-    vector_delete(work);
-    vector_delete(svals);
-}
-
-void matrix_get_col(mat *M, int j, vec *column_vec){
-    int i;
-    #pragma omp parallel shared(column_vec,M,j) private(i) 
-    {
-    #pragma omp parallel for
-    for(i=0; i<M->nrows; i++){ 
-        vector_set_element(column_vec,i,matrix_get_element(M,i,j));
-    }
-    }
-}
-
-
-void matrix_set_col(mat *M, int j, vec *column_vec){
-    int i;
-    #pragma omp parallel shared(column_vec,M,j) private(i) 
-    {
-    #pragma omp for
-    for(i=0; i<M->nrows; i++){
-        matrix_set_element(M,i,j,vector_get_element(column_vec,i));
-    }
-    }
-}
-
-void matrix_get_selected_columns(mat *M, int *inds, mat *Mc){
-    int i;
-    vec *col_vec;
-    //printf("%d %d\n", M->ncols, Mc->ncols); 
-    #pragma omp parallel shared(M,Mc,inds) private(i,col_vec) 
-    {
-    #pragma omp parallel for
-    for(i=0; i<(Mc->ncols); i++){
-        //printf("line:%d\n", i);
-        col_vec = vector_new(M->nrows);
-        matrix_get_col(M,inds[i],col_vec);
-        matrix_set_col(Mc,i,col_vec);
-        vector_delete(col_vec);
-    }
-    }
-}
-
-
-mat_coo* coo_matrix_new(int nrows, int ncols, int capacity) {
-    mat_coo *M = (mat_coo*)malloc(sizeof(mat_coo));
-    M->values = (double*)calloc(capacity, sizeof(double));
-    M->rows = (int*)calloc(capacity, sizeof(int));
-    M->cols = (int*)calloc(capacity, sizeof(int));
-    M->nnz = 0;
-    M->nrows = nrows; M->ncols = ncols;
-    M->capacity = capacity;
-    return M;
-}
-
-void coo_matrix_delete(mat_coo *M) {
-    free(M->values);
-    free(M->cols);
-    free(M->rows);
-    free(M);
-}
-
-mat_csr* csr_matrix_new() {
-    mat_csr *M = (mat_csr*)malloc(sizeof(mat_csr));
-    return M;
-}
-
-void csr_matrix_delete(mat_csr *M) {
-    free(M->values);
-    free(M->cols);
-    free(M->pointerB);
-    free(M->pointerE);
-    free(M);
-}
-
-void csr_init_from_coo(mat_csr *D, mat_coo *M) {
-    D->nrows = M->nrows; 
-    D->ncols = M->ncols;
-    D->pointerB = (int*)malloc(D->nrows*sizeof(int));
-    D->pointerE = (int*)malloc(D->nrows*sizeof(int));
-    D->cols = (int*)calloc(M->nnz, sizeof(int));
-    D->nnz = M->nnz;
-    
-    D->values = (double*)malloc(M->nnz * sizeof(double));
-    memcpy(D->values, M->values, M->nnz * sizeof(double));
-    
-    int current_row, cursor=0;
-    for (current_row = 0; current_row < D->nrows; current_row++) {
-        D->pointerB[current_row] = cursor+1;
-        while (M->rows[cursor]-1 == current_row) {
-            D->cols[cursor] = M->cols[cursor];
-            cursor++;
-        }
-        D->pointerE[current_row] = cursor+1;
-    }
-}
-
-void csr_matrix_vector_mult(mat_csr *A, vec *x, vec *y) {
-    int i;
-    int j;
-    #pragma omp parallel shared(x,A,y) private(i,j) 
-    {
-        #pragma omp for
-        for(i=0;i<A->nrows;i++)
-        {
-            y->d[i] = 0;
-        }
-    
-        #pragma omp for
-        for(i=0;i<A->nrows;i++)
-            for(j=A->pointerB[i];j<A->pointerE[i];j++)
-            {
-                int t = A->cols[j-1] - 1;
-                y->d[i] = y->d[i] + x->d[t]*A->values[j-1];
-            }
-    }
-}
-
-// void csr_matrix_transpose_vector_mult(mat_csr *A, vec *x, vec *y) {
-//     int i;
-//     int j;
-
-//     double ylocal[y->nrows];
-//     #pragma omp parallel shared(x,A,ylocal) private(i,j) 
-//     {
-//         #pragma omp for
-//         for(i=0;i<A->ncols;i++)
-//         {
-//             y->d[i] = 0;
-//             ylocal[i] = 0;
-//         }
-        
-        
-//         #pragma omp for reduction(+:ylocal)
-//         for(i=0;i<A->nrows;i++)
-//         {
-//             for(j=A->pointerB[i];j<A->pointerE[i];j++)
-//             {
-//                 int t = A->cols[j-1]-1;
-//                 ylocal[t] = ylocal[t] + x->d[i]*A->values[j-1];
-//             }
-        
-//         }
-//     }
-
-//     for(i=0;i<A->ncols;i++)
-//     {
-//         y->d[i] = ylocal[i];
-//     }
-// }
-
-void csr_matrix_transpose_vector_mult(mat_csr *A, vec *x, vec *y) {
-    int i, j;
-
-    double ylocal[y->nrows];
-    
-    // Initialize the result vector and ylocal array
-    #pragma omp parallel for shared(y, ylocal)
-    for (i = 0; i < A->ncols; i++) {
-        y->d[i] = 0;
-        ylocal[i] = 0;
-    }
-
-    #pragma omp parallel shared(x, A, ylocal) private(i, j)
-    {
-        // Private copy of ylocal for each thread
-        double ylocal_private[y->nrows];
-        for (i = 0; i < A->nrows; i++) {
-            ylocal_private[i] = 0;
-        }
-
-        // Compute local contributions
-        #pragma omp for
-        for (i = 0; i < A->nrows; i++) {
-            for (j = A->pointerB[i]; j < A->pointerE[i]; j++) {
-                int t = A->cols[j - 1] - 1;
-                ylocal_private[t] += x->d[i] * A->values[j - 1];
-            }
-        }
-
-        // Manually reduce the results
-        #pragma omp critical
-        {
-            for (i = 0; i < A->ncols; i++) {
-                ylocal[i] += ylocal_private[i];
-            }
-        }
-    }
-
-    // Copy ylocal back to the output vector y
-    #pragma omp parallel for
-    for (i = 0; i < A->ncols; i++) {
-        y->d[i] = ylocal[i];
-    }
-}
-
-
-void csr_matrix_print(mat_csr *M) {
-    int i;
-    int t = 10;
-    printf("values: ");
-    for (i = 0; i < t; i++) {
-        printf("%f ", M->values[i]);
-    }
-    printf("\ncolumns: ");
-    for (i = 0; i < t; i++) {
-        printf("%d ", M->cols[i]);
-    }
-    printf("\npointerB: ");
-    for (i = 0; i < t; i++) {
-        printf("%d\t", M->pointerB[i]);
-    }
-    printf("\npointerE: ");
-    for (i = 0; i < t; i++) {
-        printf("%d\t", M->pointerE[i]);
-    }
-    printf("\n");
-}
-
+#include <stdio.h>
+#include <lapacke.h>
+#include <cblas.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include "matrix_funcs.h"
+#include "omp.h"
+#ifdef SVD_USE_NUMA
+#include <numa.h>
+#endif
+#if defined(__AVX512F__) || (defined(__AVX2__) && defined(__FMA__))
+#include <immintrin.h>
+#endif
+
+// below this many entries a parallel first touch costs more than it saves
+#define PLACE_MIN_ENTRIES (1 << 18)
+
+static int place_interleave = 0;
+
+int matrix_set_interleave(int on)
+{
+#ifdef SVD_USE_NUMA
+    if (on && numa_available() < 0)
+        return 1;
+    place_interleave = on;
+    return 0;
+#else
+    place_interleave = 0;
+    return on ? 1 : 0;
+#endif
+}
+
+void matrix_place(void *p, size_t bytes)
+{
+#ifdef SVD_USE_NUMA
+    // mbind works on whole pages: leave the partial first page to first touch
+    size_t page = (size_t)numa_pagesize();
+    char *b = (char*)(((size_t)p + page - 1) / page * page), *e = (char*)p + bytes;
+    if (place_interleave && p && e - b >= (long)page)
+        numa_interleave_memory(b, e - b, numa_all_nodes_ptr);
+#else
+    (void)p;
+    (void)bytes;
+#endif
+}
+
+double * matrix_alloc_placed(int nrows, int ncols)
+{
+    long long size = (long long)nrows * ncols;
+    double *d = (double*)malloc(max(size, 1) * sizeof(double));
+    if (!d)
+        return NULL;
+    matrix_place(d, size * sizeof(double));
+    #pragma omp parallel if(size >= PLACE_MIN_ENTRIES)
+    {
+        int t = omp_get_thread_num(), nt = omp_get_num_threads();
+        long long rb = (long long)nrows * t / nt, re = (long long)nrows * (t + 1) / nt, j;
+        for (j = 0; j < ncols; j++)
+            memset(d + j * nrows + rb, 0, (re - rb) * sizeof(double));
+    }
+    return d;
+}
+
+size_t matrix_bytes(int nrows, int ncols)
+{
+    return (size_t)nrows * ncols * sizeof(double);
+}
+
+size_t csr_matrix_bytes(int nrows, long long nnz)
+{
+    return (size_t)nnz * (sizeof(int) + sizeof(double)) + (size_t)nrows * 2 * sizeof(long long);
+}
+
+mat * matrix_new(int nrows, int ncols)
+{
+    mat *M = malloc(sizeof(mat));
+    //M->d = (double*)mkl_calloc(nrows*ncols, sizeof(double), 64);
+    M->d = matrix_alloc_placed(nrows, ncols);
+    M->nrows = nrows;
+    M->ncols = ncols;
+    return M;
+}
+
+
+/* initialize new vector and set all entries to zero */
+vec * vector_new(int nrows)
+{
+    vec *v = malloc(sizeof(vec));
+    //v->d = (double*)mkl_calloc(nrows,sizeof(double), 64);
+    v->d = (double*)calloc(nrows,sizeof(double));
+    v->nrows = nrows;
+    return v;
+}
+
+
+void matrix_delete(mat *M)
+{
+    //mkl_free(M->d);
+    free(M->d);
+    free(M);
+}
+
+
+void vector_delete(vec *v)
+{
+    //mkl_free(v->d);
+    free(v->d);
+    free(v);
+}
+
+void matrix_print(mat * M){
+    int i,j;
+    double val;
+    for(i=0; i<M->nrows; i++){
+        for(j=0; j<M->ncols; j++){
+            val = matrix_get_element(M, i, j);
+            printf("%.16f  ", val);
+        }
+        printf("\n");
+    }
+}
+
+double get_seconds_frac(struct timeval start_timeval, struct timeval end_timeval){
+    long secs_used, micros_used;
+    secs_used=(end_timeval.tv_sec - start_timeval.tv_sec);
+    micros_used= ((secs_used*1000000) + end_timeval.tv_usec) - (start_timeval.tv_usec);
+    return (micros_used/1e6); 
+}
+
+void vector_copy(vec *d, vec *s){
+    int i;
+    //#pragma omp parallel for
+    #pragma omp parallel shared(d,s) private(i) 
+    {
+    #pragma omp for 
+    for(i=0; i<(s->nrows); i++){
+        d->d[i] = s->d[i];
+    }
+    }
+}
+
+double vector_dot_product(vec *u, vec *v){
+    int i;
+    double dotval = 0;
+    #pragma omp parallel shared(u,v,dotval) private(i) 
+    {
+    #pragma omp for reduction(+:dotval)
+    for(i=0; i<u->nrows; i++){
+        dotval += (u->d[i])*(v->d[i]);
+    }
+    }
+    return dotval;
+}
+
+/* C = A*B ; column major */
+void matrix_matrix_mult(mat *A, mat *B, mat *C){
+    double alpha, beta;
+    alpha = 1.0; beta = 0.0;
+    //cblas_dgemm(CblasColMajor, CblasNoTrans, CblasNoTrans, A->nrows, B->ncols, A->ncols, alpha, A->d, A->ncols, B->d, B->ncols, beta, C->d, C->ncols);
+    cblas_dgemm(CblasColMajor, CblasNoTrans, CblasNoTrans, A->nrows, B->ncols, A->ncols, alpha, A->d, A->nrows, B->d, B->nrows, beta, C->d, C->nrows);
+}
+
+
+/* C = A^T*B ; column major */
+void matrix_transpose_matrix_mult(mat *A, mat *B, mat *C){
+    double alpha, beta;
+    alpha = 1.0; beta = 0.0;
+    //cblas_dgemm(CblasColMajor, CblasTrans, CblasNoTrans, A->ncols, B->ncols, A->nrows, alpha, A->d, A->ncols, B->d, B->ncols, beta, C->d, C->ncols);
+    cblas_dgemm(CblasColMajor, CblasTrans, CblasNoTrans, A->ncols, B->ncols, A->nrows, alpha, A->d, A->nrows, B->d, B->nrows, beta, C->d, C->nrows);
+}
+
+
+/* C = A*B^T ; column major */
+void matrix_matrix_transpose_mult(mat *A, mat *B, mat *C){
+    double alpha, beta;
+    alpha = 1.0; beta = 0.0;
+    //cblas_dgemm(CblasColMajor, CblasNoTrans, CblasTrans, A->nrows, B->nrows, A->ncols, alpha, A->d, A->ncols, B->d, B->ncols, beta, C->d, C->ncols);
+    cblas_dgemm(CblasColMajor, CblasNoTrans, CblasTrans, A->nrows, B->nrows, A->ncols, alpha, A->d, A->nrows, B->d, B->nrows, beta, C->d, C->nrows);
+}
+
+/* y = M*x ; column major */
+void matrix_vector_mult(mat *M, vec *x, vec *y){
+    double alpha, beta;
+    alpha = 1.0; beta = 0.0;
+    cblas_dgemv (CblasColMajor, CblasNoTrans, M->nrows, M->ncols, alpha, M->d, M->nrows, x->d, 1, beta, y->d, 1);
+}
+
+
+/* y = M^T*x ; column major */
+void matrix_transpose_vector_mult(mat *M, vec *x, vec *y){
+    double alpha, beta;
+    alpha = 1.0; beta = 0.0;
+    cblas_dgemv (CblasColMajor, CblasTrans, M->nrows, M->ncols, alpha, M->d, M->nrows, x->d, 1, beta, y->d, 1);
+}
+
+/* y = M*x - beta*z ; column major, z is only read when beta != 0 */
+void matrix_vector_mult_sub(mat *M, vec *x, double beta, vec *z, vec *y){
+    if (beta == 0) {
+        matrix_vector_mult(M, x, y);
+        return;
+    }
+    cblas_dcopy(y->nrows, z->d, 1, y->d, 1);
+    cblas_dgemv (CblasColMajor, CblasNoTrans, M->nrows, M->ncols, 1.0, M->d, M->nrows, x->d, 1, -beta, y->d, 1);
+}
+
+/* y = M^T*x - beta*z ; column major, z is only read when beta != 0 */
+void matrix_transpose_vector_mult_sub(mat *M, vec *x, double beta, vec *z, vec *y){
+    if (beta == 0) {
+        matrix_transpose_vector_mult(M, x, y);
+        return;
+    }
+    cblas_dcopy(y->nrows, z->d, 1, y->d, 1);
+    cblas_dgemv (CblasColMajor, CblasTrans, M->nrows, M->ncols, 1.0, M->d, M->nrows, x->d, 1, -beta, y->d, 1);
+}
+
+void initialize_random_vector(vec *M){
+    int i,m;
+    double val;
+    m = M->nrows;
+    int N = m;
+    srand((unsigned)time(NULL));
+    for(i=0;i<N;i++)
+        M->d[i] = 1.0*(rand())/RAND_MAX;
+}
+
+void initialize_random_vector_r(vec *M, unsigned int *seed){
+    int i;
+    for(i=0;i<M->nrows;i++)
+        M->d[i] = 1.0*(rand_r(seed))/RAND_MAX;
+}
+
+void initialize_random_matrix_double(mat *M){
+    long long i;
+    int m,n;
+    double val;
+    m = M->nrows;
+    n = M->ncols;
+    long long N = (long long)m*n;
+    srand((unsigned)time(NULL));
+    for(i=0;i<N;i++)
+        M->d[i] = 1.0*(rand())/RAND_MAX;
+}
+
+/* standard normal entries (Box-Muller) for random sketches */
+void initialize_random_matrix_gaussian(mat *M){
+    const double two_pi = 6.283185307179586;
+    long long i, N;
+    N = (long long)M->nrows * M->ncols;
+    srand((unsigned)time(NULL));
+    for(i=0;i<N;i+=2){
+        double u1 = (rand() + 1.0)/(RAND_MAX + 2.0);
+        double u2 = (rand() + 1.0)/(RAND_MAX + 2.0);
+        double r = sqrt(-2.0*log(u1));
+        M->d[i] = r*cos(two_pi*u2);
+        if (i+1 < N)
+            M->d[i+1] = r*sin(two_pi*u2);
+    }
+}
+
+void vector_set_element(vec *v, int row_num, double val){
+    v->d[row_num] = val;
+}
+
+
+double vector_get_element(vec *v, int row_num){
+    return v->d[row_num];
+}
+
+void matrix_set_element(mat *M, int row_num, int col_num, double val){
+    //M->d[row_num*(M->ncols) + col_num] = val;
+    long long index = col_num;
+    index *= M->nrows;
+    index += row_num;
+    M->d[index] = val; 
+    //M->d[col_num*(M->nrows) + row_num] = val;
+}
+
+double matrix_get_element(mat *M, int row_num, int col_num){
+    //return M->d[row_num*(M->ncols) + col_num];
+    long long index = col_num;
+    index *= M->nrows;
+    index += row_num;
+    return M->d[index];
+    //return M->d[col_num*(M->nrows) + row_num];
+}
+
+void matrix_build_transpose(mat *Mt, mat *M){
+    int i,j;
+    for(i=0; i<(M->nrows); i++){
+        for(j=0; j<(M->ncols); j++){
+            matrix_set_element(Mt,j,i,matrix_get_element(M,i,j)); 
+        }
+    }
+}
+
+void matrix_copy(mat *D, mat *S){
+    long long i, N = (long long)S->nrows * S->ncols;
+    //#pragma omp parallel for
+    #pragma omp parallel shared(D,S) private(i) 
+    {
+    #pragma omp for 
+    for(i=0; i<N; i++){
+        D->d[i] = S->d[i];
+    }
+    }
+}
+
+void initialize_diagonal_matrix(mat *D, vec *data){
+    int i;
+    #pragma omp parallel shared(D) private(i)
+    { 
+    #pragma omp for
+    for(i=0; i<(D->nrows); i++){
+        matrix_set_element(D,i,i,data->d[i]);
+    }
+    }
+}
+
+/* computes SVD: M = U*S*Vt; note Vt = V^T */
+void singular_value_decomposition(mat *M, mat *U, mat *S, mat *Vt){
+    int m,n,k;
+    m = M->nrows; n = M->ncols;
+    k = min(m,n);
+    vec * work = vector_new(2*max(3*min(m, n)+max(m, n), 5*min(m,n)));
+    vec * svals = vector_new(k);
+
+    LAPACKE_dgesvd( LAPACK_COL_MAJOR, 'S', 'S', m, n, M->d, m, svals->d, U->d, m, Vt->d, k, work->d );
+
+    initialize_diagonal_matrix(S, svals);
+
+    vector_delete(work);
+    vector_delete(svals);
+}
+
+/* compact QR of an m x n matrix (m >= n): M = Q*R with Q m x n orthonormal
+   and R n x n upper triangular; Q may be the same matrix as M */
+void compact_QR_factorization(mat *M, mat *Q, mat *R){
+    int i,j,m,n;
+    m = M->nrows; n = M->ncols;
+    vec *tau = vector_new(n);
+    if (Q != M)
+        matrix_copy(Q, M);
+
+    LAPACKE_dgeqrf(LAPACK_COL_MAJOR, m, n, Q->d, m, tau->d);
+
+    for(j=0; j<n; j++){
+        for(i=0; i<n; i++){
+            matrix_set_element(R, i, j, i <= j ? matrix_get_element(Q, i, j) : 0.0);
+        }
+    }
+
+    LAPACKE_dorgqr(LAPACK_COL_MAJOR, m, n, n, Q->d, m, tau->d);
+
+    vector_delete(tau);
+}
+
+void matrix_get_col(mat *M, int j, vec *column_vec){
+    int i;
+    #pragma omp parallel shared(column_vec,M,j) private(i) 
+    {
+    #pragma omp for
+    for(i=0; i<M->nrows; i++){ 
+        vector_set_element(column_vec,i,matrix_get_element(M,i,j));
+    }
+    }
+}
+
+
+void matrix_set_col(mat *M, int j, vec *column_vec){
+    int i;
+    #pragma omp parallel shared(column_vec,M,j) private(i) 
+    {
+    #pragma omp for
+    for(i=0; i<M->nrows; i++){
+        matrix_set_element(M,i,j,vector_get_element(column_vec,i));
+    }
+    }
+}
+
+/* column-major columns are contiguous, so each one is a single memcpy; one
+   team splits the columns instead of nesting a team per column */
+void matrix_get_selected_columns(mat *M, int *inds, mat *Mc){
+    int i;
+    #pragma omp parallel for shared(M,Mc,inds) private(i)
+    for(i=0; i<(Mc->ncols); i++){
+        memcpy(Mc->d + (long long)i*Mc->nrows, M->d + (long long)inds[i]*M->nrows, M->nrows*sizeof(double));
+    }
+}
+
+
+mat_coo* coo_matrix_new(int nrows, int ncols, long long capacity) {
+    mat_coo *M = (mat_coo*)malloc(sizeof(mat_coo));
+    M->values = (double*)calloc(capacity, sizeof(double));
+    M->rows = (int*)calloc(capacity, sizeof(int));
+    M->cols = (int*)calloc(capacity, sizeof(int));
+    M->nnz = 0;
+    M->nrows = nrows; M->ncols = ncols;
+    M->capacity = capacity;
+    return M;
+}
+
+void coo_matrix_delete(mat_coo *M) {
+    free(M->values);
+    free(M->cols);
+    free(M->rows);
+    free(M);
+}
+
+mat_csr* csr_matrix_new() {
+    mat_csr *M = (mat_csr*)malloc(sizeof(mat_csr));
+    M->At = NULL;
+    return M;
+}
+
+void csr_matrix_delete(mat_csr *M) {
+    if (M->At)
+        csr_matrix_delete(M->At);
+    free(M->values);
+    free(M->cols);
+    free(M->pointerB);
+    free(M->pointerE);
+    free(M);
+}
+
+/* append one (1-based) triplet, doubling the capacity when full */
+void coo_matrix_append(mat_coo *M, int row, int col, double val) {
+    if (M->nnz == M->capacity) {
+        long long capacity = M->capacity > 0 ? 2*M->capacity : 1024;
+        M->values = (double*)realloc(M->values, capacity*sizeof(double));
+        M->rows = (int*)realloc(M->rows, capacity*sizeof(int));
+        M->cols = (int*)realloc(M->cols, capacity*sizeof(int));
+        M->capacity = capacity;
+    }
+    M->rows[M->nnz] = row;
+    M->cols[M->nnz] = col;
+    M->values[M->nnz] = val;
+    M->nnz++;
+}
+
+/* build CSR from 1-based COO triplets in any order; entries of one row keep
+   their input order. Row-sorted input (the common case for files written by
+   row) is detected during the counting pass and copied without scattering. */
+void csr_init_from_coo(mat_csr *D, mat_coo *M) {
+    long long i;
+    int r;
+    D->nrows = M->nrows; 
+    D->ncols = M->ncols;
+    D->pointerB = (long long*)malloc(max(D->nrows, 1)*sizeof(long long));
+    D->pointerE = (long long*)malloc(max(D->nrows, 1)*sizeof(long long));
+    D->cols = (int*)malloc(max(M->nnz, 1) * sizeof(int));
+    D->nnz = M->nnz;
+    D->values = (double*)malloc(max(M->nnz, 1) * sizeof(double));
+    matrix_place(D->cols, M->nnz * sizeof(int));
+    matrix_place(D->values, M->nnz * sizeof(double));
+
+    // count entries per row and check whether the input is already row-sorted
+    long long *count = (long long*)calloc(max(D->nrows, 1), sizeof(long long));
+    int sorted = 1;
+    for (i = 0; i < M->nnz; i++) {
+        count[M->rows[i]-1]++;
+        if (i > 0 && M->rows[i] < M->rows[i-1])
+            sorted = 0;
+    }
+
+    long long cursor = 1;
+    for (r = 0; r < D->nrows; r++) {
+        D->pointerB[r] = cursor;
+        cursor += count[r];
+        D->pointerE[r] = cursor;
+    }
+
+    // first touch the entries of every row from the thread that owns the row
+    // in the static row-parallel SpMVs
+    #pragma omp parallel for schedule(static) if(M->nnz >= PLACE_MIN_ENTRIES)
+    for (r = 0; r < D->nrows; r++) {
+        long long b = D->pointerB[r] - 1, n = D->pointerE[r] - D->pointerB[r];
+        if (sorted) {
+            memcpy(D->cols + b, M->cols + b, n * sizeof(int));
+            memcpy(D->values + b, M->values + b, n * sizeof(double));
+        } else {
+            memset(D->cols + b, 0, n * sizeof(int));
+            memset(D->values + b, 0, n * sizeof(double));
+        }
+    }
+
+    if (!sorted) {
+        // reuse count as the next free (0-based) slot of every row
+        for (r = 0; r < D->nrows; r++)
+            count[r] = D->pointerB[r] - 1;
+        for (i = 0; i < M->nnz; i++) {
+            long long slot = count[M->rows[i]-1]++;
+            D->cols[slot] = M->cols[i];
+            D->values[slot] = M->values[i];
+        }
+    }
+    free(count);
+}
+
+void csr_matrix_vector_mult(mat_csr *A, vec *x, vec *y) {
+    csr_matrix_vector_mult_sub(A, x, 0, NULL, y);
+}
+
+/* y = A*x - beta*z; the subtraction is folded into the row loop, so y is
+   written once and z read once */
+void csr_matrix_vector_mult_sub(mat_csr *A, vec *x, double beta, vec *z, vec *y) {
+    int i;
+    long long j;
+    #pragma omp parallel for shared(x,A,y,z,beta) private(i,j) schedule(static)
+    for(i=0;i<A->nrows;i++)
+    {
+        double sum = beta != 0 ? -beta*z->d[i] : 0;
+        for(j=A->pointerB[i];j<A->pointerE[i];j++)
+        {
+            int t = A->cols[j-1] - 1;
+            sum += x->d[t]*A->values[j-1];
+        }
+        y->d[i] = sum;
+    }
+}
+
+// void csr_matrix_transpose_vector_mult(mat_csr *A, vec *x, vec *y) {
+//     int i;
+//     int j;
+
+//     double ylocal[y->nrows];
+//     #pragma omp parallel shared(x,A,ylocal) private(i,j) 
+//     {
+//         #pragma omp for
+//         for(i=0;i<A->ncols;i++)
+//         {
+//             y->d[i] = 0;
+//             ylocal[i] = 0;
+//         }
+        
+        
+//         #pragma omp for reduction(+:ylocal)
+//         for(i=0;i<A->nrows;i++)
+//         {
+//             for(j=A->pointerB[i];j<A->pointerE[i];j++)
+//             {
+//                 int t = A->cols[j-1]-1;
+//                 ylocal[t] = ylocal[t] + x->d[i]*A->values[j-1];
+//             }
+        
+//         }
+//     }
+
+//     for(i=0;i<A->ncols;i++)
+//     {
+//         y->d[i] = ylocal[i];
+//     }
+// }
+
+/* y = A^T*x; a gather SpMV over A->At when it was built, otherwise every
+   thread scatters into its own heap buffer and the buffers are summed
+   slice by slice without a critical section */
+void csr_matrix_transpose_vector_mult(mat_csr *A, vec *x, vec *y) {
+    csr_matrix_transpose_vector_mult_sub(A, x, 0, NULL, y);
+}
+
+/* y = A^T*x - beta*z, with the subtraction folded into the final pass */
+void csr_matrix_transpose_vector_mult_sub(mat_csr *A, vec *x, double beta, vec *z, vec *y) {
+    int i, t;
+    long long j;
+
+    if (A->At) {
+        csr_matrix_vector_mult_sub(A->At, x, beta, z, y);
+        return;
+    }
+
+    int nthreads = omp_get_max_threads();
+    double *buf = (double*)calloc((size_t)A->ncols * nthreads, sizeof(double));
+    #pragma omp parallel shared(x, A, y, z, beta, buf) private(i, j, t) num_threads(nthreads)
+    {
+        double *ylocal = buf + (size_t)A->ncols * omp_get_thread_num();
+
+        // Compute local contributions
+        #pragma omp for schedule(static)
+        for (i = 0; i < A->nrows; i++) {
+            for (j = A->pointerB[i]; j < A->pointerE[i]; j++) {
+                int c = A->cols[j - 1] - 1;
+                ylocal[c] += x->d[i] * A->values[j - 1];
+            }
+        }
+
+        // Reduce the thread buffers, each thread owning a slice of y
+        #pragma omp for
+        for (i = 0; i < A->ncols; i++) {
+            double sum = beta != 0 ? -beta*z->d[i] : 0;
+            for (t = 0; t < nthreads; t++)
+                sum += buf[(size_t)A->ncols * t + i];
+            y->d[i] = sum;
+        }
+    }
+    free(buf);
+}
+
+/* every thread counts the column entries of its own block of rows; a prefix
+   over (column, thread) then gives each thread private write cursors, so
+   the scatter is conflict-free and keeps the rows of every column sorted */
+void csr_matrix_build_transpose(mat_csr *A) {
+    int i, c;
+    long long j;
+    int n = A->ncols;
+    int nthreads = omp_get_max_threads();
+    long long *cursor = (long long*)calloc((size_t)n * nthreads, sizeof(long long));
+
+    if (A->At)
+        csr_matrix_delete(A->At);
+    mat_csr *At = csr_matrix_new();
+    At->nrows = n;
+    At->ncols = A->nrows;
+    At->nnz = A->nnz;
+    At->pointerB = (long long*)malloc(max(n, 1) * sizeof(long long));
+    At->pointerE = (long long*)malloc(max(n, 1) * sizeof(long long));
+    At->cols = (int*)malloc(max(A->nnz, 1) * sizeof(int));
+    At->values = (double*)malloc(max(A->nnz, 1) * sizeof(double));
+    matrix_place(At->cols, A->nnz * sizeof(int));
+    matrix_place(At->values, A->nnz * sizeof(double));
+
+    #pragma omp parallel shared(A, At, cursor, n) private(i, j, c) num_threads(nthreads)
+    {
+        int t = omp_get_thread_num(), nt = omp_get_num_threads();
+        int rb = (int)((long long)A->nrows * t / nt);
+        int re = (int)((long long)A->nrows * (t + 1) / nt);
+        long long *mine = cursor + (size_t)n * t;
+        for (i = rb; i < re; i++)
+            for (j = A->pointerB[i]; j < A->pointerE[i]; j++)
+                mine[A->cols[j-1]-1]++;
+        #pragma omp barrier
+
+        #pragma omp single
+        {
+            long long next = 1, cnt;
+            int s;
+            for (c = 0; c < n; c++) {
+                At->pointerB[c] = next;
+                for (s = 0; s < nt; s++) {
+                    cnt = cursor[(size_t)n * s + c];
+                    cursor[(size_t)n * s + c] = next - 1;
+                    next += cnt;
+                }
+                At->pointerE[c] = next;
+            }
+        }
+
+        // first touch the rows of A^T as the static SpMV over them will
+        #pragma omp for schedule(static)
+        for (c = 0; c < n; c++) {
+            memset(At->cols + At->pointerB[c] - 1, 0, (At->pointerE[c] - At->pointerB[c]) * sizeof(int));
+            memset(At->values + At->pointerB[c] - 1, 0, (At->pointerE[c] - At->pointerB[c]) * sizeof(double));
+        }
+
+        for (i = rb; i < re; i++)
+            for (j = A->pointerB[i]; j < A->pointerE[i]; j++) {
+                long long slot = mine[A->cols[j-1]-1]++;
+                At->cols[slot] = i + 1;
+                At->values[slot] = A->values[j-1];
+            }
+    }
+    free(cursor);
+    A->At = At;
+}
+
+
+/* C = A*B for a CSR matrix A and a dense column-major block B of p vectors;
+   B is staged row-major so each nonzero of A updates p contiguous entries */
+void csr_matrix_matrix_mult(mat_csr *A, mat *B, mat *C) {
+    int i, q;
+    long long j;
+    int p = B->ncols;
+    double *Bt = (double*)malloc((size_t)A->ncols * p * sizeof(double));
+    #pragma omp parallel shared(A,B,C,Bt,p) private(i,j,q)
+    {
+        #pragma omp for
+        for (i = 0; i < A->ncols; i++)
+            for (q = 0; q < p; q++)
+                Bt[(long long)i*p + q] = B->d[(long long)q*B->nrows + i];
+
+        double *acc = (double*)malloc(p * sizeof(double));
+        #pragma omp for
+        for (i = 0; i < A->nrows; i++) {
+            for (q = 0; q < p; q++)
+                acc[q] = 0;
+            for (j = A->pointerB[i]; j < A->pointerE[i]; j++) {
+                double a = A->values[j-1];
+                double *brow = Bt + (long long)(A->cols[j-1]-1)*p;
+                for (q = 0; q < p; q++)
+                    acc[q] += a*brow[q];
+            }
+            for (q = 0; q < p; q++)
+                C->d[(long long)q*C->nrows + i] = acc[q];
+        }
+        free(acc);
+    }
+    free(Bt);
+}
+
+/* C = A^T*B for a CSR matrix A and a dense column-major block B of p vectors;
+   without A->At every thread scatters into its own row-major n x p buffer, the buffers are
+   then summed column-slice by column-slice without a critical section */
+void csr_matrix_transpose_matrix_mult(mat_csr *A, mat *B, mat *C) {
+    int i, q, t;
+    long long j;
+    int p = B->ncols;
+    if (A->At) {
+        csr_matrix_matrix_mult(A->At, B, C);
+        return;
+    }
+    int nthreads = omp_get_max_threads();
+    long long slice = (long long)A->ncols * p;
+    double *buf = (double*)calloc(slice * nthreads, sizeof(double));
+    #pragma omp parallel shared(A,B,C,buf,p,slice) private(i,j,q,t) num_threads(nthreads)
+    {
+        double *mine = buf + slice * omp_get_thread_num();
+        #pragma omp for
+        for (i = 0; i < A->nrows; i++) {
+            for (j = A->pointerB[i]; j < A->pointerE[i]; j++) {
+                double a = A->values[j-1];
+                double *crow = mine + (long long)(A->cols[j-1]-1)*p;
+                for (q = 0; q < p; q++)
+                    crow[q] += a*B->d[(long long)q*B->nrows + i];
+            }
+        }
+
+        #pragma omp for
+        for (i = 0; i < A->ncols; i++) {
+            for (q = 0; q < p; q++) {
+                double sum = 0;
+                for (t = 0; t < nthreads; t++)
+                    sum += buf[slice*t + (long long)i*p + q];
+                C->d[(long long)q*C->nrows + i] = sum;
+            }
+        }
+    }
+    free(buf);
+}
+
+void csr_matrix_print(mat_csr *M) {
+    int i;
+    int t = 10;
+    printf("values: ");
+    for (i = 0; i < t; i++) {
+        printf("%f ", M->values[i]);
+    }
+    printf("\ncolumns: ");
+    for (i = 0; i < t; i++) {
+        printf("%d ", M->cols[i]);
+    }
+    printf("\npointerB: ");
+    for (i = 0; i < t; i++) {
+        printf("%lld\t", M->pointerB[i]);
+    }
+    printf("\npointerE: ");
+    for (i = 0; i < t; i++) {
+        printf("%lld\t", M->pointerE[i]);
+    }
+    printf("\n");
+}
+
+mat_f * matrix_to_float(mat *A)
+{
+    long long i, size = (long long)A->nrows * A->ncols;
+    mat_f *M = (mat_f*)malloc(sizeof(mat_f));
+    M->nrows = A->nrows;
+    M->ncols = A->ncols;
+    M->d = (float*)malloc(max(size, 1) * sizeof(float));
+    matrix_place(M->d, size * sizeof(float));
+    // converted by row blocks, so the copy is first touched like A
+    #pragma omp parallel private(i)
+    {
+        int t = omp_get_thread_num(), nt = omp_get_num_threads();
+        long long rb = (long long)A->nrows * t / nt, re = (long long)A->nrows * (t + 1) / nt, j;
+        for (j = 0; j < A->ncols; j++)
+            for (i = rb; i < re; i++)
+                M->d[j * A->nrows + i] = (float)A->d[j * A->nrows + i];
+    }
+    return M;
+}
+
+mat_csr_f * csr_matrix_to_float(mat_csr *A)
+{
+    long long i;
+    int r;
+    mat_csr_f *M = (mat_csr_f*)malloc(sizeof(mat_csr_f));
+    M->nnz = A->nnz;
+    M->nrows = A->nrows;
+    M->ncols = A->ncols;
+    M->values = (float*)malloc(max(A->nnz, 1) * sizeof(float));
+    M->cols = (int*)malloc(max(A->nnz, 1) * sizeof(int));
+    M->pointerB = (long long*)malloc(max(A->nrows, 1) * sizeof(long long));
+    M->pointerE = (long long*)malloc(max(A->nrows, 1) * sizeof(long long));
+    matrix_place(M->values, A->nnz * sizeof(float));
+    matrix_place(M->cols, A->nnz * sizeof(int));
+    #pragma omp parallel for schedule(static) private(i)
+    for (r = 0; r < A->nrows; r++) {
+        for (i = A->pointerB[r] - 1; i < A->pointerE[r] - 1; i++) {
+            M->values[i] = (float)A->values[i];
+            M->cols[i] = A->cols[i];
+        }
+    }
+    memcpy(M->pointerB, A->pointerB, A->nrows * sizeof(long long));
+    memcpy(M->pointerE, A->pointerE, A->nrows * sizeof(long long));
+    M->At = A->At ? csr_matrix_to_float(A->At) : NULL;
+    return M;
+}
+
+void matrix_f_delete(mat_f *M)
+{
+    free(M->d);
+    free(M);
+}
+
+void csr_matrix_f_delete(mat_csr_f *M)
+{
+    if (M->At)
+        csr_matrix_f_delete(M->At);
+    free(M->values);
+    free(M->cols);
+    free(M->pointerB);
+    free(M->pointerE);
+    free(M);
+}
+
+void csr_matrix_means(const mat_csr *A, double *row_mean, double *col_mean, double *mean)
+{
+    const int m = A->nrows, n = A->ncols;
+    double *csum = (double*)calloc(max(n, 1), sizeof(double));
+    long long *ccnt = (long long*)calloc(max(n, 1), sizeof(long long));
+    double total = 0;
+    int i;
+    long long j;
+    #pragma omp parallel for private(j) reduction(+:total) reduction(+:csum[:n], ccnt[:n])
+    for (i = 0; i < m; i++) {
+        double s = 0;
+        for (j = A->pointerB[i]; j < A->pointerE[i]; j++) {
+            s += A->values[j-1];
+            csum[A->cols[j-1]-1] += A->values[j-1];
+            ccnt[A->cols[j-1]-1]++;
+        }
+        total += s;
+        if (row_mean)
+            row_mean[i] = s; // divided below, once the overall mean is known
+    }
+    const double g = A->nnz > 0 ? total / A->nnz : 0;
+    if (row_mean)
+        for (i = 0; i < m; i++) {
+            long long len = A->pointerE[i] - A->pointerB[i];
+            row_mean[i] = len > 0 ? row_mean[i] / len : g;
+        }
+    if (col_mean)
+        for (i = 0; i < n; i++)
+            col_mean[i] = ccnt[i] > 0 ? csum[i] / ccnt[i] : g;
+    if (mean)
+        *mean = g;
+    free(csum);
+    free(ccnt);
+}
+
+typedef struct {
+    int len, row;
+} sell_row;
+
+/* longest first, then by row so that the order is deterministic */
+static int sell_row_cmp(const void *a, const void *b)
+{
+    const sell_row *p = (const sell_row*)a, *q = (const sell_row*)b;
+    if (p->len != q->len)
+        return p->len > q->len ? -1 : 1;
+    return p->row - q->row;
+}
+
+static mat_sell * sell_from_csr_rows(const mat_csr *A, int sigma)
+{
+    int i, c;
+    mat_sell *S = (mat_sell*)malloc(sizeof(mat_sell));
+    S->nrows = A->nrows;
+    S->ncols = A->ncols;
+    S->nnz = A->nnz;
+    S->sigma = sigma;
+    S->nchunks = (A->nrows + SELL_C - 1) / SELL_C;
+    S->At = NULL;
+    const int slots = S->nchunks * SELL_C;
+    sell_row *order = (sell_row*)malloc(max(slots, 1) * sizeof(sell_row));
+    for (i = 0; i < slots; i++) {
+        order[i].row = i < A->nrows ? i : -1;
+        order[i].len = i < A->nrows ? (int)(A->pointerE[i] - A->pointerB[i]) : -1;
+    }
+    for (i = 0; i < A->nrows; i += sigma)
+        qsort(order + i, min(sigma, A->nrows - i), sizeof(sell_row), sell_row_cmp);
+
+    S->perm = (int*)malloc(max(slots, 1) * sizeof(int));
+    S->chunk_len = (int*)malloc(max(S->nchunks, 1) * sizeof(int));
+    S->chunk_ptr = (long long*)malloc((S->nchunks + 1) * sizeof(long long));
+    S->chunk_ptr[0] = 0;
+    for (c = 0; c < S->nchunks; c++) {
+        int w = 0, l;
+        for (l = 0; l < SELL_C; l++) {
+            S->perm[c*SELL_C + l] = order[c*SELL_C + l].row;
+            w = max(w, order[c*SELL_C + l].len);
+        }
+        S->chunk_len[c] = w;
+        S->chunk_ptr[c+1] = S->chunk_ptr[c] + (long long)w * SELL_C;
+    }
+    free(order);
+
+    const long long stored = S->chunk_ptr[S->nchunks];
+    void *pv = NULL, *pc = NULL;
+    if (posix_memalign(&pv, 64, max(stored, 1) * sizeof(double)) != 0 || posix_memalign(&pc, 64, max(stored, 1) * sizeof(int)) != 0) {
+        fprintf(stderr, "sell_matrix_from_csr: allocation of %lld entries failed\n", stored);
+        exit(1);
+    }
+    S->val = (double*)pv;
+    S->col = (int*)pc;
+    matrix_place(S->val, stored * sizeof(double));
+    matrix_place(S->col, stored * sizeof(int));
+    // filled by the threads that will stream each chunk (first touch)
+    #pragma omp parallel private(c)
+    {
+        int cb, ce, l, j;
+        sell_chunk_partition(S, omp_get_thread_num(), omp_get_num_threads(), &cb, &ce);
+        for (c = cb; c < ce; c++) {
+            double *v = S->val + S->chunk_ptr[c];
+            int *ci = S->col + S->chunk_ptr[c];
+            for (l = 0; l < SELL_C; l++) {
+                int r = S->perm[c*SELL_C + l];
+                long long b = r >= 0 ? A->pointerB[r] - 1 : 0;
+                int len = r >= 0 ? (int)(A->pointerE[r] - A->pointerB[r]) : 0;
+                for (j = 0; j < S->chunk_len[c]; j++) {
+                    v[(long long)j*SELL_C + l] = j < len ? A->values[b + j] : 0;
+                    ci[(long long)j*SELL_C + l] = j < len ? A->cols[b + j] - 1 : 0;
+                }
+            }
+        }
+    }
+    return S;
+}
+
+mat_sell * sell_matrix_from_csr(mat_csr *A, int sigma)
+{
+    sigma = max((sigma + SELL_C - 1) / SELL_C * SELL_C, SELL_C);
+    mat_sell *S = sell_from_csr_rows(A, sigma);
+    if (A->At) {
+        S->At = sell_from_csr_rows(A->At, sigma);
+    } else {
+        mat_csr tmp = *A;
+        tmp.At = NULL;
+        csr_matrix_build_transpose(&tmp);
+        S->At = sell_from_csr_rows(tmp.At, sigma);
+        csr_matrix_delete(tmp.At);
+    }
+    return S;
+}
+
+void sell_matrix_delete(mat_sell *S)
+{
+    if (S->At)
+        sell_matrix_delete(S->At);
+    free(S->chunk_ptr);
+    free(S->chunk_len);
+    free(S->perm);
+    free(S->val);
+    free(S->col);
+    free(S);
+}
+
+size_t sell_matrix_bytes(const mat_sell *S)
+{
+    size_t stored = (size_t)S->chunk_ptr[S->nchunks];
+    size_t b = stored * (sizeof(double) + sizeof(int)) + (size_t)S->nchunks * (sizeof(long long) + sizeof(int) + SELL_C * sizeof(int));
+    return b + (S->At ? sell_matrix_bytes(S->At) : 0);
+}
+
+/* first chunk whose entries start at or after the target */
+static int sell_chunk_at(const mat_sell *S, long long target)
+{
+    int lo = 0, hi = S->nchunks;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (S->chunk_ptr[mid] < target)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+void sell_chunk_partition(const mat_sell *S, int p, int nparts, int *cb, int *ce)
+{
+    const long long stored = S->chunk_ptr[S->nchunks];
+    *cb = p == 0 ? 0 : sell_chunk_at(S, (long long)((double)stored * p / nparts));
+    *ce = p == nparts - 1 ? S->nchunks : sell_chunk_at(S, (long long)((double)stored * (p + 1) / nparts));
+}
+
+void sell_matrix_mult_chunks(const mat_sell *S, int cb, int ce, const double *x, double beta, const double *z, double *y)
+{
+    int c, l;
+    for (c = cb; c < ce; c++) {
+        const double *v = S->val + S->chunk_ptr[c];
+        const int *ci = S->col + S->chunk_ptr[c];
+        const int w = S->chunk_len[c];
+        int j;
+#if defined(__AVX512F__)
+        double acc[SELL_C] __attribute__((aligned(64)));
+        __m512d sum = _mm512_setzero_pd();
+        for (j = 0; j < w; j++) {
+            __m256i idx = _mm256_load_si256((const __m256i*)(ci + (long long)j*SELL_C));
+            sum = _mm512_fmadd_pd(_mm512_load_pd(v + (long long)j*SELL_C), _mm512_i32gather_pd(idx, x, 8), sum);
+        }
+        _mm512_store_pd(acc, sum);
+#elif defined(__AVX2__) && defined(__FMA__)
+        double acc[SELL_C] __attribute__((aligned(32)));
+        __m256d sum = _mm256_setzero_pd();
+        for (j = 0; j < w; j++) {
+            __m128i idx = _mm_load_si128((const __m128i*)(ci + (long long)j*SELL_C));
+            sum = _mm256_fmadd_pd(_mm256_load_pd(v + (long long)j*SELL_C), _mm256_i32gather_pd(x, idx, 8), sum);
+        }
+        _mm256_store_pd(acc, sum);
+#else
+        double acc[SELL_C] = {0};
+        for (j = 0; j < w; j++) {
+            #pragma omp simd
+            for (l = 0; l < SELL_C; l++)
+                acc[l] += v[(long long)j*SELL_C + l] * x[ci[(long long)j*SELL_C + l]];
+        }
+#endif
+        for (l = 0; l < SELL_C; l++) {
+            int r = S->perm[c*SELL_C + l];
+            if (r >= 0)
+                y[r] = beta != 0 ? acc[l] - beta*z[r] : acc[l];
+        }
+    }
+}
+
+void sell_matrix_vector_mult(mat_sell *A, vec *x, vec *y)
+{
+    #pragma omp parallel
+    {
+        int cb, ce;
+        sell_chunk_partition(A, omp_get_thread_num(), omp_get_num_threads(), &cb, &ce);
+        sell_matrix_mult_chunks(A, cb, ce, x->d, 0, NULL, y->d);
+    }
+}
+
+void sell_matrix_transpose_vector_mult(mat_sell *A, vec *x, vec *y)
+{
+    sell_matrix_vector_mult(A->At, x, y);
+}
@@ -1,100 +1,230 @@
-#pragma once
-
-#include <stdio.h>
-#include <lapacke.h>
-#include <cblas.h>
-#include <stdlib.h>
-#include <time.h>
-#include <string.h>
-#include <omp.h>
-#include <sys/time.h>
-
-#define min(x,y) (((x) < (y)) ? (x) : (y))
-#define max(x,y) (((x) > (y)) ? (x) : (y))
-
-typedef struct {
-    int nrows, ncols;
-    double * d;
-} mat;
-
-
-typedef struct {
-    int nrows;
-    double * d;
-} vec;
-
-typedef struct {
-    int nrows, ncols;
-    long long nnz; // number of non-zero element in the matrix.
-    long long capacity; // number of possible nnzs.
-    double *values;
-    int *rows, *cols;
-} mat_coo;
-
-typedef struct {
-    long long nnz;
-    int nrows, ncols;
-    double *values;
-    int *cols;
-    int *pointerB, *pointerE;
-} mat_csr;
-
-
-void initialize_random_vector(vec *M);
-
-void initialize_random_matrix_double(mat *M);
-
-mat * matrix_new(int nrows, int ncols);
-
-vec * vector_new(int nrows);
-
-void matrix_delete(mat *M);
-
-void vector_delete(vec *v);
-
-void matrix_print(mat * M);
-
-void matrix_copy(mat *D, mat *S);
-
-void vector_copy(vec *d, vec *s);
-
-double vector_dot_product(vec *u, vec *v);
-
-void matrix_build_transpose(mat *Mt, mat *M);
-
-double get_seconds_frac(struct timeval start_timeval, struct timeval end_timeval);
-
-void matrix_matrix_mult(mat *A, mat *B, mat *C);
-
-void matrix_transpose_matrix_mult(mat *A, mat *B, mat *C);
-
-void matrix_matrix_transpose_mult(mat *A, mat *B, mat *C);
-
-void matrix_vector_mult(mat *M, vec *x, vec *y);
-
-void matrix_transpose_vector_mult(mat *M, vec *x, vec *y);
-
-void matrix_set_element(mat *M, int row_num, int col_num, double val);
-
-double matrix_get_element(mat *M, int row_num, int col_num);
-
-void matrix_get_selected_columns(mat *M, int *inds, mat *Mc);
-
-void singular_value_decomposition(mat *M, mat *U, mat *S, mat *Vt);
-
-mat_coo* coo_matrix_new(int nrows, int ncols, int capacity);
-
-mat_csr* csr_matrix_new();
-
-void csr_matrix_delete(mat_csr *M);
-
-void csr_matrix_delete(mat_csr *M);
-
-void csr_init_from_coo(mat_csr *D, mat_coo *M);
-
-void coo_matrix_delete(mat_coo *M);
-
-void csr_matrix_vector_mult(mat_csr *A, vec *x, vec *y);
-
-void csr_matrix_transpose_vector_mult(mat_csr *A, vec *x, vec *y);
-
+#pragma once
+
+#include <stdio.h>
+#include <lapacke.h>
+#include <cblas.h>
+#include <stdlib.h>
+#include <time.h>
+#include <string.h>
+#include <omp.h>
+#include <sys/time.h>
+
+#define min(x,y) (((x) < (y)) ? (x) : (y))
+#define max(x,y) (((x) > (y)) ? (x) : (y))
+
+typedef struct {
+    int nrows, ncols;
+    double * d;
+} mat;
+
+
+typedef struct {
+    int nrows;
+    double * d;
+} vec;
+
+/* sparse formats use 1-based row/column indices */
+typedef struct {
+    int nrows, ncols;
+    long long nnz; // number of non-zero element in the matrix.
+    long long capacity; // number of possible nnzs.
+    double *values;
+    int *rows, *cols;
+} mat_coo;
+
+typedef struct mat_csr {
+    long long nnz;
+    int nrows, ncols;
+    double *values;
+    int *cols;
+    long long *pointerB, *pointerE; // 64-bit so that nnz may exceed 2^31
+    struct mat_csr *At; // optional CSR copy of A^T (see csr_matrix_build_transpose), NULL if absent
+} mat_csr;
+
+/* single-precision copies of mat / mat_csr for the mixed-precision solvers:
+   the matrix is stored and streamed as float, the vectors stay double */
+typedef struct {
+    int nrows, ncols;
+    float * d;
+} mat_f;
+
+typedef struct mat_csr_f {
+    long long nnz;
+    int nrows, ncols;
+    float *values;
+    int *cols;
+    long long *pointerB, *pointerE;
+    struct mat_csr_f *At;
+} mat_csr_f;
+
+/* SELL-C-sigma (sliced ELLPACK) copy of a CSR matrix for the Lanczos SpMV:
+   the rows are sorted by length within windows of sigma rows and cut into
+   chunks of SELL_C rows, each stored column-major and padded to its longest
+   row, so the SELL_C rows of a chunk advance together by one gather and one
+   FMA per stored column (AVX-512 with SELL_C = 8, AVX2 with 4, omp simd
+   otherwise; build with -march=native). Sorting keeps the padding small on
+   skewed rating rows. Threads split the chunks by stored entries, not by
+   rows, so heavy and light users balance. Indices are 0-based; padding
+   entries read column 0 with value 0. */
+#if defined(__AVX512F__)
+#define SELL_C 8
+#else
+#define SELL_C 4
+#endif
+
+typedef struct mat_sell {
+    int nrows, ncols, sigma;
+    long long nnz;           // entries of A, without the padding
+    int nchunks;
+    long long *chunk_ptr;    // nchunks+1 offsets into val / col
+    int *chunk_len;          // stored columns of each chunk
+    int *perm;               // row of A at each of the nchunks*SELL_C slots, -1 for padding
+    double *val;             // 64-byte aligned
+    int *col;
+    struct mat_sell *At;     // SELL copy of A^T (the A^T*u gather), NULL if absent
+} mat_sell;
+
+/* NUMA placement of the large arrays (A, the Lanczos bases, CSR arrays).
+   By default every row block is first touched by the thread that streams it
+   later under a static schedule (rows r*t/nt .. r*(t+1)/nt of each column for
+   thread t of nt), so its pages land on that thread's node. With interleave
+   on, pages are instead spread round-robin over all nodes, which suits
+   access patterns that do not follow the row blocks. Interleaving needs a
+   build with -DSVD_USE_NUMA and -lnuma; matrix_set_interleave returns
+   nonzero (and leaves first touch in place) when it is unavailable. */
+int matrix_set_interleave(int on);
+
+/* applies the interleave policy, if on, to a fresh allocation before it is
+   first touched */
+void matrix_place(void *p, size_t bytes);
+
+/* zero-filled nrows x ncols column-major array, zeroed by row blocks
+   as described above; NULL if the allocation fails */
+double * matrix_alloc_placed(int nrows, int ncols);
+
+/* memory footprint of a dense nrows x ncols mat and of a CSR matrix with
+   nnz entries (bytes, without its optional At) */
+size_t matrix_bytes(int nrows, int ncols);
+
+size_t csr_matrix_bytes(int nrows, long long nnz);
+
+void initialize_random_vector(vec *M);
+
+/* reentrant variant drawing from *seed (rand_r), for concurrent solves */
+void initialize_random_vector_r(vec *M, unsigned int *seed);
+
+void initialize_random_matrix_double(mat *M);
+
+void initialize_random_matrix_gaussian(mat *M);
+
+mat * matrix_new(int nrows, int ncols);
+
+vec * vector_new(int nrows);
+
+void matrix_delete(mat *M);
+
+void vector_delete(vec *v);
+
+void matrix_print(mat * M);
+
+void matrix_copy(mat *D, mat *S);
+
+void vector_copy(vec *d, vec *s);
+
+double vector_dot_product(vec *u, vec *v);
+
+void matrix_build_transpose(mat *Mt, mat *M);
+
+double get_seconds_frac(struct timeval start_timeval, struct timeval end_timeval);
+
+void matrix_matrix_mult(mat *A, mat *B, mat *C);
+
+void matrix_transpose_matrix_mult(mat *A, mat *B, mat *C);
+
+void matrix_matrix_transpose_mult(mat *A, mat *B, mat *C);
+
+void matrix_vector_mult(mat *M, vec *x, vec *y);
+
+void matrix_transpose_vector_mult(mat *M, vec *x, vec *y);
+
+/* fused y = M*x - beta*z and y = M^T*x - beta*z (z unused when beta == 0) */
+void matrix_vector_mult_sub(mat *M, vec *x, double beta, vec *z, vec *y);
+
+void matrix_transpose_vector_mult_sub(mat *M, vec *x, double beta, vec *z, vec *y);
+
+void matrix_set_element(mat *M, int row_num, int col_num, double val);
+
+double matrix_get_element(mat *M, int row_num, int col_num);
+
+void matrix_get_selected_columns(mat *M, int *inds, mat *Mc);
+
+void singular_value_decomposition(mat *M, mat *U, mat *S, mat *Vt);
+
+void compact_QR_factorization(mat *M, mat *Q, mat *R);
+
+mat_coo* coo_matrix_new(int nrows, int ncols, long long capacity);
+
+void coo_matrix_append(mat_coo *M, int row, int col, double val);
+
+mat_csr* csr_matrix_new();
+
+void csr_matrix_delete(mat_csr *M);
+
+void csr_matrix_delete(mat_csr *M);
+
+void csr_init_from_coo(mat_csr *D, mat_coo *M);
+
+void coo_matrix_delete(mat_coo *M);
+
+void csr_matrix_vector_mult(mat_csr *A, vec *x, vec *y);
+
+void csr_matrix_transpose_vector_mult(mat_csr *A, vec *x, vec *y);
+
+void csr_matrix_vector_mult_sub(mat_csr *A, vec *x, double beta, vec *z, vec *y);
+
+void csr_matrix_transpose_vector_mult_sub(mat_csr *A, vec *x, double beta, vec *z, vec *y);
+
+/* builds A->At once, in parallel. The transpose products then run as
+   row-parallel gathers over At, at the cost of a second copy of the
+   index and value arrays. csr_matrix_delete frees it. */
+void csr_matrix_build_transpose(mat_csr *A);
+
+/* means of the stored entries of every row (row_mean, nrows) and column
+   (col_mean, ncols) and of all of them (*mean); a row or column without
+   entries gets the overall mean. Any output may be NULL. */
+void csr_matrix_means(const mat_csr *A, double *row_mean, double *col_mean, double *mean);
+
+void csr_matrix_matrix_mult(mat_csr *A, mat *B, mat *C);
+
+void csr_matrix_transpose_matrix_mult(mat_csr *A, mat *B, mat *C);
+
+/* float copies of A (and of A->At when present); A itself is untouched and
+   may be freed afterwards */
+mat_f * matrix_to_float(mat *A);
+
+mat_csr_f * csr_matrix_to_float(mat_csr *A);
+
+void matrix_f_delete(mat_f *M);
+
+void csr_matrix_f_delete(mat_csr_f *M);
+
+/* SELL-C-sigma copy of A, and of A^T in ->At (from A->At when present);
+   sigma is rounded up to a multiple of SELL_C. A is untouched and may be
+   freed afterwards. */
+mat_sell * sell_matrix_from_csr(mat_csr *A, int sigma);
+
+void sell_matrix_delete(mat_sell *S);
+
+/* bytes held by S, its At included */
+size_t sell_matrix_bytes(const mat_sell *S);
+
+/* chunks [*cb, *ce) of part p of nparts, balanced by stored entries */
+void sell_chunk_partition(const mat_sell *S, int p, int nparts, int *cb, int *ce);
+
+/* y = A*x - beta*z on the rows of chunks cb .. ce-1 (z unused if beta == 0) */
+void sell_matrix_mult_chunks(const mat_sell *S, int cb, int ce, const double *x, double beta, const double *z, double *y);
+
+void sell_matrix_vector_mult(mat_sell *A, vec *x, vec *y);
+
+/* through A->At */
+void sell_matrix_transpose_vector_mult(mat_sell *A, vec *x, vec *y);
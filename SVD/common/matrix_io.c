@@ -0,0 +1,560 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <omp.h>
+#include <cblas.h>
+#include "matrix_io.h"
+
+#define CACHE_ALIGN 64
+
+static size_t align_up(size_t x)
+{
+    return (x + CACHE_ALIGN - 1) / CACHE_ALIGN * CACHE_ALIGN;
+}
+
+/* writes n bytes of data and zero-pads the file to the next array boundary */
+static int write_padded(FILE *fp, const void *data, size_t n)
+{
+    static const char zeros[CACHE_ALIGN] = {0};
+    if (n > 0 && fwrite(data, 1, n, fp) != n)
+        return 1;
+    size_t pad = align_up(n) - n;
+    if (pad > 0 && fwrite(zeros, 1, pad, fp) != pad)
+        return 1;
+    return 0;
+}
+
+static void header_init(matrix_cache_header *h, int kind, int nrows, int ncols, long long nnz)
+{
+    memset(h, 0, sizeof(*h));
+    memcpy(h->magic, MATRIX_CACHE_MAGIC, sizeof(h->magic));
+    h->kind = kind;
+    h->nrows = nrows;
+    h->ncols = ncols;
+    h->version = 2;
+    h->nnz = nnz;
+}
+
+/* expected file size: header plus the aligned arrays */
+static size_t rowptr_size(const matrix_cache_header *h)
+{
+    return ((size_t)h->nrows + 1) * (h->version == 1 ? sizeof(int) : sizeof(long long));
+}
+
+static size_t cache_size(const matrix_cache_header *h)
+{
+    if (h->kind == MATRIX_CACHE_CSR)
+        return sizeof(*h) + align_up(rowptr_size(h))
+            + align_up((size_t)h->nnz * sizeof(int)) + (size_t)h->nnz * sizeof(double);
+    return sizeof(*h) + (size_t)h->nrows * h->ncols * sizeof(double);
+}
+
+int matrix_cache_kind(const char *filename, matrix_cache_header *h)
+{
+    matrix_cache_header tmp;
+    FILE *fp = fopen(filename, "rb");
+    if (!fp)
+        return -1;
+    size_t got = fread(&tmp, sizeof(tmp), 1, fp);
+    fclose(fp);
+    if (got != 1)
+        return -1;
+    if (memcmp(tmp.magic, MATRIX_CACHE_MAGIC, sizeof(tmp.magic)) == 0)
+        tmp.version = 2;
+    else if (memcmp(tmp.magic, MATRIX_CACHE_MAGIC_V1, sizeof(tmp.magic)) == 0)
+        tmp.version = 1;
+    else
+        return -1;
+    if (tmp.kind != MATRIX_CACHE_DENSE && tmp.kind != MATRIX_CACHE_CSR)
+        return -1;
+    if (h)
+        *h = tmp;
+    return tmp.kind;
+}
+
+int matrix_cache_save_csr(const char *filename, const mat_csr *A)
+{
+    int i;
+    // the file holds one rowptr array, so row i must end where row i+1 starts
+    for (i = 0; i + 1 < A->nrows; i++) {
+        if (A->pointerE[i] != A->pointerB[i+1])
+            return 2;
+    }
+    FILE *fp = fopen(filename, "wb");
+    if (!fp)
+        return 3;
+
+    matrix_cache_header h;
+    header_init(&h, MATRIX_CACHE_CSR, A->nrows, A->ncols, A->nnz);
+    long long *rowptr = (long long*)malloc(((size_t)A->nrows + 1) * sizeof(long long));
+    if (A->nrows > 0)
+        memcpy(rowptr, A->pointerB, (size_t)A->nrows * sizeof(long long));
+    rowptr[A->nrows] = A->nrows > 0 ? A->pointerE[A->nrows-1] : 1;
+
+    int err = fwrite(&h, sizeof(h), 1, fp) != 1
+        || write_padded(fp, rowptr, ((size_t)A->nrows + 1) * sizeof(long long))
+        || write_padded(fp, A->cols, (size_t)A->nnz * sizeof(int))
+        || ((size_t)fwrite(A->values, sizeof(double), (size_t)A->nnz, fp) != (size_t)A->nnz);
+    free(rowptr);
+    if (fclose(fp) != 0)
+        err = 1;
+    return err ? 4 : 0;
+}
+
+int matrix_cache_save_dense(const char *filename, const mat *A)
+{
+    FILE *fp = fopen(filename, "wb");
+    if (!fp)
+        return 3;
+
+    matrix_cache_header h;
+    header_init(&h, MATRIX_CACHE_DENSE, A->nrows, A->ncols, 0);
+    size_t n = (size_t)A->nrows * A->ncols;
+    int err = fwrite(&h, sizeof(h), 1, fp) != 1
+        || fwrite(A->d, sizeof(double), n, fp) != n;
+    if (fclose(fp) != 0)
+        err = 1;
+    return err ? 4 : 0;
+}
+
+/* maps the whole file copy-on-write, so that a solver touching A can never
+   modify the cache on disk */
+static int cache_map(const char *filename, int kind, matrix_cache_header *h, mapped_file *f)
+{
+    struct stat st;
+    f->addr = NULL;
+    f->size = 0;
+    f->owned = NULL;
+    if (matrix_cache_kind(filename, h) != kind)
+        return 2;
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return 3;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < cache_size(h)) {
+        close(fd);
+        return 4; // truncated cache
+    }
+    f->size = (size_t)st.st_size;
+    f->addr = mmap(NULL, f->size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (f->addr == MAP_FAILED) {
+        f->addr = NULL;
+        return 5;
+    }
+    return 0;
+}
+
+int matrix_cache_map_csr(const char *filename, int row_begin, int row_end, mat_csr *A, mapped_file *f)
+{
+    matrix_cache_header h;
+    int err = cache_map(filename, MATRIX_CACHE_CSR, &h, f);
+    if (err)
+        return err;
+    if (row_begin < 0 || row_end > h.nrows || row_begin > row_end) {
+        matrix_cache_unmap(f);
+        return 1;
+    }
+
+    char *base = (char*)f->addr + sizeof(h);
+    long long *rowptr = (long long*)base;
+    int *rowptr_v1 = (int*)base;
+    int *cols = (int*)(base + align_up(rowptr_size(&h)));
+    double *values = (double*)((char*)cols + align_up((size_t)h.nnz * sizeof(int)));
+
+    int nrows = row_end - row_begin;
+    long long first = (h.version == 1 ? rowptr_v1[row_begin] : rowptr[row_begin]) - 1;
+    if (row_begin > 0 || h.version == 1) {
+        // local 1-based row pointers into the shared cols/values window
+        int i;
+        long long *local = (long long*)malloc(((size_t)nrows + 1) * sizeof(long long));
+        for (i = 0; i <= nrows; i++)
+            local[i] = (h.version == 1 ? rowptr_v1[row_begin + i] : rowptr[row_begin + i]) - first;
+        f->owned = local;
+        rowptr = local;
+    }
+
+    A->nrows = nrows;
+    A->ncols = h.ncols;
+    A->nnz = rowptr[nrows] - 1;
+    A->pointerB = rowptr;
+    A->pointerE = rowptr + 1;
+    A->cols = cols + first;
+    A->values = values + first;
+    return 0;
+}
+
+int matrix_cache_map_dense(const char *filename, int row_begin, int row_end, mat *A, mapped_file *f)
+{
+    matrix_cache_header h;
+    int err = cache_map(filename, MATRIX_CACHE_DENSE, &h, f);
+    if (err)
+        return err;
+    if (row_begin < 0 || row_end > h.nrows || row_begin > row_end) {
+        matrix_cache_unmap(f);
+        return 1;
+    }
+
+    double *d = (double*)((char*)f->addr + sizeof(h));
+    A->nrows = row_end - row_begin;
+    A->ncols = h.ncols;
+    if (A->nrows == h.nrows) {
+        A->d = d;
+        return 0;
+    }
+
+    int j;
+    A->d = (double*)malloc((size_t)A->nrows * A->ncols * sizeof(double));
+    #pragma omp parallel for
+    for (j = 0; j < A->ncols; j++)
+        memcpy(A->d + (size_t)j * A->nrows, d + (size_t)j * h.nrows + row_begin, (size_t)A->nrows * sizeof(double));
+    f->owned = A->d;
+    // the copy is all this rank needs, drop the mapping right away
+    munmap(f->addr, f->size);
+    f->addr = NULL;
+    return 0;
+}
+
+void matrix_cache_unmap(mapped_file *f)
+{
+    if (f->addr)
+        munmap(f->addr, f->size);
+    free(f->owned);
+    f->addr = NULL;
+    f->size = 0;
+    f->owned = NULL;
+}
+
+/* ---- out-of-core streaming ------------------------------------------ */
+
+static int pread_full(int fd, void *buf, size_t n, off_t off)
+{
+    char *p = (char*)buf;
+    while (n > 0) {
+        ssize_t got = pread(fd, p, n, off);
+        if (got < 0 && errno == EINTR)
+            continue;
+        if (got <= 0)
+            return 1;
+        p += got;
+        n -= (size_t)got;
+        off += got;
+    }
+    return 0;
+}
+
+/* a CSR panel buffer holds cols[cnt], then values[cnt] on the next 8 bytes */
+static size_t panel_values_offset(long long cnt)
+{
+    return ((size_t)cnt * sizeof(int) + 7) / 8 * 8;
+}
+
+static size_t csr_panel_bytes(long long cnt)
+{
+    return panel_values_offset(cnt) + (size_t)cnt * sizeof(double);
+}
+
+int matrix_stream_open(const char *filename, size_t panel_bytes, matrix_stream *s)
+{
+    matrix_cache_header h;
+    struct stat st;
+    int i;
+    memset(s, 0, sizeof(*s));
+    s->fd = -1;
+    int kind = matrix_cache_kind(filename, &h);
+    if (kind < 0)
+        return 2;
+    s->fd = open(filename, O_RDONLY);
+    if (s->fd < 0)
+        return 3;
+    if (fstat(s->fd, &st) != 0 || (size_t)st.st_size < cache_size(&h)) {
+        matrix_stream_close(s);
+        return 4; // truncated cache
+    }
+    posix_fadvise(s->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    s->kind = kind;
+    s->nrows = h.nrows;
+    s->ncols = h.ncols;
+    s->nnz = kind == MATRIX_CACHE_CSR ? h.nnz : (long long)h.nrows * h.ncols;
+    s->data_off = sizeof(h);
+
+    if (kind == MATRIX_CACHE_CSR) {
+        s->rowptr = (long long*)malloc(((size_t)h.nrows + 1) * sizeof(long long));
+        if (h.version == 1) {
+            int *v1 = (int*)malloc(rowptr_size(&h));
+            if (v1 && pread_full(s->fd, v1, rowptr_size(&h), sizeof(h)) == 0) {
+                for (i = 0; i <= h.nrows; i++)
+                    s->rowptr[i] = v1[i];
+            } else {
+                s->error = 5;
+            }
+            free(v1);
+        } else if (pread_full(s->fd, s->rowptr, rowptr_size(&h), sizeof(h)) != 0) {
+            s->error = 5;
+        }
+        if (s->error) {
+            matrix_stream_close(s);
+            return 5;
+        }
+        s->data_off = sizeof(h) + align_up(rowptr_size(&h));
+        s->values_off = s->data_off + align_up((size_t)h.nnz * sizeof(int));
+
+        // greedy row panels of at most panel_bytes (a longer row is a panel of its own)
+        s->panel_start = (int*)malloc(((size_t)h.nrows + 1) * sizeof(int));
+        int r = 0;
+        while (r < h.nrows) {
+            int e = r + 1;
+            while (e < h.nrows && csr_panel_bytes(s->rowptr[e+1] - s->rowptr[r]) <= panel_bytes)
+                e++;
+            s->panel_start[s->npanels++] = r;
+            s->buf_bytes = max(s->buf_bytes, csr_panel_bytes(s->rowptr[e] - s->rowptr[r]));
+            r = e;
+        }
+        s->panel_start[s->npanels] = h.nrows;
+    } else {
+        size_t col_bytes = (size_t)h.nrows * sizeof(double);
+        int per = (int)min((size_t)max(h.ncols, 1), max(panel_bytes / max(col_bytes, 1), 1));
+        s->npanels = (h.ncols + per - 1) / per;
+        s->panel_start = (int*)malloc(((size_t)s->npanels + 1) * sizeof(int));
+        for (i = 0; i <= s->npanels; i++)
+            s->panel_start[i] = min(i * per, h.ncols);
+        s->buf_bytes = (size_t)per * col_bytes;
+    }
+    for (i = 0; i < 2; i++) {
+        s->buf[i] = malloc(max(s->buf_bytes, 1));
+        if (!s->buf[i]) {
+            matrix_stream_close(s);
+            return 6;
+        }
+    }
+    return 0;
+}
+
+void matrix_stream_close(matrix_stream *s)
+{
+    if (s->fd >= 0)
+        close(s->fd);
+    free(s->rowptr);
+    free(s->panel_start);
+    free(s->buf[0]);
+    free(s->buf[1]);
+    s->fd = -1;
+    s->rowptr = NULL;
+    s->panel_start = NULL;
+    s->buf[0] = s->buf[1] = NULL;
+}
+
+size_t matrix_stream_bytes(int nrows, int ncols, long long nnz, int sparse, size_t panel_bytes)
+{
+    size_t data = sparse ? csr_panel_bytes(nnz) : (size_t)nrows * ncols * sizeof(double);
+    return 2 * min(panel_bytes, data) + (sparse ? ((size_t)nrows + 1) * sizeof(long long) : 0);
+}
+
+typedef struct {
+    matrix_stream *s;
+    int panel, slot;
+    int err;
+    double seconds;
+} panel_read;
+
+/* reader thread: panel rd->panel into buffer rd->slot */
+static void * panel_read_run(void *arg)
+{
+    panel_read *rd = (panel_read*)arg;
+    matrix_stream *s = rd->s;
+    char *buf = (char*)s->buf[rd->slot];
+    double t = omp_get_wtime();
+    int a = s->panel_start[rd->panel], e = s->panel_start[rd->panel + 1];
+    if (s->kind == MATRIX_CACHE_CSR) {
+        long long first = s->rowptr[a] - 1, cnt = s->rowptr[e] - s->rowptr[a];
+        off_t co = s->data_off + (off_t)first * sizeof(int), vo = s->values_off + (off_t)first * sizeof(double);
+        rd->err = pread_full(s->fd, buf, (size_t)cnt * sizeof(int), co)
+            || pread_full(s->fd, buf + panel_values_offset(cnt), (size_t)cnt * sizeof(double), vo);
+        posix_fadvise(s->fd, co, (off_t)cnt * sizeof(int), POSIX_FADV_DONTNEED);
+        posix_fadvise(s->fd, vo, (off_t)cnt * sizeof(double), POSIX_FADV_DONTNEED);
+        s->bytes_read += (double)cnt * (sizeof(int) + sizeof(double));
+    } else {
+        size_t n = (size_t)(e - a) * s->nrows * sizeof(double);
+        off_t off = s->data_off + (off_t)a * s->nrows * sizeof(double);
+        rd->err = pread_full(s->fd, buf, n, off);
+        posix_fadvise(s->fd, off, (off_t)n, POSIX_FADV_DONTNEED);
+        s->bytes_read += (double)n;
+    }
+    rd->seconds = omp_get_wtime() - t;
+    return NULL;
+}
+
+typedef void (*panel_apply)(matrix_stream *s, int panel, const void *buf, void *ctx);
+
+/* one scan of the file: panel i is applied while panel i+1 is read */
+static int stream_pass(matrix_stream *s, panel_apply apply, void *ctx)
+{
+    pthread_t reader;
+    panel_read rd[2];
+    int i;
+    if (s->error)
+        return s->error;
+    rd[0].s = rd[1].s = s;
+    rd[0].panel = 0;
+    rd[0].slot = 0;
+    if (pthread_create(&reader, NULL, panel_read_run, &rd[0]) != 0)
+        return s->error = 7;
+    for (i = 0; i < s->npanels; i++) {
+        panel_read *cur = &rd[i & 1];
+        double t = omp_get_wtime();
+        pthread_join(reader, NULL);
+        s->wait_seconds += omp_get_wtime() - t;
+        s->read_seconds += cur->seconds;
+        if (cur->err) {
+            s->error = 8;
+            return s->error;
+        }
+        if (i + 1 < s->npanels) {
+            panel_read *next = &rd[(i + 1) & 1];
+            next->panel = i + 1;
+            next->slot = (i + 1) & 1;
+            if (pthread_create(&reader, NULL, panel_read_run, next) != 0) {
+                s->error = 7;
+                return s->error;
+            }
+        }
+        apply(s, i, s->buf[cur->slot], ctx);
+    }
+    s->passes++;
+    return 0;
+}
+
+/* X and Y of a product plus per-thread scratch: X transposed to row-major
+   for the CSR gathers, and nthreads accumulators (p, or ncols x p for A^T) */
+typedef struct {
+    mat *X, *Y;
+    int p, nthreads;
+    double *Xt;
+    double *acc;
+} stream_product;
+
+static void csr_panel_mult(matrix_stream *s, int panel, const void *buf, void *ctx)
+{
+    stream_product *c = (stream_product*)ctx;
+    const int a = s->panel_start[panel], e = s->panel_start[panel + 1], p = c->p;
+    const long long first = s->rowptr[a];
+    const int *cols = (const int*)buf;
+    const double *values = (const double*)((const char*)buf + panel_values_offset(s->rowptr[e] - first));
+    #pragma omp parallel num_threads(c->nthreads)
+    {
+        double *acc = c->acc + (long long)omp_get_thread_num() * p;
+        int i, q;
+        long long j;
+        #pragma omp for schedule(static)
+        for (i = a; i < e; i++) {
+            for (q = 0; q < p; q++)
+                acc[q] = 0;
+            for (j = s->rowptr[i] - first; j < s->rowptr[i+1] - first; j++) {
+                const double *xrow = c->Xt + (long long)(cols[j]-1) * p;
+                for (q = 0; q < p; q++)
+                    acc[q] += values[j] * xrow[q];
+            }
+            for (q = 0; q < p; q++)
+                c->Y->d[(long long)q * s->nrows + i] = acc[q];
+        }
+    }
+}
+
+static void csr_panel_transpose_mult(matrix_stream *s, int panel, const void *buf, void *ctx)
+{
+    stream_product *c = (stream_product*)ctx;
+    const int a = s->panel_start[panel], e = s->panel_start[panel + 1], p = c->p;
+    const long long first = s->rowptr[a];
+    const int *cols = (const int*)buf;
+    const double *values = (const double*)((const char*)buf + panel_values_offset(s->rowptr[e] - first));
+    #pragma omp parallel num_threads(c->nthreads)
+    {
+        double *mine = c->acc + (long long)omp_get_thread_num() * s->ncols * p;
+        int i, q;
+        long long j;
+        #pragma omp for schedule(static)
+        for (i = a; i < e; i++) {
+            for (j = s->rowptr[i] - first; j < s->rowptr[i+1] - first; j++) {
+                double *yrow = mine + (long long)(cols[j]-1) * p;
+                for (q = 0; q < p; q++)
+                    yrow[q] += values[j] * c->X->d[(long long)q * s->nrows + i];
+            }
+        }
+    }
+}
+
+/* Y += A(:, panel) * X(panel, :), Y = 0 before the first panel */
+static void dense_panel_mult(matrix_stream *s, int panel, const void *buf, void *ctx)
+{
+    stream_product *c = (stream_product*)ctx;
+    const int a = s->panel_start[panel], e = s->panel_start[panel + 1];
+    cblas_dgemm(CblasColMajor, CblasNoTrans, CblasNoTrans, s->nrows, c->p, e - a, 1.0, (const double*)buf, s->nrows,
+                c->X->d + a, c->X->nrows, panel == 0 ? 0.0 : 1.0, c->Y->d, c->Y->nrows);
+}
+
+/* Y(panel, :) = A(:, panel)^T * X */
+static void dense_panel_transpose_mult(matrix_stream *s, int panel, const void *buf, void *ctx)
+{
+    stream_product *c = (stream_product*)ctx;
+    const int a = s->panel_start[panel], e = s->panel_start[panel + 1];
+    cblas_dgemm(CblasColMajor, CblasTrans, CblasNoTrans, e - a, c->p, s->nrows, 1.0, (const double*)buf, s->nrows,
+                c->X->d, c->X->nrows, 0.0, c->Y->d + a, c->Y->nrows);
+}
+
+int matrix_stream_mult(matrix_stream *s, mat *X, mat *Y)
+{
+    stream_product c;
+    int i, q, err;
+    c.X = X;
+    c.Y = Y;
+    c.p = X->ncols;
+    c.nthreads = omp_get_max_threads();
+    c.Xt = NULL;
+    c.acc = NULL;
+    if (s->kind == MATRIX_CACHE_DENSE)
+        return stream_pass(s, dense_panel_mult, &c);
+    c.Xt = (double*)malloc((size_t)s->ncols * c.p * sizeof(double));
+    c.acc = (double*)malloc((size_t)c.nthreads * c.p * sizeof(double));
+    #pragma omp parallel for schedule(static) private(q)
+    for (i = 0; i < s->ncols; i++)
+        for (q = 0; q < c.p; q++)
+            c.Xt[(long long)i * c.p + q] = X->d[(long long)q * X->nrows + i];
+    err = stream_pass(s, csr_panel_mult, &c);
+    free(c.Xt);
+    free(c.acc);
+    return err;
+}
+
+int matrix_stream_transpose_mult(matrix_stream *s, mat *X, mat *Y)
+{
+    stream_product c;
+    int i, q, t, err;
+    c.X = X;
+    c.Y = Y;
+    c.p = X->ncols;
+    c.nthreads = omp_get_max_threads();
+    c.Xt = NULL;
+    c.acc = NULL;
+    if (s->kind == MATRIX_CACHE_DENSE)
+        return stream_pass(s, dense_panel_transpose_mult, &c);
+    // per-thread row-major ncols x p accumulators over the whole scan, summed at the end
+    long long slice = (long long)s->ncols * c.p;
+    c.acc = (double*)calloc((size_t)slice * c.nthreads, sizeof(double));
+    err = stream_pass(s, csr_panel_transpose_mult, &c);
+    #pragma omp parallel for schedule(static) private(q, t) num_threads(c.nthreads)
+    for (i = 0; i < s->ncols; i++) {
+        for (q = 0; q < c.p; q++) {
+            double sum = 0;
+            for (t = 0; t < c.nthreads; t++)
+                sum += c.acc[slice * t + (long long)i * c.p + q];
+            Y->d[(long long)q * Y->nrows + i] = sum;
+        }
+    }
+    free(c.acc);
+    return err;
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <sys/types.h>
+#include "matrix_funcs.h"
+
+/* Binary cache of an ingested rating matrix, written once from the CSV and
+   mmap'ed by later runs with no parsing and no copy.
+
+   Layout: a 64-byte matrix_cache_header followed by the arrays, each one
+   starting on a 64-byte boundary.
+     CSR:   long long rowptr[nrows+1], int cols[nnz], double values[nnz]
+            (1-based like mat_csr, pointerB = rowptr, pointerE = rowptr+1)
+     dense: double d[nrows*ncols], column-major like mat
+   Version 1 caches ("SVDMAT01") hold an int rowptr; they are still read,
+   with the row pointers widened into a heap copy. */
+
+#define MATRIX_CACHE_MAGIC "SVDMAT02"
+#define MATRIX_CACHE_MAGIC_V1 "SVDMAT01"
+#define MATRIX_CACHE_DENSE 0
+#define MATRIX_CACHE_CSR 1
+
+typedef struct {
+    char magic[8];
+    int kind;
+    int nrows, ncols;
+    int version; // 1 or 2, filled in by matrix_cache_kind from the magic
+    long long nnz; // 0 for dense caches
+    char pad[32];
+} matrix_cache_header;
+
+/* a mapped cache file; matrices loaded from it stay valid until
+   matrix_cache_unmap, and must not be passed to matrix_delete /
+   csr_matrix_delete */
+typedef struct {
+    void *addr;
+    size_t size;
+    void *owned; // heap copy made for a row block or a v1 cache (rowptr) or dense rows
+} mapped_file;
+
+/* returns MATRIX_CACHE_DENSE / MATRIX_CACHE_CSR and fills *h if filename is
+   a cache file, -1 otherwise (e.g. a CSV) */
+int matrix_cache_kind(const char *filename, matrix_cache_header *h);
+
+/* both return 0 on success, nonzero on error */
+int matrix_cache_save_csr(const char *filename, const mat_csr *A);
+
+int matrix_cache_save_dense(const char *filename, const mat *A);
+
+/* map rows row_begin .. row_end-1 of a CSR cache into *A (a csr_matrix_new()
+   shell). The whole matrix is zero-copy; a row block shares cols/values with
+   the mapping and only rebases its nrows+1 row pointers (as does a v1 cache,
+   whose row pointers are widened). */
+int matrix_cache_map_csr(const char *filename, int row_begin, int row_end, mat_csr *A, mapped_file *f);
+
+/* map rows row_begin .. row_end-1 of a dense cache into *A. The whole matrix
+   is zero-copy; a strict row block is copied out since columns are
+   contiguous in the file. */
+int matrix_cache_map_dense(const char *filename, int row_begin, int row_end, mat *A, mapped_file *f);
+
+void matrix_cache_unmap(mapped_file *f);
+
+/* Out-of-core access to a cache file that does not fit in memory. Only the
+   row pointers of a CSR cache (8 bytes per row) are kept; the matrix itself
+   is read by panels (row panels of a CSR cache, column panels of a dense
+   one, since its columns are contiguous) of at most about panel_bytes,
+   with pread into one of two buffers while a reader thread fetches the
+   next panel into the other. Every product is one sequential scan of the
+   file, and the pages read are dropped from the page cache behind it. */
+typedef struct {
+    int fd;
+    int kind;                // MATRIX_CACHE_DENSE / MATRIX_CACHE_CSR
+    int nrows, ncols;
+    long long nnz;
+    long long *rowptr;       // CSR: nrows+1 row pointers, 1-based
+    off_t data_off;          // CSR: cols, dense: d
+    off_t values_off;        // CSR: values
+    int npanels;
+    int *panel_start;        // first row (CSR) / column (dense) of each panel, npanels+1 entries
+    void *buf[2];
+    size_t buf_bytes;
+    int error;               // first I/O error (sticky), 0 if none
+    // since matrix_stream_open
+    long long passes;
+    double bytes_read;
+    double read_seconds;     // spent in pread by the reader thread
+    double wait_seconds;     // compute threads blocked on a panel not yet read
+} matrix_stream;
+
+/* returns 0 on success, nonzero on error (not a cache, unreadable, truncated) */
+int matrix_stream_open(const char *filename, size_t panel_bytes, matrix_stream *s);
+
+void matrix_stream_close(matrix_stream *s);
+
+/* close estimate of the bytes matrix_stream_open keeps in memory for a
+   cache of this shape: the two panel buffers plus the CSR row pointers */
+size_t matrix_stream_bytes(int nrows, int ncols, long long nnz, int sparse, size_t panel_bytes);
+
+/* Y = A*X (Y is nrows x p) and Y = A^T*X (Y is ncols x p), each one scan of
+   the file; both return 0, or the stream's error, after which Y is
+   undefined */
+int matrix_stream_mult(matrix_stream *s, mat *X, mat *Y);
+
+int matrix_stream_transpose_mult(matrix_stream *s, mat *X, mat *Y);
@@ -0,0 +1,488 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "recommend.h"
+
+#define DEFAULT_BATCH 4096
+
+int svd_model_load(const char *filename, svd_model *M)
+{
+    struct stat st;
+    const double *data[3];
+    int shape[3][2], i;
+    memset(M, 0, sizeof(*M));
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return 2;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return 3;
+    }
+    M->file.size = (size_t)st.st_size;
+    M->file.addr = M->file.size > 0 ? mmap(NULL, M->file.size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (M->file.addr == MAP_FAILED) {
+        M->file.addr = NULL;
+        return 4;
+    }
+
+    // Uk, Sk, Vk: (int nrows, int ncols, doubles) each
+    size_t off = 0;
+    const char *base = (const char*)M->file.addr;
+    for (i = 0; i < 3; i++) {
+        if (off + 2 * sizeof(int) > M->file.size) {
+            svd_model_free(M);
+            return 5; // truncated
+        }
+        memcpy(shape[i], base + off, 2 * sizeof(int));
+        off += 2 * sizeof(int);
+        size_t n = (size_t)shape[i][0] * shape[i][1];
+        if (shape[i][0] < 0 || shape[i][1] < 0 || off + n * sizeof(double) > M->file.size) {
+            svd_model_free(M);
+            return 5;
+        }
+        data[i] = (const double*)(base + off);
+        off += n * sizeof(double);
+    }
+    int k = shape[1][0] * shape[1][1];
+    if (k < 1 || shape[0][1] != k || shape[2][1] != k) {
+        svd_model_free(M);
+        return 6; // not the rank-k factors of one SVD
+    }
+
+    M->nusers = shape[0][0];
+    M->nmovies = shape[2][0];
+    M->k = k;
+    M->V.nrows = M->nmovies;
+    M->V.ncols = k;
+    M->V.d = (double*)data[2];
+    M->s = data[1];
+    M->US.nrows = M->nusers;
+    M->US.ncols = k;
+    M->US.d = matrix_alloc_placed(M->nusers, k);
+    #pragma omp parallel for schedule(static)
+    for (i = 0; i < M->nusers; i++) {
+        int j;
+        for (j = 0; j < k; j++)
+            M->US.d[(long long)j * M->nusers + i] = data[0][(long long)j * M->nusers + i] * data[1][j];
+    }
+    return 0;
+}
+
+void svd_model_free(svd_model *M)
+{
+    free(M->US.d);
+    matrix_cache_unmap(&M->file);
+    memset(M, 0, sizeof(*M));
+}
+
+/* a (score, movie) pair ranks above another by score, then by lower id */
+static int better(double sa, int ja, double sb, int jb)
+{
+    return sa > sb || (sa == sb && ja < jb);
+}
+
+static void heap_swap(double *hs, int *hj, int a, int b)
+{
+    double s = hs[a];
+    int j = hj[a];
+    hs[a] = hs[b];
+    hj[a] = hj[b];
+    hs[b] = s;
+    hj[b] = j;
+}
+
+/* min-heap on 'better': the root is the worst of the kept movies */
+static void heap_sift_down(double *hs, int *hj, int len, int i)
+{
+    for (;;) {
+        int l = 2*i + 1, r = l + 1, w = i;
+        if (l < len && better(hs[w], hj[w], hs[l], hj[l]))
+            w = l;
+        if (r < len && better(hs[w], hj[w], hs[r], hj[r]))
+            w = r;
+        if (w == i)
+            return;
+        heap_swap(hs, hj, i, w);
+        i = w;
+    }
+}
+
+static void heap_sift_up(double *hs, int *hj, int i)
+{
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (!better(hs[parent], hj[parent], hs[i], hj[i]))
+            return;
+        heap_swap(hs, hj, i, parent);
+        i = parent;
+    }
+}
+
+/* offers (score, j) to a heap of at most cap entries holding *len */
+static void heap_offer(double *hs, int *hj, int *len, int cap, double score, int j)
+{
+    if (*len < cap) {
+        hs[*len] = score;
+        hj[*len] = j;
+        heap_sift_up(hs, hj, (*len)++);
+    } else if (better(score, j, hs[0], hj[0])) {
+        hs[0] = score;
+        hj[0] = j;
+        heap_sift_down(hs, hj, cap, 0);
+    }
+}
+
+/* empties the heap into out_j / out_s best first, padding up to cap;
+   popping the worst first fills the output from the back */
+static void heap_drain(double *hs, int *hj, int len, int cap, int *out_j, double *out_s)
+{
+    int j;
+    for (j = len; j < cap; j++) {
+        out_j[j] = -1;
+        out_s[j] = -HUGE_VAL;
+    }
+    while (len > 0) {
+        out_j[len-1] = hj[0];
+        out_s[len-1] = hs[0];
+        heap_swap(hs, hj, 0, --len);
+        heap_sift_down(hs, hj, len, 0);
+    }
+}
+
+int svd_recommend_top_n(const svd_model *M, int first, int count, int n, int batch, const mat_csr *rated, int *movies, double *scores)
+{
+    if (n < 1 || first < 0 || count < 0 || first + count > M->nusers)
+        return 1;
+    if (rated && (rated->nrows != M->nusers || rated->ncols != M->nmovies))
+        return 1;
+    if (batch <= 0)
+        batch = DEFAULT_BATCH;
+    batch = max(1, min(batch, count));
+    const int nm = M->nmovies;
+    const int nthreads = omp_get_max_threads();
+    double *S = (double*)malloc((size_t)nm * batch * sizeof(double));
+    // per thread: the heap, and movie stamps marking the current user's ratings
+    double *heap_s = (double*)malloc((size_t)nthreads * n * sizeof(double));
+    int *heap_j = (int*)malloc((size_t)nthreads * n * sizeof(int));
+    int *stamp = rated ? (int*)malloc((size_t)nthreads * max(nm, 1) * sizeof(int)) : NULL;
+    if (stamp) {
+        for (long long q = 0; q < (long long)nthreads * nm; q++)
+            stamp[q] = -1;
+    }
+
+    int b0;
+    for (b0 = first; b0 < first + count; b0 += batch) {
+        int bs = min(batch, first + count - b0);
+        // S(:, u) = V * US(b0+u, :)^T for the whole batch
+        cblas_dgemm(CblasColMajor, CblasNoTrans, CblasTrans, nm, bs, M->k, 1.0, M->V.d, nm,
+                    M->US.d + b0, M->nusers, 0.0, S, nm);
+        #pragma omp parallel num_threads(nthreads)
+        {
+            int t = omp_get_thread_num();
+            double *hs = heap_s + (long long)t * n;
+            int *hj = heap_j + (long long)t * n;
+            int *mark = stamp ? stamp + (long long)t * nm : NULL;
+            int u;
+            #pragma omp for schedule(static)
+            for (u = 0; u < bs; u++) {
+                const int user = b0 + u;
+                const double *su = S + (long long)u * nm;
+                int j, len = 0;
+                if (mark) {
+                    long long q;
+                    for (q = rated->pointerB[user]; q < rated->pointerE[user]; q++)
+                        mark[rated->cols[q-1] - 1] = user;
+                }
+                for (j = 0; j < nm; j++) {
+                    if (!mark || mark[j] != user)
+                        heap_offer(hs, hj, &len, n, su[j], j);
+                }
+                heap_drain(hs, hj, len, n, movies + (long long)(user - first) * n, scores + (long long)(user - first) * n);
+            }
+        }
+    }
+    free(S);
+    free(heap_s);
+    free(heap_j);
+    free(stamp);
+    return 0;
+}
+
+/* ---- item-item similarity index --------------------------------------- */
+
+#define INDEX_ALIGN 64
+#define KMEANS_ITERS 10
+
+static size_t index_elem_size(svd_index_precision p)
+{
+    return p == SVD_INDEX_DOUBLE ? sizeof(double) : p == SVD_INDEX_FLOAT ? sizeof(float) : 1;
+}
+
+/* row length in elements padded to whole 64-byte lines */
+static int index_ld(int k, size_t elem)
+{
+    return (int)(((size_t)k * elem + INDEX_ALIGN - 1) / INDEX_ALIGN * INDEX_ALIGN / elem);
+}
+
+static void * index_alloc(size_t bytes)
+{
+    void *p = NULL;
+    if (posix_memalign(&p, INDEX_ALIGN, bytes > 0 ? bytes : INDEX_ALIGN) != 0)
+        return NULL;
+    memset(p, 0, bytes); // the padding must be zero
+    return p;
+}
+
+static double dot_d(const double *a, const double *b, int ld)
+{
+    double s = 0;
+    int i;
+    #pragma omp simd aligned(a, b : INDEX_ALIGN) reduction(+:s)
+    for (i = 0; i < ld; i++)
+        s += a[i] * b[i];
+    return s;
+}
+
+static double dot_f(const float *a, const float *b, int ld)
+{
+    float s = 0;
+    int i;
+    #pragma omp simd aligned(a, b : INDEX_ALIGN) reduction(+:s)
+    for (i = 0; i < ld; i++)
+        s += a[i] * b[i];
+    return s;
+}
+
+static double dot_i8(const signed char *a, const signed char *b, int ld)
+{
+    int s = 0, i;
+    #pragma omp simd aligned(a, b : INDEX_ALIGN) reduction(+:s)
+    for (i = 0; i < ld; i++)
+        s += a[i] * b[i];
+    return s;
+}
+
+static double index_sim(const svd_item_index *ix, int a, int b)
+{
+    const int ld = ix->ld;
+    if (ix->precision == SVD_INDEX_DOUBLE)
+        return dot_d((const double*)ix->rows + (long long)a * ld, (const double*)ix->rows + (long long)b * ld, ld);
+    if (ix->precision == SVD_INDEX_FLOAT)
+        return dot_f((const float*)ix->rows + (long long)a * ld, (const float*)ix->rows + (long long)b * ld, ld);
+    return ix->scale[a] * ix->scale[b]
+        * dot_i8((const signed char*)ix->rows + (long long)a * ld, (const signed char*)ix->rows + (long long)b * ld, ld);
+}
+
+/* row i as floats into x (ldc long, the padding stays zero) */
+static void index_row_float(const svd_item_index *ix, int i, float *x)
+{
+    int j;
+    for (j = 0; j < ix->k; j++) {
+        if (ix->precision == SVD_INDEX_DOUBLE)
+            x[j] = (float)((const double*)ix->rows)[(long long)i * ix->ld + j];
+        else if (ix->precision == SVD_INDEX_FLOAT)
+            x[j] = ((const float*)ix->rows)[(long long)i * ix->ld + j];
+        else
+            x[j] = ix->scale[i] * ((const signed char*)ix->rows)[(long long)i * ix->ld + j];
+    }
+}
+
+static void normalize_f(float *x, int len)
+{
+    double nrm = sqrt(dot_f(x, x, len));
+    int j;
+    if (nrm > 0) {
+        for (j = 0; j < len; j++)
+            x[j] = (float)(x[j] / nrm);
+    }
+}
+
+/* spherical k-means of the normalized rows into nlists lists, seeded with
+   evenly spaced movies so that the index is deterministic */
+static void index_build_lists(svd_item_index *ix)
+{
+    const int nm = ix->nmovies, nl = ix->nlists, ldc = ix->ldc;
+    float *X = (float*)index_alloc((size_t)nm * ldc * sizeof(float));
+    float *sum = (float*)index_alloc((size_t)nl * ldc * sizeof(float));
+    int *assign = (int*)malloc(max(nm, 1) * sizeof(int));
+    int *count = (int*)calloc((size_t)nl + 1, sizeof(int));
+    int i, l, it;
+    #pragma omp parallel for schedule(static)
+    for (i = 0; i < nm; i++)
+        index_row_float(ix, i, X + (long long)i * ldc);
+    for (l = 0; l < nl; l++)
+        memcpy(ix->centroids + (long long)l * ldc, X + ((long long)l * nm / nl) * ldc, ldc * sizeof(float));
+
+    for (it = 0; it <= KMEANS_ITERS; it++) {
+        #pragma omp parallel for schedule(static) private(l)
+        for (i = 0; i < nm; i++) {
+            double best = -HUGE_VAL;
+            for (l = 0; l < nl; l++) {
+                double d = dot_f(X + (long long)i * ldc, ix->centroids + (long long)l * ldc, ldc);
+                if (d > best) {
+                    best = d;
+                    assign[i] = l;
+                }
+            }
+        }
+        if (it == KMEANS_ITERS)
+            break; // the last pass only assigns
+        memset(sum, 0, (size_t)nl * ldc * sizeof(float));
+        memset(count, 0, ((size_t)nl + 1) * sizeof(int));
+        for (i = 0; i < nm; i++) {
+            int j;
+            float *c = sum + (long long)assign[i] * ldc;
+            for (j = 0; j < ldc; j++)
+                c[j] += X[(long long)i * ldc + j];
+            count[assign[i]]++;
+        }
+        for (l = 0; l < nl; l++) {
+            if (count[l] == 0)
+                continue; // an empty list keeps its centroid
+            memcpy(ix->centroids + (long long)l * ldc, sum + (long long)l * ldc, ldc * sizeof(float));
+            normalize_f(ix->centroids + (long long)l * ldc, ldc);
+        }
+    }
+
+    // counting sort of the movies by list
+    memset(count, 0, ((size_t)nl + 1) * sizeof(int));
+    for (i = 0; i < nm; i++)
+        count[assign[i] + 1]++;
+    for (l = 0; l < nl; l++)
+        count[l + 1] += count[l];
+    memcpy(ix->list_start, count, ((size_t)nl + 1) * sizeof(int));
+    for (i = 0; i < nm; i++)
+        ix->list_movies[count[assign[i]]++] = i;
+    free(X);
+    free(sum);
+    free(assign);
+    free(count);
+}
+
+int svd_item_index_build(const mat *Vk, const double *s, svd_index_precision precision, int nlists, svd_item_index *ix)
+{
+    int i;
+    memset(ix, 0, sizeof(*ix));
+    if (Vk->ncols < 1 || nlists < 0 || nlists > Vk->nrows)
+        return 1;
+    const int nm = Vk->nrows, k = Vk->ncols;
+    const size_t elem = index_elem_size(precision);
+    ix->nmovies = nm;
+    ix->k = k;
+    ix->precision = precision;
+    ix->ld = index_ld(k, elem);
+    ix->rows = index_alloc((size_t)nm * ix->ld * elem);
+    if (precision == SVD_INDEX_INT8)
+        ix->scale = (float*)malloc(max(nm, 1) * sizeof(float));
+
+    #pragma omp parallel
+    {
+        double *v = (double*)malloc(k * sizeof(double));
+        int j;
+        #pragma omp for schedule(static)
+        for (i = 0; i < nm; i++) {
+            double nrm = 0, amax = 0;
+            for (j = 0; j < k; j++) {
+                v[j] = Vk->d[(long long)j * nm + i] * s[j];
+                nrm += v[j] * v[j];
+            }
+            nrm = nrm > 0 ? 1.0 / sqrt(nrm) : 0;
+            for (j = 0; j < k; j++) {
+                v[j] *= nrm;
+                amax = max(amax, fabs(v[j]));
+            }
+            if (precision == SVD_INDEX_DOUBLE) {
+                memcpy((double*)ix->rows + (long long)i * ix->ld, v, k * sizeof(double));
+            } else if (precision == SVD_INDEX_FLOAT) {
+                float *r = (float*)ix->rows + (long long)i * ix->ld;
+                for (j = 0; j < k; j++)
+                    r[j] = (float)v[j];
+            } else {
+                signed char *r = (signed char*)ix->rows + (long long)i * ix->ld;
+                ix->scale[i] = (float)(amax / 127.0);
+                for (j = 0; j < k; j++)
+                    r[j] = amax > 0 ? (signed char)lrint(v[j] * 127.0 / amax) : 0;
+            }
+        }
+        free(v);
+    }
+
+    if (nlists > 0) {
+        ix->nlists = nlists;
+        ix->ldc = index_ld(k, sizeof(float));
+        ix->centroids = (float*)index_alloc((size_t)nlists * ix->ldc * sizeof(float));
+        ix->list_start = (int*)malloc(((size_t)nlists + 1) * sizeof(int));
+        ix->list_movies = (int*)malloc(max(nm, 1) * sizeof(int));
+        index_build_lists(ix);
+    }
+    return 0;
+}
+
+void svd_item_index_free(svd_item_index *ix)
+{
+    free(ix->rows);
+    free(ix->scale);
+    free(ix->centroids);
+    free(ix->list_start);
+    free(ix->list_movies);
+    memset(ix, 0, sizeof(*ix));
+}
+
+int svd_item_index_query(const svd_item_index *ix, const int *queries, int nq, int K, int nprobe, int *neighbours, double *sims)
+{
+    int i;
+    if (K < 1 || nq < 0)
+        return 1;
+    for (i = 0; i < nq; i++) {
+        if (queries[i] < 0 || queries[i] >= ix->nmovies)
+            return 1;
+    }
+    const int lists = ix->nlists > 0 && nprobe > 0 && nprobe < ix->nlists;
+    #pragma omp parallel
+    {
+        double *hs = (double*)malloc(K * sizeof(double));
+        int *hj = (int*)malloc(K * sizeof(int));
+        // the probe heap and the query row for the centroid distances
+        double *ps = lists ? (double*)malloc(nprobe * sizeof(double)) : NULL;
+        int *pj = lists ? (int*)malloc(nprobe * sizeof(int)) : NULL;
+        float *x = lists ? (float*)index_alloc((size_t)ix->ldc * sizeof(float)) : NULL;
+        int qi;
+        #pragma omp for schedule(dynamic, 16)
+        for (qi = 0; qi < nq; qi++) {
+            const int q = queries[qi];
+            int len = 0, j, l;
+            if (!lists) {
+                for (j = 0; j < ix->nmovies; j++) {
+                    if (j != q)
+                        heap_offer(hs, hj, &len, K, index_sim(ix, q, j), j);
+                }
+            } else {
+                int plen = 0;
+                index_row_float(ix, q, x);
+                for (l = 0; l < ix->nlists; l++)
+                    heap_offer(ps, pj, &plen, nprobe, dot_f(x, ix->centroids + (long long)l * ix->ldc, ix->ldc), l);
+                for (l = 0; l < plen; l++) {
+                    int e;
+                    for (e = ix->list_start[pj[l]]; e < ix->list_start[pj[l] + 1]; e++) {
+                        j = ix->list_movies[e];
+                        if (j != q)
+                            heap_offer(hs, hj, &len, K, index_sim(ix, q, j), j);
+                    }
+                }
+            }
+            heap_drain(hs, hj, len, K, neighbours + (long long)qi * K, sims + (long long)qi * K);
+        }
+        free(hs);
+        free(hj);
+        free(ps);
+        free(pj);
+        free(x);
+    }
+    return 0;
+}
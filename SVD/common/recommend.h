@@ -0,0 +1,77 @@
+#pragma once
+
+#include "matrix_io.h"
+
+/* Top-N recommendation from the truncated SVD A ~ Uk*Sk*Vk^T of a rating
+   matrix (users x movies), as written by the drivers to
+   svd_mpi_results.dat: for Uk, Sk and Vk in turn two ints (nrows, ncols)
+   followed by the column-major doubles.
+
+   The score of movie j for user u is (Uk*Sk)(u,:) . Vk(j,:). Users are
+   scored in batches: one cblas_dgemm gives the nmovies x batch score block,
+   and every thread then keeps the N best movies of its users with a
+   size-N min-heap, so movies are never sorted. */
+
+typedef struct {
+    int nusers, nmovies, k;
+    mat US;          // nusers x k, Uk with column j scaled by s_j (owned)
+    mat V;           // nmovies x k, Vk inside the mapping
+    const double *s; // the k singular values, inside the mapping
+    mapped_file file;
+} svd_model;
+
+/* maps a results file and scales Uk by Sk; returns 0 on success, nonzero on
+   error (unreadable, truncated, inconsistent shapes) */
+int svd_model_load(const char *filename, svd_model *M);
+
+void svd_model_free(svd_model *M);
+
+/* Top n movies of users first .. first+count-1, best first (ties go to the
+   lower movie id): user first+i gets movies[i*n .. i*n+n-1] (0-based) and
+   their scores. batch users share one GEMM (0: 4096). If rated is not NULL
+   (a users x movies CSR of the ratings, 1-based as usual) the movies a
+   user already rated are skipped; slots left without a candidate get movie
+   -1 and score -HUGE_VAL. Returns 0, or 1 for arguments out of range. */
+int svd_recommend_top_n(const svd_model *M, int first, int count, int n, int batch, const mat_csr *rated, int *movies, double *scores);
+
+/* Item-item similarity: the cosine between rows of Vk*Sk, i.e. between
+   movies in the latent space weighted by the singular values. The rows are
+   normalized once and stored row-major, each one padded to a multiple of
+   64 bytes and 64-byte aligned so that the dot products run as full-width
+   omp simd loops, in double, float or int8 (one scale per row, about 1%
+   error on a similarity).
+   With nlists > 0 the index is also an inverted file: spherical k-means
+   groups the movies into nlists lists, and a query scans only the movies
+   of the nprobe lists whose centroids are closest to it, instead of the
+   whole catalog. */
+typedef enum {
+    SVD_INDEX_DOUBLE,
+    SVD_INDEX_FLOAT,
+    SVD_INDEX_INT8
+} svd_index_precision;
+
+typedef struct {
+    int nmovies, k, ld;          // ld: padded row length in elements
+    svd_index_precision precision;
+    void *rows;                  // nmovies x ld, row-major, normalized
+    float *scale;                // int8: per-row factor back to the normalized row
+    int nlists, ldc;             // 0 lists: exact search only
+    float *centroids;            // nlists x ldc, normalized
+    int *list_start;             // nlists+1 offsets into list_movies
+    int *list_movies;            // movies grouped by list
+} svd_item_index;
+
+/* builds the index of the rows of Vk (nmovies x k) scaled by s; returns 0,
+   or 1 for arguments out of range */
+int svd_item_index_build(const mat *Vk, const double *s, svd_index_precision precision, int nlists, svd_item_index *ix);
+
+void svd_item_index_free(svd_item_index *ix);
+
+/* The K most similar movies of each of the nq query movies (the query
+   itself excluded), best first with ties to the lower id:
+   neighbours[i*K .. i*K+K-1] and sims likewise, padded with -1 /
+   -HUGE_VAL. nprobe lists are scanned per query (ignored without lists,
+   all lists if nprobe <= 0 or >= nlists, which is exact). Queries run in
+   parallel, one thread per query. Returns 0, or 1 for arguments out of
+   range. */
+int svd_item_index_query(const svd_item_index *ix, const int *queries, int nq, int K, int nprobe, int *neighbours, double *sims);
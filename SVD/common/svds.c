@@ -1,1028 +1,2232 @@
-#include <stdio.h>
-#include <lapacke.h>
-#include <cblas.h>
-#include <stdlib.h>
-#include <time.h>
-#include "svds.h"
-#include "omp.h"
-
-void x_minus_VVTx(mat *V, vec *x, vec *xt)
-{
-    matrix_transpose_vector_mult(V, x, xt);
-    double alpha, beta;
-    alpha = -1.0;
-    beta = 1.0;
-    cblas_dgemv(CblasColMajor, CblasNoTrans, V->nrows, V->ncols, alpha, V->d, V->nrows, xt->d, 1, beta, x->d, 1);
-}
-
-void matrix_set_colm(mat* M, long long j, vec *column_vec)
-{
-    int i;
-    #pragma omp parallel shared(column_vec,M,j) private(i)
-    {
-    #pragma omp for
-    for(i = 0; i < M->nrows; ++i)
-        M->d[j*M->nrows+i] = column_vec->d[i];
-    }
-}
-
-void vector_scale_d(vec *v, double scalar)
-{
-    int i;
-    #pragma omp parallel shared(v,scalar) private(i) 
-    {
-    #pragma omp for
-    for(i=0; i<(v->nrows); i++)
-        v->d[i] = (v->d[i])/scalar;
-    }
-}
-
-void svds_C_dense(mat *A, mat **Uk, mat **Sk, mat **Vk, int k)
-{
-    const double eps = 1e-10;
-    const int b = max(3*k, 15);
-    const int maxiter = 10;
-    mat *U = matrix_new(A->nrows, b);
-    mat *V = matrix_new(A->ncols, b);
-    double alpha[b+1];
-    double beta[b+1];
-    vec *vt = vector_new(A->ncols);
-    initialize_random_vector(vt);
-    double nv = cblas_dnrm2(A->ncols, vt->d, 1);
-    vector_scale_d(vt, nv);
-    int i;
-    vec *ut = vector_new(A->nrows);
-    vec *utb = vector_new(A->nrows);
-    vec *vtb = vector_new(A->ncols);
-    vec *bt = vector_new(b);
-    double ai, bi, ntol;
-    matrix_set_colm(V, 0, vt);
-    double sk_last=-1;
-    mat *B_now;
-    mat *UB;
-    mat *SB;
-    mat *VB;
-    for(i = 0; i < b; ++i)
-    { 	
-        vector_copy(utb, ut);
-        vector_copy(vtb, vt);
-        matrix_vector_mult(A, vt, ut);
-        if (i == 0)
-        {
-            ai = cblas_dnrm2(ut->nrows, ut->d, 1);
-            alpha[i] = ai;
-            vector_scale_d(ut, ai);
-            matrix_set_colm(U, i, ut);
-            matrix_transpose_vector_mult(A, ut, vt);
-            cblas_daxpy(vt->nrows, -ai, vtb->d, 1, vt->d, 1);
-            ntol = vector_dot_product(vt, vtb);
-            {
-                bt->nrows = i+1;
-                V->ncols = i+1;
-                x_minus_VVTx(V, vt, bt);
-            }
-            V->ncols++;
-            bi = cblas_dnrm2(vt->nrows, vt->d, 1);
-            beta[i] = bi;
-            vector_scale_d(vt, bi);
-            matrix_set_colm(V, i+1, vt);
-        }
-        else
-        {
-            cblas_daxpy(A->nrows, -bi, utb->d, 1, ut->d, 1);
-            ntol = vector_dot_product(ut, utb);
-            {
-                bt->nrows = i;
-                U->ncols = i;
-                x_minus_VVTx(U, ut, bt);
-            }
-            U->ncols++;
-            ai = cblas_dnrm2(ut->nrows, ut->d, 1);
-            alpha[i] = ai;
-            vector_scale_d(ut, ai);
-            matrix_set_colm(U, i, ut);
-            matrix_transpose_vector_mult(A, ut, vt);
-            cblas_daxpy(A->ncols, -ai, vtb->d, 1, vt->d, 1);
-            ntol = vector_dot_product(vt, vtb);
-            {
-                bt->nrows = i+1;
-                V->ncols = i+1;
-                x_minus_VVTx(V, vt, bt);
-            }
-            V->ncols++;
-            bi = cblas_dnrm2(vt->nrows, vt->d, 1);
-            beta[i] = bi;
-            if (i==b-1)
-                break;
-            vector_scale_d(vt, bi);
-            matrix_set_colm(V, i+1, vt);
-        }
-    }
-    int flag = 0;
-    double gamma[k];
-    B_now = matrix_new(b, b);
-    int j;
-    for(j=0;j<b-1;j++)
-    {
-        matrix_set_element(B_now, j, j, alpha[j]);
-        matrix_set_element(B_now, j, j+1, beta[j]);
-    }
-    matrix_set_element(B_now, b-1, b-1, alpha[b-1]);
-    UB = matrix_new(b, b);
-    SB = matrix_new(b, b);
-    VB = matrix_new(b, b);
-    singular_value_decomposition(B_now, UB, SB, VB);
-    for(i=0;i<k;i++)
-    {
-        gamma[i] = beta[b-1]*matrix_get_element(UB, b-1, i);
-        double gi = gamma[i];
-        if(gi < 0) gi = -gi;
-        flag += (gi < eps*matrix_get_element(SB, i, i));
-    }
-    U->ncols = b;
-    V->ncols = b;
-    bt->nrows = b;
-    int inds[k];
-    (*Sk) = matrix_new(k, 1);
-    for(i=0;i<b;i++)
-    {
-        alpha[i] = 0;
-        beta[i] = 0;
-    }
-    for(i=0;i<k;i++)
-    {
-        inds[i] = i;
-        (*Sk)->d[i] = matrix_get_element(SB, i, i);
-        alpha[i] = matrix_get_element(SB, i, i);
-        beta[i] = 0;
-    }
-    mat* UBk = matrix_new(b, k);
-    mat* VBt = matrix_new(b, b);
-    matrix_build_transpose(VBt, VB);
-    mat* VBk = matrix_new(b, k);
-    matrix_get_selected_columns(UB, inds, UBk);
-    matrix_get_selected_columns(VBt, inds, VBk);
-    (*Uk) = matrix_new(A->nrows, k);
-    matrix_matrix_mult(U, UBk, *Uk);
-    (*Vk) = matrix_new(A->ncols, k);
-    matrix_matrix_mult(V, VBk, *Vk);
-    int iters = 1;
-    
-    while(iters < maxiter)
-    {
-        if(flag==k)
-            break;
-        V->ncols = k;
-        U->ncols = k;
-        matrix_copy(V, *Vk);
-        matrix_copy(U, *Uk);
-        nv = 0;
-        nv = cblas_dnrm2(A->ncols, vt->d, 1);
-        vector_scale_d(vt, nv);
-        V->ncols++;
-        matrix_set_colm(V, k, vt);
-
-        matrix_vector_mult(A, vt, ut);
-        bt->nrows = k;
-        x_minus_VVTx(U, ut, bt);
-        U->ncols++;
-        ai = cblas_dnrm2(ut->nrows, ut->d, 1);
-        alpha[k] = ai;
-        vector_scale_d(ut, ai);
-        matrix_set_colm(U, k, ut);
-
-        vector_copy(vtb, vt);
-        matrix_transpose_vector_mult(A, ut, vt);
-        cblas_daxpy(A->ncols, -ai, vtb->d, 1, vt->d, 1);
-        bt->nrows = k+1;
-        x_minus_VVTx(V, vt, bt);
-        V->ncols++;
-        bi = cblas_dnrm2(vt->nrows, vt->d, 1);
-        beta[k] = bi;
-        vector_scale_d(vt, bi);
-        matrix_set_colm(V, k+1, vt);
-        for(i = k+1; i < b; ++i)
-        { 	
-            vector_copy(utb, ut);
-            vector_copy(vtb, vt);
-            matrix_vector_mult(A, vt, ut);
-            cblas_daxpy(A->nrows, -bi, utb->d, 1, ut->d, 1);
-            {
-                bt->nrows = i;
-                x_minus_VVTx(U, ut, bt);
-            }
-            U->ncols++;
-            ai = cblas_dnrm2(ut->nrows, ut->d, 1);
-            alpha[i] = ai;
-            vector_scale_d(ut, ai);
-            matrix_set_colm(U, i, ut);
-            matrix_transpose_vector_mult(A, ut, vt);
-            cblas_daxpy(A->ncols, -ai, vtb->d, 1, vt->d, 1);
-            {
-                bt->nrows = i+1;
-                x_minus_VVTx(V, vt, bt);
-            }
-            V->ncols++;
-            bi = cblas_dnrm2(vt->nrows, vt->d, 1);
-            beta[i] = bi;
-            if (i==b-1)
-                break;
-            vector_scale_d(vt, bi);
-            matrix_set_colm(V, i+1, vt);
-        }
-        matrix_delete(B_now);
-        B_now = matrix_new(b, b);
-        for(j=0;j<k;j++)
-        {
-            matrix_set_element(B_now, j, j, alpha[j]);
-            matrix_set_element(B_now, j, k, gamma[j]);
-        }
-        for(j=k;j<b-1;j++)
-        {
-            matrix_set_element(B_now, j, j, alpha[j]);
-            matrix_set_element(B_now, j, j+1, beta[j]);
-        }
-        matrix_set_element(B_now, b-1, b-1, alpha[b-1]);
-        singular_value_decomposition(B_now, UB, SB, VB);
-        flag = 0;
-        for(i=0;i<k;i++)
-        {
-            gamma[i] = beta[b-1]*matrix_get_element(UB, b-1, i);
-            double gi = gamma[i];
-            if(gi < 0) gi = -gi;
-            flag += (gi < eps * matrix_get_element(SB, i, i));
-        }
-        U->ncols = b;
-        V->ncols = b;
-        bt->nrows = b;
-        for(i=0;i<k;i++)
-        {
-            inds[i] = i;
-            (*Sk)->d[i] = matrix_get_element(SB, i, i);
-            alpha[i] = matrix_get_element(SB, i, i);
-            beta[i] = 0;
-        }
-        matrix_build_transpose(VBt, VB);
-        matrix_get_selected_columns(UB, inds, UBk);
-        matrix_get_selected_columns(VBt, inds, VBk);
-        matrix_matrix_mult(U, UBk, *Uk);
-        matrix_matrix_mult(V, VBk, *Vk);
-        iters++;
-    }
-    
-    matrix_delete(B_now);
-    matrix_delete(SB);
-    matrix_delete(VB);
-    matrix_delete(UB);
-    matrix_delete(VBt);
-    matrix_delete(U);
-    matrix_delete(UBk);
-    matrix_delete(V);
-    matrix_delete(VBk);
-    vector_delete(bt);
-    vector_delete(ut);
-    vector_delete(utb);
-    vector_delete(vt);
-    vector_delete(vtb);
-}
-
-void svds_C_dense_opt(mat *A, mat **Uk, mat **Sk, mat **Vk, int k, double eps, int maxbasis, int maxiter)
-{
-    const int b = maxbasis;
-    mat *U = matrix_new(A->nrows, b);
-    mat *V = matrix_new(A->ncols, b);
-    double alpha[b+1];
-    double beta[b+1];
-    vec *vt = vector_new(A->ncols);
-    initialize_random_vector(vt);
-    double nv = cblas_dnrm2(A->ncols, vt->d, 1);
-    vector_scale_d(vt, nv);
-    int i;
-    vec *ut = vector_new(A->nrows);
-    vec *utb = vector_new(A->nrows);
-    vec *vtb = vector_new(A->ncols);
-    vec *bt = vector_new(b);
-    double ai, bi, ntol;
-    matrix_set_colm(V, 0, vt);
-    double sk_last=-1;
-    mat *B_now;
-    mat *UB;
-    mat *SB;
-    mat *VB;
-    for(i = 0; i < b; ++i)
-    { 	
-        vector_copy(utb, ut);
-        vector_copy(vtb, vt);
-        matrix_vector_mult(A, vt, ut);
-        if (i == 0)
-        {
-            ai = cblas_dnrm2(ut->nrows, ut->d, 1);
-            alpha[i] = ai;
-            vector_scale_d(ut, ai);
-            matrix_set_colm(U, i, ut);
-            matrix_transpose_vector_mult(A, ut, vt);
-            cblas_daxpy(vt->nrows, -ai, vtb->d, 1, vt->d, 1);
-            ntol = vector_dot_product(vt, vtb);
-            {
-                bt->nrows = i+1;
-                V->ncols = i+1;
-                x_minus_VVTx(V, vt, bt);
-            }
-            V->ncols++;
-            bi = cblas_dnrm2(vt->nrows, vt->d, 1);
-            beta[i] = bi;
-            vector_scale_d(vt, bi);
-            matrix_set_colm(V, i+1, vt);
-        }
-        else
-        {
-            cblas_daxpy(A->nrows, -bi, utb->d, 1, ut->d, 1);
-            ntol = vector_dot_product(ut, utb);
-            {
-                bt->nrows = i;
-                U->ncols = i;
-                x_minus_VVTx(U, ut, bt);
-            }
-            U->ncols++;
-            ai = cblas_dnrm2(ut->nrows, ut->d, 1);
-            alpha[i] = ai;
-            vector_scale_d(ut, ai);
-            matrix_set_colm(U, i, ut);
-            matrix_transpose_vector_mult(A, ut, vt);
-            cblas_daxpy(A->ncols, -ai, vtb->d, 1, vt->d, 1);
-            ntol = vector_dot_product(vt, vtb);
-            {
-                bt->nrows = i+1;
-                V->ncols = i+1;
-                x_minus_VVTx(V, vt, bt);
-            }
-            V->ncols++;
-            bi = cblas_dnrm2(vt->nrows, vt->d, 1);
-            beta[i] = bi;
-            if (i==b-1)
-                break;
-            vector_scale_d(vt, bi);
-            matrix_set_colm(V, i+1, vt);
-        }
-    }
-    int flag = 0;
-    double gamma[k];
-    B_now = matrix_new(b, b);
-    int j;
-    for(j=0;j<b-1;j++)
-    {
-        matrix_set_element(B_now, j, j, alpha[j]);
-        matrix_set_element(B_now, j, j+1, beta[j]);
-    }
-    matrix_set_element(B_now, b-1, b-1, alpha[b-1]);
-    UB = matrix_new(b, b);
-    SB = matrix_new(b, b);
-    VB = matrix_new(b, b);
-    singular_value_decomposition(B_now, UB, SB, VB);
-    for(i=0;i<k;i++)
-    {
-        gamma[i] = beta[b-1]*matrix_get_element(UB, b-1, i);
-        double gi = gamma[i];
-        if(gi < 0) gi = -gi;
-        flag += (gi < eps*matrix_get_element(SB, i, i));
-    }
-    U->ncols = b;
-    V->ncols = b;
-    bt->nrows = b;
-    int inds[k];
-    (*Sk) = matrix_new(k, 1);
-    for(i=0;i<b;i++)
-    {
-        alpha[i] = 0;
-        beta[i] = 0;
-    }
-    for(i=0;i<k;i++)
-    {
-        inds[i] = i;
-        (*Sk)->d[i] = matrix_get_element(SB, i, i);
-        alpha[i] = matrix_get_element(SB, i, i);
-        beta[i] = 0;
-    }
-    mat* UBk = matrix_new(b, k);
-    mat* VBt = matrix_new(b, b);
-    matrix_build_transpose(VBt, VB);
-    mat* VBk = matrix_new(b, k);
-    matrix_get_selected_columns(UB, inds, UBk);
-    matrix_get_selected_columns(VBt, inds, VBk);
-    (*Uk) = matrix_new(A->nrows, k);
-    matrix_matrix_mult(U, UBk, *Uk);
-    (*Vk) = matrix_new(A->ncols, k);
-    matrix_matrix_mult(V, VBk, *Vk);
-    int iters = 1;
-    
-    while(iters < maxiter)
-    {
-        if(flag==k)
-            break;
-        V->ncols = k;
-        U->ncols = k;
-        matrix_copy(V, *Vk);
-        matrix_copy(U, *Uk);
-        nv = 0;
-        nv = cblas_dnrm2(A->ncols, vt->d, 1);
-        vector_scale_d(vt, nv);
-        V->ncols++;
-        matrix_set_colm(V, k, vt);
-
-        matrix_vector_mult(A, vt, ut);
-        bt->nrows = k;
-        x_minus_VVTx(U, ut, bt);
-        U->ncols++;
-        ai = cblas_dnrm2(ut->nrows, ut->d, 1);
-        alpha[k] = ai;
-        vector_scale_d(ut, ai);
-        matrix_set_colm(U, k, ut);
-
-        vector_copy(vtb, vt);
-        matrix_transpose_vector_mult(A, ut, vt);
-        cblas_daxpy(A->ncols, -ai, vtb->d, 1, vt->d, 1);
-        bt->nrows = k+1;
-        x_minus_VVTx(V, vt, bt);
-        V->ncols++;
-        bi = cblas_dnrm2(vt->nrows, vt->d, 1);
-        beta[k] = bi;
-        vector_scale_d(vt, bi);
-        matrix_set_colm(V, k+1, vt);
-        for(i = k+1; i < b; ++i)
-        { 	
-            vector_copy(utb, ut);
-            vector_copy(vtb, vt);
-            matrix_vector_mult(A, vt, ut);
-            cblas_daxpy(A->nrows, -bi, utb->d, 1, ut->d, 1);
-            {
-                bt->nrows = i;
-                x_minus_VVTx(U, ut, bt);
-            }
-            U->ncols++;
-            ai = cblas_dnrm2(ut->nrows, ut->d, 1);
-            alpha[i] = ai;
-            vector_scale_d(ut, ai);
-            matrix_set_colm(U, i, ut);
-            matrix_transpose_vector_mult(A, ut, vt);
-            cblas_daxpy(A->ncols, -ai, vtb->d, 1, vt->d, 1);
-            {
-                bt->nrows = i+1;
-                x_minus_VVTx(V, vt, bt);
-            }
-            V->ncols++;
-            bi = cblas_dnrm2(vt->nrows, vt->d, 1);
-            beta[i] = bi;
-            if (i==b-1)
-                break;
-            vector_scale_d(vt, bi);
-            matrix_set_colm(V, i+1, vt);
-        }
-        matrix_delete(B_now);
-        B_now = matrix_new(b, b);
-        for(j=0;j<k;j++)
-        {
-            matrix_set_element(B_now, j, j, alpha[j]);
-            matrix_set_element(B_now, j, k, gamma[j]);
-        }
-        for(j=k;j<b-1;j++)
-        {
-            matrix_set_element(B_now, j, j, alpha[j]);
-            matrix_set_element(B_now, j, j+1, beta[j]);
-        }
-        matrix_set_element(B_now, b-1, b-1, alpha[b-1]);
-        singular_value_decomposition(B_now, UB, SB, VB);
-        flag = 0;
-        for(i=0;i<k;i++)
-        {
-            gamma[i] = beta[b-1]*matrix_get_element(UB, b-1, i);
-            double gi = gamma[i];
-            if(gi < 0) gi = -gi;
-            flag += (gi < eps * matrix_get_element(SB, i, i));
-        }
-        U->ncols = b;
-        V->ncols = b;
-        bt->nrows = b;
-        for(i=0;i<k;i++)
-        {
-            inds[i] = i;
-            (*Sk)->d[i] = matrix_get_element(SB, i, i);
-            alpha[i] = matrix_get_element(SB, i, i);
-            beta[i] = 0;
-        }
-        matrix_build_transpose(VBt, VB);
-        matrix_get_selected_columns(UB, inds, UBk);
-        matrix_get_selected_columns(VBt, inds, VBk);
-        matrix_matrix_mult(U, UBk, *Uk);
-        matrix_matrix_mult(V, VBk, *Vk);
-        iters++;
-    }
-    
-    matrix_delete(B_now);
-    matrix_delete(SB);
-    matrix_delete(VB);
-    matrix_delete(UB);
-    matrix_delete(VBt);
-    matrix_delete(U);
-    matrix_delete(UBk);
-    matrix_delete(V);
-    matrix_delete(VBk);
-    vector_delete(bt);
-    vector_delete(ut);
-    vector_delete(utb);
-    vector_delete(vt);
-    vector_delete(vtb);
-}
-
-void svds_C(mat_csr *A, mat **Uk, mat **Sk, mat **Vk, int k)
-{
-    const double eps = 1e-10;
-    const int b = max(3*k, 15);
-    const int maxiter = 10;
-    mat *U = matrix_new(A->nrows, b);
-    mat *V = matrix_new(A->ncols, b);
-    double alpha[b+1];
-    double beta[b+1];
-    vec *vt = vector_new(A->ncols);
-    initialize_random_vector(vt);
-    double nv = cblas_dnrm2(A->ncols, vt->d, 1);
-    vector_scale_d(vt, nv);
-    int i;
-    vec *ut = vector_new(A->nrows);
-    vec *utb = vector_new(A->nrows);
-    vec *vtb = vector_new(A->ncols);
-    vec *bt = vector_new(b);
-    double ai, bi, ntol;
-    matrix_set_colm(V, 0, vt);
-    double sk_last=-1;
-    mat *B_now;
-    mat *UB;
-    mat *SB;
-    mat *VB;
-    for(i = 0; i < b; ++i)
-    { 	
-        vector_copy(utb, ut);
-        vector_copy(vtb, vt);
-        csr_matrix_vector_mult(A, vt, ut);
-        if (i == 0)
-        {
-            ai = cblas_dnrm2(ut->nrows, ut->d, 1);
-            alpha[i] = ai;
-            vector_scale_d(ut, ai);
-            matrix_set_colm(U, i, ut);
-            csr_matrix_transpose_vector_mult(A, ut, vt);
-            cblas_daxpy(vt->nrows, -ai, vtb->d, 1, vt->d, 1);
-            ntol = vector_dot_product(vt, vtb);
-            {
-                bt->nrows = i+1;
-                V->ncols = i+1;
-                x_minus_VVTx(V, vt, bt);
-            }
-            V->ncols++;
-            bi = cblas_dnrm2(vt->nrows, vt->d, 1);
-            beta[i] = bi;
-            vector_scale_d(vt, bi);
-            matrix_set_colm(V, i+1, vt);
-        }
-        else
-        {
-            cblas_daxpy(A->nrows, -bi, utb->d, 1, ut->d, 1);
-            ntol = vector_dot_product(ut, utb);
-            {
-                bt->nrows = i;
-                U->ncols = i;
-                x_minus_VVTx(U, ut, bt);
-            }
-            U->ncols++;
-            ai = cblas_dnrm2(ut->nrows, ut->d, 1);
-            alpha[i] = ai;
-            vector_scale_d(ut, ai);
-            matrix_set_colm(U, i, ut);
-            csr_matrix_transpose_vector_mult(A, ut, vt);
-            cblas_daxpy(A->ncols, -ai, vtb->d, 1, vt->d, 1);
-            ntol = vector_dot_product(vt, vtb);
-            {
-                bt->nrows = i+1;
-                V->ncols = i+1;
-                x_minus_VVTx(V, vt, bt);
-            }
-            V->ncols++;
-            bi = cblas_dnrm2(vt->nrows, vt->d, 1);
-            beta[i] = bi;
-            if (i==b-1)
-                break;
-            vector_scale_d(vt, bi);
-            matrix_set_colm(V, i+1, vt);
-        }
-    }
-    int flag = 0;
-    double gamma[k];
-    B_now = matrix_new(b, b);
-    int j;
-    for(j=0;j<b-1;j++)
-    {
-        matrix_set_element(B_now, j, j, alpha[j]);
-        matrix_set_element(B_now, j, j+1, beta[j]);
-    }
-    matrix_set_element(B_now, b-1, b-1, alpha[b-1]);
-    UB = matrix_new(b, b);
-    SB = matrix_new(b, b);
-    VB = matrix_new(b, b);
-    singular_value_decomposition(B_now, UB, SB, VB);
-    for(i=0;i<k;i++)
-    {
-        gamma[i] = beta[b-1]*matrix_get_element(UB, b-1, i);
-        double gi = gamma[i];
-        if(gi < 0) gi = -gi;
-        flag += (gi < eps*matrix_get_element(SB, i, i));
-    }
-    U->ncols = b;
-    V->ncols = b;
-    bt->nrows = b;
-    int inds[k];
-    (*Sk) = matrix_new(k, 1);
-    for(i=0;i<b;i++)
-    {
-        alpha[i] = 0;
-        beta[i] = 0;
-    }
-    for(i=0;i<k;i++)
-    {
-        inds[i] = i;
-        (*Sk)->d[i] = matrix_get_element(SB, i, i);
-        alpha[i] = matrix_get_element(SB, i, i);
-        beta[i] = 0;
-    }
-    mat* UBk = matrix_new(b, k);
-    mat* VBt = matrix_new(b, b);
-    matrix_build_transpose(VBt, VB);
-    mat* VBk = matrix_new(b, k);
-    matrix_get_selected_columns(UB, inds, UBk);
-    matrix_get_selected_columns(VBt, inds, VBk);
-    (*Uk) = matrix_new(A->nrows, k);
-    matrix_matrix_mult(U, UBk, *Uk);
-    (*Vk) = matrix_new(A->ncols, k);
-    matrix_matrix_mult(V, VBk, *Vk);
-    int iters = 1;
-    while(iters < maxiter)
-    {
-        if(flag==k)
-            break;
-        V->ncols = k;
-        U->ncols = k;
-        matrix_copy(V, *Vk);
-        matrix_copy(U, *Uk);
-        nv = 0;
-        nv = cblas_dnrm2(A->ncols, vt->d, 1);
-        vector_scale_d(vt, nv);
-        V->ncols++;
-        matrix_set_colm(V, k, vt);
-
-        csr_matrix_vector_mult(A, vt, ut);
-        bt->nrows = k;
-        x_minus_VVTx(U, ut, bt);
-        U->ncols++;
-        ai = cblas_dnrm2(ut->nrows, ut->d, 1);
-        alpha[k] = ai;
-        vector_scale_d(ut, ai);
-        matrix_set_colm(U, k, ut);
-
-        vector_copy(vtb, vt);
-        csr_matrix_transpose_vector_mult(A, ut, vt);
-        cblas_daxpy(A->ncols, -ai, vtb->d, 1, vt->d, 1);
-        bt->nrows = k+1;
-        x_minus_VVTx(V, vt, bt);
-        V->ncols++;
-        bi = cblas_dnrm2(vt->nrows, vt->d, 1);
-        beta[k] = bi;
-        vector_scale_d(vt, bi);
-        matrix_set_colm(V, k+1, vt);
-        for(i = k+1; i < b; ++i)
-        { 	
-            vector_copy(utb, ut);
-            vector_copy(vtb, vt);
-            csr_matrix_vector_mult(A, vt, ut);
-            cblas_daxpy(A->nrows, -bi, utb->d, 1, ut->d, 1);
-            {
-                bt->nrows = i;
-                x_minus_VVTx(U, ut, bt);
-            }
-            U->ncols++;
-            ai = cblas_dnrm2(ut->nrows, ut->d, 1);
-            alpha[i] = ai;
-            vector_scale_d(ut, ai);
-            matrix_set_colm(U, i, ut);
-            csr_matrix_transpose_vector_mult(A, ut, vt);
-            cblas_daxpy(A->ncols, -ai, vtb->d, 1, vt->d, 1);
-            {
-                bt->nrows = i+1;
-                x_minus_VVTx(V, vt, bt);
-            }
-            V->ncols++;
-            bi = cblas_dnrm2(vt->nrows, vt->d, 1);
-            beta[i] = bi;
-            if (i==b-1)
-                break;
-            vector_scale_d(vt, bi);
-            matrix_set_colm(V, i+1, vt);
-        }
-        matrix_delete(B_now);
-        B_now = matrix_new(b, b);
-        for(j=0;j<k;j++)
-        {
-            matrix_set_element(B_now, j, j, alpha[j]);
-            matrix_set_element(B_now, j, k, gamma[j]);
-        }
-        for(j=k;j<b-1;j++)
-        {
-            matrix_set_element(B_now, j, j, alpha[j]);
-            matrix_set_element(B_now, j, j+1, beta[j]);
-        }
-        matrix_set_element(B_now, b-1, b-1, alpha[b-1]);
-        singular_value_decomposition(B_now, UB, SB, VB);
-        flag = 0;
-        for(i=0;i<k;i++)
-        {
-            gamma[i] = beta[b-1]*matrix_get_element(UB, b-1, i);
-            double gi = gamma[i];
-            if(gi < 0) gi = -gi;
-            flag += (gi < eps * matrix_get_element(SB, i, i));
-        }
-        U->ncols = b;
-        V->ncols = b;
-        bt->nrows = b;
-        for(i=0;i<k;i++)
-        {
-            inds[i] = i;
-            (*Sk)->d[i] = matrix_get_element(SB, i, i);
-            alpha[i] = matrix_get_element(SB, i, i);
-            beta[i] = 0;
-        }
-        matrix_build_transpose(VBt, VB);
-        matrix_get_selected_columns(UB, inds, UBk);
-        matrix_get_selected_columns(VBt, inds, VBk);
-        matrix_matrix_mult(U, UBk, *Uk);
-        matrix_matrix_mult(V, VBk, *Vk);
-        iters++;
-    }
-    
-    matrix_delete(B_now);
-    matrix_delete(SB);
-    matrix_delete(VB);
-    matrix_delete(UB);
-    matrix_delete(VBt);
-    matrix_delete(U);
-    matrix_delete(UBk);
-    matrix_delete(V);
-    matrix_delete(VBk);
-    vector_delete(bt);
-    vector_delete(ut);
-    vector_delete(utb);
-    vector_delete(vt);
-    vector_delete(vtb);
-}
-
-void svds_C_opt(mat_csr *A, mat **Uk, mat **Sk, mat **Vk, int k, double eps, int maxbasis, int maxiter)
-{
-    const int b = maxbasis;
-    mat *U = matrix_new(A->nrows, b);
-    mat *V = matrix_new(A->ncols, b);
-    double alpha[b+1];
-    double beta[b+1];
-    vec *vt = vector_new(A->ncols);
-    initialize_random_vector(vt);
-    double nv = cblas_dnrm2(A->ncols, vt->d, 1);
-    vector_scale_d(vt, nv);
-    int i;
-    vec *ut = vector_new(A->nrows);
-    vec *utb = vector_new(A->nrows);
-    vec *vtb = vector_new(A->ncols);
-    vec *bt = vector_new(b);
-    double ai, bi, ntol;
-    matrix_set_colm(V, 0, vt);
-    double sk_last=-1;
-    mat *B_now;
-    mat *UB;
-    mat *SB;
-    mat *VB;
-    for(i = 0; i < b; ++i)
-    { 	
-        vector_copy(utb, ut);
-        vector_copy(vtb, vt);
-        csr_matrix_vector_mult(A, vt, ut);
-        if (i == 0)
-        {
-            ai = cblas_dnrm2(ut->nrows, ut->d, 1);
-            alpha[i] = ai;
-            vector_scale_d(ut, ai);
-            matrix_set_colm(U, i, ut);
-            csr_matrix_transpose_vector_mult(A, ut, vt);
-            cblas_daxpy(vt->nrows, -ai, vtb->d, 1, vt->d, 1);
-            ntol = vector_dot_product(vt, vtb);
-            {
-                bt->nrows = i+1;
-                V->ncols = i+1;
-                x_minus_VVTx(V, vt, bt);
-            }
-            V->ncols++;
-            bi = cblas_dnrm2(vt->nrows, vt->d, 1);
-            beta[i] = bi;
-            vector_scale_d(vt, bi);
-            matrix_set_colm(V, i+1, vt);
-        }
-        else
-        {
-            cblas_daxpy(A->nrows, -bi, utb->d, 1, ut->d, 1);
-            ntol = vector_dot_product(ut, utb);
-            {
-                bt->nrows = i;
-                U->ncols = i;
-                x_minus_VVTx(U, ut, bt);
-            }
-            U->ncols++;
-            ai = cblas_dnrm2(ut->nrows, ut->d, 1);
-            alpha[i] = ai;
-            vector_scale_d(ut, ai);
-            matrix_set_colm(U, i, ut);
-            csr_matrix_transpose_vector_mult(A, ut, vt);
-            cblas_daxpy(A->ncols, -ai, vtb->d, 1, vt->d, 1);
-            ntol = vector_dot_product(vt, vtb);
-            {
-                bt->nrows = i+1;
-                V->ncols = i+1;
-                x_minus_VVTx(V, vt, bt);
-            }
-            V->ncols++;
-            bi = cblas_dnrm2(vt->nrows, vt->d, 1);
-            beta[i] = bi;
-            if (i==b-1)
-                break;
-            vector_scale_d(vt, bi);
-            matrix_set_colm(V, i+1, vt);
-        }
-    }
-    int flag = 0;
-    double gamma[k];
-    B_now = matrix_new(b, b);
-    int j;
-    for(j=0;j<b-1;j++)
-    {
-        matrix_set_element(B_now, j, j, alpha[j]);
-        matrix_set_element(B_now, j, j+1, beta[j]);
-    }
-    matrix_set_element(B_now, b-1, b-1, alpha[b-1]);
-    UB = matrix_new(b, b);
-    SB = matrix_new(b, b);
-    VB = matrix_new(b, b);
-    singular_value_decomposition(B_now, UB, SB, VB);
-    for(i=0;i<k;i++)
-    {
-        gamma[i] = beta[b-1]*matrix_get_element(UB, b-1, i);
-        double gi = gamma[i];
-        if(gi < 0) gi = -gi;
-        flag += (gi < eps*matrix_get_element(SB, i, i));
-    }
-    U->ncols = b;
-    V->ncols = b;
-    bt->nrows = b;
-    int inds[k];
-    (*Sk) = matrix_new(k, 1);
-    for(i=0;i<b;i++)
-    {
-        alpha[i] = 0;
-        beta[i] = 0;
-    }
-    for(i=0;i<k;i++)
-    {
-        inds[i] = i;
-        (*Sk)->d[i] = matrix_get_element(SB, i, i);
-        alpha[i] = matrix_get_element(SB, i, i);
-        beta[i] = 0;
-    }
-    mat* UBk = matrix_new(b, k);
-    mat* VBt = matrix_new(b, b);
-    matrix_build_transpose(VBt, VB);
-    mat* VBk = matrix_new(b, k);
-    matrix_get_selected_columns(UB, inds, UBk);
-    matrix_get_selected_columns(VBt, inds, VBk);
-    (*Uk) = matrix_new(A->nrows, k);
-    matrix_matrix_mult(U, UBk, *Uk);
-    (*Vk) = matrix_new(A->ncols, k);
-    matrix_matrix_mult(V, VBk, *Vk);
-    int iters = 1;
-    while(iters < maxiter)
-    {
-        if(flag==k)
-            break;
-        V->ncols = k;
-        U->ncols = k;
-        matrix_copy(V, *Vk);
-        matrix_copy(U, *Uk);
-        nv = 0;
-        nv = cblas_dnrm2(A->ncols, vt->d, 1);
-        vector_scale_d(vt, nv);
-        V->ncols++;
-        matrix_set_colm(V, k, vt);
-
-        csr_matrix_vector_mult(A, vt, ut);
-        bt->nrows = k;
-        x_minus_VVTx(U, ut, bt);
-        U->ncols++;
-        ai = cblas_dnrm2(ut->nrows, ut->d, 1);
-        alpha[k] = ai;
-        vector_scale_d(ut, ai);
-        matrix_set_colm(U, k, ut);
-
-        vector_copy(vtb, vt);
-        csr_matrix_transpose_vector_mult(A, ut, vt);
-        cblas_daxpy(A->ncols, -ai, vtb->d, 1, vt->d, 1);
-        bt->nrows = k+1;
-        x_minus_VVTx(V, vt, bt);
-        V->ncols++;
-        bi = cblas_dnrm2(vt->nrows, vt->d, 1);
-        beta[k] = bi;
-        vector_scale_d(vt, bi);
-        matrix_set_colm(V, k+1, vt);
-        for(i = k+1; i < b; ++i)
-        { 	
-            vector_copy(utb, ut);
-            vector_copy(vtb, vt);
-            csr_matrix_vector_mult(A, vt, ut);
-            cblas_daxpy(A->nrows, -bi, utb->d, 1, ut->d, 1);
-            {
-                bt->nrows = i;
-                x_minus_VVTx(U, ut, bt);
-            }
-            U->ncols++;
-            ai = cblas_dnrm2(ut->nrows, ut->d, 1);
-            alpha[i] = ai;
-            vector_scale_d(ut, ai);
-            matrix_set_colm(U, i, ut);
-            csr_matrix_transpose_vector_mult(A, ut, vt);
-            cblas_daxpy(A->ncols, -ai, vtb->d, 1, vt->d, 1);
-            {
-                bt->nrows = i+1;
-                x_minus_VVTx(V, vt, bt);
-            }
-            V->ncols++;
-            bi = cblas_dnrm2(vt->nrows, vt->d, 1);
-            beta[i] = bi;
-            if (i==b-1)
-                break;
-            vector_scale_d(vt, bi);
-            matrix_set_colm(V, i+1, vt);
-        }
-        matrix_delete(B_now);
-        B_now = matrix_new(b, b);
-        for(j=0;j<k;j++)
-        {
-            matrix_set_element(B_now, j, j, alpha[j]);
-            matrix_set_element(B_now, j, k, gamma[j]);
-        }
-        for(j=k;j<b-1;j++)
-        {
-            matrix_set_element(B_now, j, j, alpha[j]);
-            matrix_set_element(B_now, j, j+1, beta[j]);
-        }
-        matrix_set_element(B_now, b-1, b-1, alpha[b-1]);
-        singular_value_decomposition(B_now, UB, SB, VB);
-        flag = 0;
-        for(i=0;i<k;i++)
-        {
-            gamma[i] = beta[b-1]*matrix_get_element(UB, b-1, i);
-            double gi = gamma[i];
-            if(gi < 0) gi = -gi;
-            flag += (gi < eps * matrix_get_element(SB, i, i));
-        }
-        U->ncols = b;
-        V->ncols = b;
-        bt->nrows = b;
-        for(i=0;i<k;i++)
-        {
-            inds[i] = i;
-            (*Sk)->d[i] = matrix_get_element(SB, i, i);
-            alpha[i] = matrix_get_element(SB, i, i);
-            beta[i] = 0;
-        }
-        matrix_build_transpose(VBt, VB);
-        matrix_get_selected_columns(UB, inds, UBk);
-        matrix_get_selected_columns(VBt, inds, VBk);
-        matrix_matrix_mult(U, UBk, *Uk);
-        matrix_matrix_mult(V, VBk, *Vk);
-        iters++;
-    }
-    
-    matrix_delete(B_now);
-    matrix_delete(SB);
-    matrix_delete(VB);
-    matrix_delete(UB);
-    matrix_delete(VBt);
-    matrix_delete(U);
-    matrix_delete(UBk);
-    matrix_delete(V);
-    matrix_delete(VBk);
-    vector_delete(bt);
-    vector_delete(ut);
-    vector_delete(utb);
-    vector_delete(vt);
-    vector_delete(vtb);
-}
+#include <stdio.h>
+#include <lapacke.h>
+#include <cblas.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "svds.h"
+#include "omp.h"
+
+void x_minus_VVTx(mat *V, vec *x, vec *xt)
+{
+    matrix_transpose_vector_mult(V, x, xt);
+    double alpha, beta;
+    alpha = -1.0;
+    beta = 1.0;
+    cblas_dgemv(CblasColMajor, CblasNoTrans, V->nrows, V->ncols, alpha, V->d, V->nrows, xt->d, 1, beta, x->d, 1);
+}
+
+void matrix_set_colm(mat* M, long long j, vec *column_vec)
+{
+    int i;
+    #pragma omp parallel shared(column_vec,M,j) private(i)
+    {
+    #pragma omp for
+    for(i = 0; i < M->nrows; ++i)
+        M->d[j*M->nrows+i] = column_vec->d[i];
+    }
+}
+
+/* M(:,j) = v/scalar in one pass, v is left untouched */
+void matrix_set_colm_scaled(mat* M, long long j, vec *v, double scalar)
+{
+    int i;
+    double *col = M->d + j*M->nrows;
+    #pragma omp parallel for shared(v,M,col,scalar) private(i)
+    for(i = 0; i < M->nrows; ++i)
+        col[i] = v->d[i]/scalar;
+}
+
+/* column j of M viewed as a vector, no copy */
+vec matrix_col_vec(mat *M, long long j)
+{
+    vec v;
+    v.nrows = M->nrows;
+    v.d = M->d + j*M->nrows;
+    return v;
+}
+
+void vector_scale_d(vec *v, double scalar)
+{
+    int i;
+    #pragma omp parallel shared(v,scalar) private(i) 
+    {
+    #pragma omp for
+    for(i=0; i<(v->nrows); i++)
+        v->d[i] = (v->d[i])/scalar;
+    }
+}
+
+svds_ritz * svds_ritz_new(int b, int k)
+{
+    svds_ritz *r = (svds_ritz*)malloc(sizeof(svds_ritz));
+    int lq, lp;
+    double q;
+    r->b = b;
+    r->k = k;
+    r->d = (double*)malloc(b*sizeof(double));
+    r->e = (double*)malloc(b*sizeof(double));
+    r->U = matrix_new(b, b);
+    r->VT = matrix_new(b, b);
+    r->house = (double*)malloc(2*k*sizeof(double));
+    r->dk = (double*)malloc(k*sizeof(double));
+    r->ek = (double*)malloc(k*sizeof(double));
+    r->tauq = (double*)malloc(k*sizeof(double));
+    r->taup = (double*)malloc(k*sizeof(double));
+    r->G = matrix_new(k, k);
+    r->T = matrix_new(k, k);
+    r->Q = matrix_new(k, k);
+    r->P = matrix_new(k, k);
+    r->bdwork = (double*)malloc(((size_t)3*b*b + 4*b)*sizeof(double));
+    r->iwork = (int*)malloc(8*b*sizeof(int));
+
+    // one workspace large enough for dgebrd and both dorgbr calls
+    LAPACKE_dgebrd_work(LAPACK_COL_MAJOR, k, k, r->G->d, k, r->dk, r->ek, r->tauq, r->taup, &q, -1);
+    r->lwork = (int)q;
+    LAPACKE_dorgbr_work(LAPACK_COL_MAJOR, 'Q', k, k, k, r->G->d, k, r->tauq, &q, -1);
+    lq = (int)q;
+    LAPACKE_dorgbr_work(LAPACK_COL_MAJOR, 'P', k, k, k, r->T->d, k, r->taup, &q, -1);
+    lp = (int)q;
+    r->lwork = max(max(r->lwork, lq), max(lp, 1));
+    r->work = (double*)malloc(r->lwork*sizeof(double));
+    return r;
+}
+
+void svds_ritz_delete(svds_ritz *r)
+{
+    free(r->d);
+    free(r->e);
+    matrix_delete(r->U);
+    matrix_delete(r->VT);
+    free(r->house);
+    free(r->dk);
+    free(r->ek);
+    free(r->tauq);
+    free(r->taup);
+    matrix_delete(r->G);
+    matrix_delete(r->T);
+    matrix_delete(r->Q);
+    matrix_delete(r->P);
+    free(r->work);
+    free(r->bdwork);
+    free(r->iwork);
+    free(r);
+}
+
+/*
+ * Rows and columns 0..k-1 of the arrowhead, [diag(alpha) gamma], become
+ * Q^T [diag(alpha) gamma] diag(P, 1) = upper bidiagonal with gamma folded
+ * into entry (k-1, k). Q must fix e_{k-1} and P may not touch column k, or
+ * the coupling to the bidiagonal tail would fill in, so either side is
+ * reduced from the bottom-right corner:
+ *   H = I - tau*v*v^T maps gamma to c*e_{k-1},
+ *   G = J (H diag(alpha))^T J (J the k x k reversal) = Qg Bg Pg^T by dgebrd,
+ * whose first right reflector leaves e_0 alone. Then J Bg^T J is upper
+ * bidiagonal, Q = H J Pg J and P = J Qg J. Costs O(k^3) on k x k matrices.
+ */
+static void ritz_fold_arrowhead(svds_ritz *r, const double *alpha, const double *gamma)
+{
+    const int k = r->k;
+    double *v = r->house, *w = r->house + k;
+    double *G = r->G->d, *T = r->T->d, *Q = r->Q->d, *P = r->P->d;
+    int i, j;
+
+    double nrm = cblas_dnrm2(k, gamma, 1);
+    double c = gamma[k-1] >= 0 ? -nrm : nrm;
+    memcpy(v, gamma, k*sizeof(double));
+    v[k-1] -= c;
+    double vtv = 2*nrm*(nrm + fabs(gamma[k-1]));
+    double tau = vtv > 0 ? 2/vtv : 0;
+
+    // G(i,j) = (H diag(alpha))(k-1-j, k-1-i)
+    for (j = 0; j < k; j++) {
+        int p = k-1-j;
+        for (i = 0; i < k; i++) {
+            int q = k-1-i;
+            G[(long long)j*k+i] = (p == q ? alpha[q] : 0) - tau*v[p]*v[q]*alpha[q];
+        }
+    }
+    LAPACKE_dgebrd_work(LAPACK_COL_MAJOR, k, k, G, k, r->dk, r->ek, r->tauq, r->taup, r->work, r->lwork);
+    memcpy(T, G, (size_t)k*k*sizeof(double));
+    LAPACKE_dorgbr_work(LAPACK_COL_MAJOR, 'Q', k, k, k, G, k, r->tauq, r->work, r->lwork);
+    LAPACKE_dorgbr_work(LAPACK_COL_MAJOR, 'P', k, k, k, T, k, r->taup, r->work, r->lwork); // Pg^T
+
+    for (j = 0; j < k; j++) {
+        for (i = 0; i < k; i++) {
+            Q[(long long)j*k+i] = T[(long long)(k-1-i)*k + (k-1-j)];
+            P[(long long)j*k+i] = G[(long long)(k-1-j)*k + (k-1-i)];
+        }
+    }
+    // Q = H*Q
+    cblas_dgemv(CblasColMajor, CblasTrans, k, k, 1.0, Q, k, v, 1, 0.0, w, 1);
+    cblas_dger(CblasColMajor, k, k, -tau, v, 1, w, 1, Q, k);
+
+    for (i = 0; i < k; i++)
+        r->d[i] = r->dk[k-1-i];
+    for (i = 0; i < k-1; i++)
+        r->e[i] = r->ek[k-2-i];
+    r->e[k-1] = c;
+}
+
+int svds_ritz_solve(svds_ritz *r, int start, const double *alpha, const double *beta, const double *gamma, double *s, mat *UBk, mat *VBk)
+{
+    const int b = r->b, k = r->k;
+    const double *U = r->U->d, *VT = r->VT->d;
+    int i, j, iq;
+    double q;
+    memcpy(r->d, alpha, b*sizeof(double));
+    memcpy(r->e, beta, (b-1)*sizeof(double));
+    if (start > 0)
+        ritz_fold_arrowhead(r, alpha, gamma);
+
+    int info = LAPACKE_dbdsdc_work(LAPACK_COL_MAJOR, 'U', 'I', b, r->d, r->e, r->U->d, b, r->VT->d, b, &q, &iq, r->bdwork, r->iwork);
+    if (info != 0)
+        return info;
+    memcpy(s, r->d, k*sizeof(double));
+
+    // the bidiagonal rows from 'start' on are those of B, the first k rows
+    // still go through the arrowhead transforms
+    for (j = 0; j < k; j++) {
+        memcpy(UBk->d + (long long)j*b + start, U + (long long)j*b + start, (b-start)*sizeof(double));
+        for (i = start; i < b; i++)
+            VBk->d[(long long)j*b + i] = VT[(long long)i*b + j];
+    }
+    if (start > 0) {
+        cblas_dgemm(CblasColMajor, CblasNoTrans, CblasNoTrans, k, k, k, 1.0, r->Q->d, k, U, b, 0.0, UBk->d, b);
+        cblas_dgemm(CblasColMajor, CblasNoTrans, CblasTrans, k, k, k, 1.0, r->P->d, k, VT, b, 0.0, VBk->d, b);
+    }
+    return 0;
+}
+
+/*
+ * Team kernels of the Lanczos expansion loop. Every thread of an enclosing
+ * parallel region calls them (orphaned worksharing), so one fork/join covers
+ * a whole expansion instead of one per helper; outside a region they run on
+ * a team of one. They use no BLAS, which would either serialize or
+ * oversubscribe inside the region, and each one ends on a barrier so its
+ * result is visible to the whole team.
+ */
+
+/* the formats svds stores itself; a backend may take some of them whole */
+typedef enum {
+    OP_CALLBACK,             // a caller's svds_operator
+    OP_DENSE,                // mat
+    OP_CSR,                  // mat_csr
+    OP_DENSE_F,              // mat_f
+    OP_CSR_F,                // mat_csr_f
+    OP_SELL                  // mat_sell
+} lanczos_format;
+
+/* the operand plus the team's scratch: part holds ldpart partial sums per
+   thread, red one cache line per thread for the norms. The solver only
+   applies A through the callbacks of the svds_operator; a built-in format
+   is one (lanczos_op_for) whose products reduce through part, so its ctx
+   is the lanczos_op itself, pointed at by svds_lanczos_core once the
+   scratch is in place, and the matrix is M. A row-distributed operand
+   (A.reduce set) keeps the ctx of its reductions in rctx. */
+typedef struct {
+    svds_operator A;
+    lanczos_format fmt;
+    const void *M;           // the built-in matrix, NULL for OP_CALLBACK
+    const svds_centering *center; // NULL, or A is centered implicitly
+    double flops, bytes;     // nominal cost of one product, for stats
+    long long m, n;
+    double *part;
+    long long ldpart;
+    double *red;
+    void *rctx;
+} lanczos_op;
+
+#define RED_STRIDE 8
+
+static const char *phase_names[SVDS_NPHASES] = {"matvec", "rmatvec", "reorth", "small SVD", "Ritz GEMM"};
+
+const char * svds_phase_name(svds_phase p)
+{
+    return p >= 0 && p < SVDS_NPHASES ? phase_names[p] : "?";
+}
+
+double svds_stats_gflops(const svds_stats *s, svds_phase p)
+{
+    return s->seconds[p] > 0 ? s->flops[p] / s->seconds[p] * 1e-9 : 0;
+}
+
+double svds_stats_gbs(const svds_stats *s, svds_phase p)
+{
+    return s->seconds[p] > 0 ? s->bytes[p] / s->seconds[p] * 1e-9 : 0;
+}
+
+/* STATS_TIC declares a start time, STATS_TOC charges the interval and the
+   nominal flops / bytes to a phase from the master thread; both vanish, with
+   their arguments, in a build without SVDS_STATS */
+#ifdef SVDS_STATS
+static void stats_add(svds_stats *st, svds_phase p, double t0, double flops, double bytes)
+{
+    if (!st || omp_get_thread_num() != 0)
+        return;
+    st->seconds[p] += omp_get_wtime() - t0;
+    st->calls[p]++;
+    st->flops[p] += flops;
+    st->bytes[p] += bytes;
+}
+#define STATS_TIC(t) double t = omp_get_wtime()
+#define STATS_TOC(st, p, t, flops, bytes) stats_add(st, p, t, flops, bytes)
+#else
+#define STATS_TIC(t)
+#define STATS_TOC(st, p, t, flops, bytes)
+#endif
+
+/* this thread's share [*rb, *re) of len rows */
+static void team_range(long long len, long long *rb, long long *re)
+{
+    int t = omp_get_thread_num(), nt = omp_get_num_threads();
+    *rb = len*t/nt;
+    *re = len*(t+1)/nt;
+}
+
+#define REAL double
+#define CSR_T mat_csr
+#define SFX(f) f
+#include "svds_team.inc"
+#undef REAL
+#undef CSR_T
+#undef SFX
+
+#define REAL float
+#define CSR_T mat_csr_f
+#define SFX(f) f##_f
+#include "svds_team.inc"
+#undef REAL
+#undef CSR_T
+#undef SFX
+
+/* y = A*x over this thread's chunks of the SELL copy */
+static void team_sell_matvec(const mat_sell *A, const double *x, double *y)
+{
+    int cb, ce;
+    sell_chunk_partition(A, omp_get_thread_num(), omp_get_num_threads(), &cb, &ce);
+    sell_matrix_mult_chunks(A, cb, ce, x, 0, NULL, y);
+    #pragma omp barrier
+}
+
+/* the products of the built-in formats as svds_operator callbacks; ctx is
+   the lanczos_op, see there */
+static void op_dense_matvec(void *ctx, const double *x, double *y)
+{
+    lanczos_op *op = (lanczos_op*)ctx;
+    team_gemv_n(((const mat*)op->M)->d, op->m, op->n, 1.0, x, 0, NULL, y);
+}
+
+static void op_dense_rmatvec(void *ctx, const double *x, double *y)
+{
+    lanczos_op *op = (lanczos_op*)ctx;
+    team_gemv_t(op, ((const mat*)op->M)->d, op->m, op->n, x, 0, NULL, y);
+}
+
+static void op_csr_matvec(void *ctx, const double *x, double *y)
+{
+    team_csr_matvec_sub((mat_csr*)((lanczos_op*)ctx)->M, x, 0, NULL, y);
+}
+
+static void op_csr_rmatvec(void *ctx, const double *x, double *y)
+{
+    lanczos_op *op = (lanczos_op*)ctx;
+    team_csr_matvec_transpose_sub(op, (mat_csr*)op->M, x, 0, NULL, y);
+}
+
+static void op_dense_f_matvec(void *ctx, const double *x, double *y)
+{
+    lanczos_op *op = (lanczos_op*)ctx;
+    team_gemv_n_f(((const mat_f*)op->M)->d, op->m, op->n, 1.0, x, 0, NULL, y);
+}
+
+static void op_dense_f_rmatvec(void *ctx, const double *x, double *y)
+{
+    lanczos_op *op = (lanczos_op*)ctx;
+    team_gemv_t_f(op, ((const mat_f*)op->M)->d, op->m, op->n, x, 0, NULL, y);
+}
+
+static void op_csr_f_matvec(void *ctx, const double *x, double *y)
+{
+    team_csr_matvec_sub_f((mat_csr_f*)((lanczos_op*)ctx)->M, x, 0, NULL, y);
+}
+
+static void op_csr_f_rmatvec(void *ctx, const double *x, double *y)
+{
+    lanczos_op *op = (lanczos_op*)ctx;
+    team_csr_matvec_transpose_sub_f(op, (mat_csr_f*)op->M, x, 0, NULL, y);
+}
+
+static void op_sell_matvec(void *ctx, const double *x, double *y)
+{
+    team_sell_matvec((const mat_sell*)((lanczos_op*)ctx)->M, x, y);
+}
+
+static void op_sell_rmatvec(void *ctx, const double *x, double *y)
+{
+    team_sell_matvec(((const mat_sell*)((lanczos_op*)ctx)->M)->At, x, y);
+}
+
+/* buf, shared and complete, summed over the processes of a row-distributed
+   operand by thread 0 (svds_operator.reduce) */
+static void team_reduce(lanczos_op *op, double *buf, int len)
+{
+    #pragma omp master
+    op->A.reduce(op->rctx, buf, len);
+    #pragma omp barrier
+}
+
+/* y = f(x) - beta*z through one of the operator's callbacks, which fills y
+   as a team; with dist, f(x) is first summed over the processes of a
+   row-distributed operand */
+static void team_callback_sub(lanczos_op *op, void (*f)(void*, const double*, double*), const double *x, double beta, const double *z, double *y, long long len, int dist)
+{
+    long long rb, re, r;
+    f(op->A.ctx, x, y);
+    #pragma omp barrier
+    if (dist && op->A.reduce)
+        team_reduce(op, y, (int)len);
+    if (beta == 0)
+        return;
+    team_range(len, &rb, &re);
+    for (r = rb; r < re; r++)
+        y[r] -= beta*z[r];
+    #pragma omp barrier
+}
+
+/* s[0] = sum of x, s[1] = a^T*x (0 if a is NULL), returned to every thread */
+static void team_sum_dot(lanczos_op *op, const double *a, const double *x, long long len, double *s)
+{
+    long long rb, re, r;
+    int t, nt = omp_get_num_threads();
+    double s0 = 0, s1 = 0;
+    team_range(len, &rb, &re);
+    for (r = rb; r < re; r++)
+    {
+        s0 += x[r];
+        if (a)
+            s1 += a[r]*x[r];
+    }
+    op->red[RED_STRIDE*omp_get_thread_num()] = s0;
+    op->red[RED_STRIDE*omp_get_thread_num() + 1] = s1;
+    #pragma omp barrier
+    s[0] = s[1] = 0;
+    for (t = 0; t < nt; t++)
+    {
+        s[0] += op->red[RED_STRIDE*t];
+        s[1] += op->red[RED_STRIDE*t + 1];
+    }
+    #pragma omp barrier
+}
+
+/* y = y - a*s0 - c (a may be NULL) */
+static void team_center(double *y, const double *a, double s0, double c, long long len)
+{
+    long long rb, re, r;
+    team_range(len, &rb, &re);
+    for (r = rb; r < re; r++)
+        y[r] -= (a ? a[r]*s0 : 0) + c;
+    #pragma omp barrier
+}
+
+/* ||x||, returned to every thread; with dist x is a U-side vector, split
+   over the processes of a row-distributed operand */
+static double team_nrm2(lanczos_op *op, const double *x, long long len, int dist)
+{
+    long long rb, re, r;
+    int t, nt = omp_get_num_threads();
+    double s = 0;
+    team_range(len, &rb, &re);
+    #pragma omp simd reduction(+:s)
+    for (r = rb; r < re; r++)
+        s += x[r]*x[r];
+    op->red[RED_STRIDE*omp_get_thread_num()] = s;
+    #pragma omp barrier
+    s = 0;
+    for (t = 0; t < nt; t++)
+        s += op->red[RED_STRIDE*t];
+    #pragma omp barrier
+    if (dist && op->A.reduce)
+    {
+        #pragma omp master
+        {
+            op->red[0] = s;
+            op->A.reduce(op->rctx, op->red, 1);
+        }
+        #pragma omp barrier
+        s = op->red[0];
+        #pragma omp barrier
+    }
+    return sqrt(s);
+}
+
+static void team_scale(double *x, long long len, double scalar)
+{
+    long long rb, re, r;
+    team_range(len, &rb, &re);
+    for (r = rb; r < re; r++)
+        x[r] /= scalar;
+    #pragma omp barrier
+}
+
+/* y = A*x - beta*z, with A centered by op->center:
+   C*x = A*x - row*(1^T*x) - 1*(col^T*x + bias*1^T*x) */
+static void team_matvec(lanczos_op *op, const double *x, double beta, const double *z, double *y)
+{
+    double s[2];
+    if (op->center)
+        team_sum_dot(op, op->center->col, x, op->n, s);
+    team_callback_sub(op, op->A.matvec, x, beta, z, y, op->m, 0);
+    if (op->center)
+        team_center(y, op->center->row, s[0], s[1] + op->center->bias*s[0], op->m);
+}
+
+/* y = A^T*x - beta*z, likewise
+   C^T*x = A^T*x - col*(1^T*x) - 1*(row^T*x + bias*1^T*x)
+   (a row-distributed operand is not centered) */
+static void team_matvec_transpose(lanczos_op *op, const double *x, double beta, const double *z, double *y)
+{
+    double s[2];
+    if (op->center)
+        team_sum_dot(op, op->center->row, x, op->m, s);
+    team_callback_sub(op, op->A.rmatvec, x, beta, z, y, op->n, 1);
+    if (op->center)
+        team_center(y, op->center->col, s[0], s[1] + op->center->bias*s[0], op->n);
+}
+
+/* x = x - Q*(Q^T*x) for the first ncols columns of Q; c receives Q^T*x,
+   summed over the processes with dist as in team_nrm2 */
+static void team_x_minus_QQTx(lanczos_op *op, const double *Q, long long len, int ncols, double *x, double *c, int dist)
+{
+    team_gemv_t(op, Q, len, ncols, x, 0, NULL, c);
+    if (dist && op->A.reduce)
+        team_reduce(op, c, ncols);
+    team_gemv_n(Q, len, ncols, -1.0, c, 1.0, x, x);
+}
+
+/* The full reorthogonalization of u = U(:,ii) of a row-distributed operand
+   in one reduction: [U(:,0..ii-1)^T*u; u^T*u] comes from one product with
+   U(:,0..ii), and once u lost U*c its norm is sqrt(u^T*u - c^T*c) by
+   Pythagoras, unless that cancels (as on the first step after a restart,
+   where c holds the arrowhead), which costs a second reduction. Returns
+   the norm; c needs ii+1 entries. */
+static double team_u_reorth_dist(lanczos_op *op, double *U, long long m, int ii, double *c)
+{
+    double *u = U + ii*m;
+    double ww, cc = 0;
+    int j;
+    team_gemv_t(op, U, m, ii+1, u, 0, NULL, c);
+    team_reduce(op, c, ii+1);
+    ww = c[ii];
+    for (j = 0; j < ii; j++)
+        cc += c[j]*c[j];
+    team_gemv_n(U, m, ii, -1.0, c, 1.0, u, u);
+    return ww - cc > 0.5*ww ? sqrt(ww - cc) : team_nrm2(op, u, m, 1);
+}
+
+/*
+ * Orthogonality estimates for SVDS_REORTH_PARTIAL (Simon / Larsen).
+ * mu[j] ~ u_i^T u_j and nu[j] ~ v_i^T v_j are carried along with the
+ * Lanczos recurrences by the rows and columns of B. For j < start, B holds
+ * the arrowhead of the last restart: row j is (sigma_j at j, gamma_j at
+ * start), and column start collects the gamma_j. A vector is
+ * reorthogonalized, twice and against the whole basis, once an estimate
+ * passes sqrt(eps), and again on the following step; its estimates then
+ * drop back to the rounding level eps1.
+ */
+typedef struct {
+    double *mu, *nu;
+    double eps1, delta, anorm;
+    int again_u, again_v;
+} lanczos_pro;
+
+static void pro_reset(double *w, int len, double eps1)
+{
+    int j;
+    for (j = 0; j < len; j++)
+        w[j] = eps1;
+    w[len] = 1;
+}
+
+/* mu_{i,.} from mu_{i-1,.} and nu_{i,.}; returns 1 if u_i needs reorthogonalizing */
+static int pro_update_mu(lanczos_pro *p, int i, int start, double ai, const double *alpha, const double *beta, const double *gamma)
+{
+    int j, trigger = 0;
+    for (j = 0; j < i; j++) {
+        double off = j < start ? gamma[j] : beta[j];
+        double t = alpha[j]*p->nu[j] + off*p->nu[j < start ? start : j+1] - beta[i-1]*p->mu[j];
+        double d = p->eps1*(hypot(alpha[j], off) + hypot(ai, beta[i-1]) + p->anorm);
+        t = (t + copysign(d, t))/ai;
+        p->mu[j] = t;
+        trigger |= fabs(t) > p->delta;
+    }
+    p->mu[i] = 1;
+    int redo = trigger || p->again_u;
+    p->again_u = trigger;
+    if (redo)
+        pro_reset(p->mu, i, p->eps1);
+    return redo;
+}
+
+/* nu_{i+1,.} from nu_{i,.} and mu_{i,.}; returns 1 if v_{i+1} needs reorthogonalizing */
+static int pro_update_nu(lanczos_pro *p, int i, int start, double ai, double bi, const double *alpha, const double *beta, const double *gamma)
+{
+    int j, l, trigger = 0;
+    double gmu = 0;
+    for (l = 0; l < start; l++)
+        gmu += gamma[l]*p->mu[l];
+    p->anorm = max(p->anorm, hypot(ai, bi));
+    for (j = 0; j <= i; j++) {
+        double aj = j == i ? ai : alpha[j];
+        double off = 0;
+        if (j == start && start > 0)
+            off = gmu;
+        else if (j > start)
+            off = beta[j-1]*p->mu[j-1];
+        double t = aj*p->mu[j] + off - ai*p->nu[j];
+        double d = p->eps1*(hypot(aj, j > start ? beta[j-1] : 0) + hypot(ai, bi) + p->anorm);
+        t = (t + copysign(d, t))/bi;
+        p->nu[j] = t;
+        trigger |= fabs(t) > p->delta;
+    }
+    p->nu[i+1] = 1;
+    int redo = trigger || p->again_v;
+    p->again_v = trigger;
+    if (redo)
+        pro_reset(p->nu, i+1, p->eps1);
+    return redo;
+}
+
+#define WS_ALIGN 64
+
+/* rows x cols, column-major, zeroed column by column in the row blocks that
+   team_range hands each thread, so pages land on that thread's node */
+static double * ws_alloc(long long rows, long long cols, int nthreads)
+{
+    void *p = NULL;
+    size_t bytes = (size_t)rows*cols*sizeof(double);
+    if (posix_memalign(&p, WS_ALIGN, bytes > 0 ? bytes : WS_ALIGN) != 0)
+        return NULL;
+    double *d = (double*)p;
+    matrix_place(d, bytes);
+    #pragma omp parallel num_threads(nthreads)
+    {
+        long long rb, re, j;
+        team_range(rows, &rb, &re);
+        for (j = 0; j < cols; j++)
+            memset(d + j*rows + rb, 0, (re - rb)*sizeof(double));
+    }
+    return d;
+}
+
+static void ws_mat(mat *M, int rows, int cols, int nthreads)
+{
+    M->nrows = rows;
+    M->ncols = cols;
+    M->d = ws_alloc(rows, cols, nthreads);
+}
+
+svds_workspace * svds_workspace_new(int m, int n, int k, int maxbasis)
+{
+    svds_workspace *ws = (svds_workspace*)malloc(sizeof(svds_workspace));
+    const int b = maxbasis;
+    const int nt = omp_get_max_threads();
+    ws->m = m;
+    ws->n = n;
+    ws->k = k;
+    ws->b = b;
+    ws->nthreads = nt;
+    ws_mat(&ws->U, m, b, nt);
+    ws_mat(&ws->V, n, b, nt);
+    ws_mat(&ws->Uk, m, k, nt);
+    ws_mat(&ws->Vk, n, k, nt);
+    ws_mat(&ws->Sk, k, 1, 1);
+    ws_mat(&ws->UBk, b, k, 1);
+    ws_mat(&ws->VBk, b, k, 1);
+    ws->vt.nrows = n;
+    ws->vt.d = ws_alloc(n, 1, nt);
+    ws->warm = 0;
+    ws->nconv = 0;
+    ws->coef = ws_alloc(b, 1, 1);
+    ws->part = ws_alloc(max(n, b), nt, nt);
+    ws->red = ws_alloc(RED_STRIDE, nt, 1);
+    ws->mu = ws_alloc(b + 1, 1, 1);
+    ws->nu = ws_alloc(b + 1, 1, 1);
+    ws->ritz = svds_ritz_new(b, k);
+    ws->ckpt = NULL;
+    return ws;
+}
+
+static void checkpoint_delete(struct svds_checkpoint *c);
+
+void svds_workspace_delete(svds_workspace *ws)
+{
+    if (ws->ckpt)
+        checkpoint_delete(ws->ckpt);
+    free(ws->U.d);
+    free(ws->V.d);
+    free(ws->Uk.d);
+    free(ws->Vk.d);
+    free(ws->Sk.d);
+    free(ws->UBk.d);
+    free(ws->VBk.d);
+    free(ws->vt.d);
+    free(ws->coef);
+    free(ws->part);
+    free(ws->red);
+    free(ws->mu);
+    free(ws->nu);
+    svds_ritz_delete(ws->ritz);
+    free(ws);
+}
+
+void svds_workspace_warm_start(svds_workspace *ws, const mat *V0)
+{
+    const int n0 = min(V0->nrows, ws->n);
+    long long i;
+    int j;
+    initialize_random_vector(&ws->vt);
+    double nr = cblas_dnrm2(ws->n, ws->vt.d, 1);
+    cblas_dscal(ws->n, 0.01 * sqrt((double)max(V0->ncols, 1)) / nr, ws->vt.d, 1);
+    for (j = 0; j < V0->ncols; j++)
+        for (i = 0; i < n0; i++)
+            ws->vt.d[i] += V0->d[(long long)j*V0->nrows + i];
+    ws->warm = 1;
+}
+
+size_t svds_workspace_bytes(int m, int n, int k, int maxbasis)
+{
+    const size_t b = maxbasis, nt = omp_get_max_threads();
+    size_t doubles = ((size_t)m + n) * (b + k) + n + k + 2*b*k
+        + (size_t)max(n, maxbasis) * nt + RED_STRIDE * nt + 3*b + 2;
+    // svds_ritz: b x b singular vectors plus the dbdsdc work
+    doubles += 2*b*b + 3*b*b + 4*b + 10*(size_t)k*k;
+    return doubles * sizeof(double) + 8*b * sizeof(int);
+}
+
+/* Checkpoint file: the 64-byte header, then alpha, beta, gamma and the
+   Ritz values (k each), U(:,0..k-1) and V(:,0..k), column-major. nnz and
+   sum identify the matrix (op_fingerprint). */
+#define SVDS_CHECKPOINT_MAGIC "SVDCKP02"
+
+typedef struct {
+    char magic[8];
+    int m, n, k, b;
+    int iters, locked, bcur, conv_prev;
+    double anorm;
+    long long nnz;
+    double sum;
+} checkpoint_header;
+
+struct svds_checkpoint {
+    char *path, *tmp;        // NULL: resume only
+    double interval, last;
+    checkpoint_header h;     // of the pending write, or of the loaded file
+    double *buf;             // the body, 4k + m*k + n*(k+1) doubles
+    size_t len;
+    pthread_t writer;
+    int writing;             // a writer thread is to be joined
+    int err;                 // last write failed
+    int resume;              // buf holds a loaded checkpoint for the next solve
+};
+
+static size_t checkpoint_len(int m, int n, int k)
+{
+    return 4*(size_t)k + (size_t)m*k + (size_t)n*(k + 1);
+}
+
+static struct svds_checkpoint * checkpoint_get(svds_workspace *ws)
+{
+    if (!ws->ckpt)
+        ws->ckpt = (struct svds_checkpoint*)calloc(1, sizeof(struct svds_checkpoint));
+    return ws->ckpt;
+}
+
+static void * checkpoint_write_run(void *arg)
+{
+    struct svds_checkpoint *c = (struct svds_checkpoint*)arg;
+    FILE *fp = fopen(c->tmp, "wb");
+    int err = !fp;
+    if (fp)
+    {
+        err = fwrite(&c->h, sizeof(c->h), 1, fp) != 1 || fwrite(c->buf, sizeof(double), c->len, fp) != c->len;
+        err |= fflush(fp) != 0 || fsync(fileno(fp)) != 0;
+        err |= fclose(fp) != 0;
+    }
+    if (!err)
+        err = rename(c->tmp, c->path) != 0;
+    if (err)
+        fprintf(stderr, "svds: could not write the checkpoint '%s'\n", c->path);
+    c->err = err;
+    return NULL;
+}
+
+static void checkpoint_wait(struct svds_checkpoint *c)
+{
+    if (c->writing)
+        pthread_join(c->writer, NULL);
+    c->writing = 0;
+}
+
+static void checkpoint_delete(struct svds_checkpoint *c)
+{
+    checkpoint_wait(c);
+    free(c->path);
+    free(c->tmp);
+    free(c->buf);
+    free(c);
+}
+
+/* the body buffer for an m x n, rank-k state; returns 0 on success */
+static int checkpoint_reserve(struct svds_checkpoint *c, int m, int n, int k)
+{
+    size_t len = checkpoint_len(m, n, k);
+    if (c->buf && c->len == len)
+        return 0;
+    free(c->buf);
+    c->buf = (double*)malloc(max(len, 1) * sizeof(double));
+    c->len = c->buf ? len : 0;
+    return !c->buf;
+}
+
+int svds_workspace_checkpoint(svds_workspace *ws, const char *path, double interval)
+{
+    struct svds_checkpoint *c = checkpoint_get(ws);
+    if (!c)
+        return 1;
+    checkpoint_wait(c);
+    free(c->path);
+    free(c->tmp);
+    c->path = (char*)malloc(strlen(path) + 1);
+    c->tmp = (char*)malloc(strlen(path) + 5);
+    if (!c->path || !c->tmp)
+        return 1;
+    strcpy(c->path, path);
+    sprintf(c->tmp, "%s.tmp", path);
+    c->interval = interval;
+    return 0;
+}
+
+int svds_workspace_resume(svds_workspace *ws, const char *path)
+{
+    struct svds_checkpoint *c = checkpoint_get(ws);
+    FILE *fp = fopen(path, "rb");
+    long long i;
+    if (!c || !fp)
+    {
+        if (fp)
+            fclose(fp);
+        return 1;
+    }
+    checkpoint_wait(c);
+    int err = fread(&c->h, sizeof(c->h), 1, fp) != 1 ? 1 : 0;
+    if (!err && (memcmp(c->h.magic, SVDS_CHECKPOINT_MAGIC, 8) != 0 || c->h.m != ws->m || c->h.n != ws->n
+                 || c->h.k < 1 || c->h.k >= ws->b || c->h.bcur > ws->b || c->h.locked > c->h.k))
+        err = 2;
+    if (!err)
+        err = checkpoint_reserve(c, c->h.m, c->h.n, c->h.k);
+    if (!err)
+        err = fread(c->buf, sizeof(double), c->len, fp) != c->len;
+    fclose(fp);
+    if (err)
+        return err;
+    // the bases go to U and V now, the scalars at the start of the solve
+    const int m = ws->m, n = ws->n, k = c->h.k;
+    const double *src = c->buf + 4*k;
+    for (i = 0; i < (long long)m*k; i++)
+        ws->U.d[i] = src[i];
+    src += (long long)m*k;
+    for (i = 0; i < (long long)n*(k + 1); i++)
+        ws->V.d[i] = src[i];
+    c->resume = 1;
+    return 0;
+}
+
+/* snapshot of the state after a restart, written in the background */
+static void checkpoint_save(struct svds_checkpoint *c, const mat *U, const mat *V, int k, const double *alpha, const double *beta, const double *gamma, const double *s,
+                            int b, int iters, int locked, int bcur, int conv_prev, double anorm, long long nnz, double sum)
+{
+    const int m = U->nrows, n = V->nrows;
+    checkpoint_wait(c);
+    if (checkpoint_reserve(c, m, n, k) != 0)
+        return;
+    memset(&c->h, 0, sizeof(c->h));
+    memcpy(c->h.magic, SVDS_CHECKPOINT_MAGIC, 8);
+    c->h.m = m;
+    c->h.n = n;
+    c->h.k = k;
+    c->h.b = b;
+    c->h.iters = iters;
+    c->h.locked = locked;
+    c->h.bcur = bcur;
+    c->h.conv_prev = conv_prev;
+    c->h.anorm = anorm;
+    c->h.nnz = nnz;
+    c->h.sum = sum;
+    memcpy(c->buf, alpha, k*sizeof(double));
+    memcpy(c->buf + k, beta, k*sizeof(double));
+    memcpy(c->buf + 2*k, gamma, k*sizeof(double));
+    memcpy(c->buf + 3*k, s, k*sizeof(double));
+    memcpy(c->buf + 4*k, U->d, (size_t)m*k*sizeof(double));
+    memcpy(c->buf + 4*k + (size_t)m*k, V->d, (size_t)n*(k + 1)*sizeof(double));
+    c->writing = pthread_create(&c->writer, NULL, checkpoint_write_run, c) == 0;
+    if (!c->writing)
+        checkpoint_write_run(c);
+    c->last = omp_get_wtime();
+}
+
+/* what a checkpoint records of the operand: the stored entries and the sum
+   of their float roundings, so that the double and float copies of one
+   matrix agree, plus the centering terms. A caller's operator only has
+   its nnz. */
+static void op_fingerprint(const lanczos_op *op, long long *nnz, double *sum)
+{
+    const mat *Ad = (const mat*)op->M;
+    const mat_f *Adf = (const mat_f*)op->M;
+    const mat_csr *As = (const mat_csr*)op->M;
+    const mat_csr_f *Asf = (const mat_csr_f*)op->M;
+    const mat_sell *Asl = (const mat_sell*)op->M;
+    long long i, j;
+    double s = 0;
+    switch (op->fmt) {
+    case OP_DENSE:
+        #pragma omp parallel for reduction(+:s)
+        for (i = 0; i < op->m*op->n; i++)
+            s += (float)Ad->d[i];
+        break;
+    case OP_DENSE_F:
+        #pragma omp parallel for reduction(+:s)
+        for (i = 0; i < op->m*op->n; i++)
+            s += Adf->d[i];
+        break;
+    case OP_CSR:
+        #pragma omp parallel for private(j) reduction(+:s)
+        for (i = 0; i < As->nrows; i++)
+            for (j = As->pointerB[i]; j < As->pointerE[i]; j++)
+                s += (float)As->values[j-1];
+        break;
+    case OP_CSR_F:
+        #pragma omp parallel for private(j) reduction(+:s)
+        for (i = 0; i < Asf->nrows; i++)
+            for (j = Asf->pointerB[i]; j < Asf->pointerE[i]; j++)
+                s += Asf->values[j-1];
+        break;
+    case OP_SELL:   // the padding holds zeros
+        #pragma omp parallel for reduction(+:s)
+        for (i = 0; i < Asl->chunk_ptr[Asl->nchunks]; i++)
+            s += (float)Asl->val[i];
+        break;
+    default:
+        break;
+    }
+    if (op->center)
+    {
+        for (i = 0; op->center->row && i < op->m; i++)
+            s += op->center->row[i];
+        for (i = 0; op->center->col && i < op->n; i++)
+            s += op->center->col[i];
+        s += op->center->bias;
+    }
+    *nnz = op->A.nnz;
+    *sum = s;
+}
+
+static int svds_workspace_fits(const svds_workspace *ws, int m, int n, int k, int maxbasis)
+{
+    return ws->m == m && ws->n == n && k <= ws->k && maxbasis <= ws->b;
+}
+
+/*
+ * Restarted Lanczos bidiagonalization behind every CPU Lanczos entry point;
+ * the operand, built-in format or caller's callbacks, is only reached
+ * through the svds_operator in op. The Lanczos vectors are built in place
+ * in the columns of U and V: the product A*v_i lands straight in U(:,i),
+ * loses beta_{i-1}*u_{i-1} there and is then reorthogonalized and
+ * normalized where it lies, and likewise for V(:,i+1). Only the residual
+ * of the last step, needed for the restart, is kept apart in vt. Each
+ * expansion runs inside a single parallel region; the small SVD of B and
+ * the Ritz vector GEMMs stay outside it, where LAPACK/BLAS bring their own
+ * threading.
+ *
+ * A row-distributed operand (op.A.reduce) holds this process's rows of A
+ * and U, while V, B and everything derived from them are replicated. The
+ * U-side coefficients and norms and A^T*u are reduced, and so are the
+ * decisions that must agree (the start vector, resuming, checkpointing,
+ * the time budget); with full reorthogonalization a step costs two
+ * reductions (team_u_reorth_dist).
+ *
+ * Restarts: the leading run of converged Ritz triplets is locked after
+ * each pass. Locked vectors stay in the first L columns of U and V, where
+ * the expansion still orthogonalizes against them, but they drop out of
+ * the projected problem (rows and columns L..bcur-1 only) and of the Ritz
+ * GEMMs. The basis length bcur <= maxbasis of the next pass follows the
+ * observed rate: the steps the unconverged triplets need if they keep
+ * converging as fast as in the last pass, back to the full basis when a
+ * pass gained nothing. Stops when all k converged, after maxiter passes,
+ * or (time_budget > 0) when another pass of the last one's length would
+ * end past time_budget seconds.
+ */
+static void svds_lanczos_core(lanczos_op op, int k, double eps, int maxbasis, int maxiter, double time_budget, svds_reorth reorth, svds_workspace *ws, svds_stats *stats)
+{
+    (void)stats; // only read by the STATS_ macros
+    const int b = maxbasis;
+    const int nthreads = ws->nthreads;
+    const int m = (int)op.m, n = (int)op.n;
+    mat *U = &ws->U;
+    mat *V = &ws->V;
+    double alpha[b+1];
+    double beta[b+1];
+    double gamma[k];
+    vec *vt = &ws->vt;
+    double *coef = ws->coef;
+    op.ldpart = max(n, ws->b);
+    op.part = ws->part;
+    op.red = ws->red;
+    if (op.M)
+        op.A.ctx = &op;
+    double rows = m;
+    if (op.A.reduce)
+        op.A.reduce(op.rctx, &rows, 1); // all the processes' rows
+    lanczos_pro pro;
+    pro.mu = ws->mu;
+    pro.nu = ws->nu;
+    pro.eps1 = DBL_EPSILON*sqrt(max(rows, (double)n))/2;
+    pro.delta = sqrt(DBL_EPSILON);
+    pro.anorm = 0;
+    // full CGS: one pass, CGS2 and the triggered partial steps: two passes
+    const int passes = reorth == SVDS_REORTH_FULL ? 1 : 2;
+    int i;
+    U->ncols = b;
+    V->ncols = b;
+    struct svds_checkpoint *ck = ws->ckpt;
+    long long op_nnz = 0;
+    double op_sum = 0;
+    if (ck)
+        op_fingerprint(&op, &op_nnz, &op_sum);
+    int resuming = ck && ck->resume && ck->h.k == k && ck->h.bcur <= b;
+    if (ck && ck->resume && !resuming)
+        fprintf(stderr, "svds: the checkpoint is of a rank-%d solve with a basis of %d, not %d / %d; starting afresh\n", ck->h.k, ck->h.bcur, k, b);
+    // the sum may differ in the last digits with the summation order
+    if (resuming && (ck->h.nnz != op_nnz || fabs(ck->h.sum - op_sum) > 1e-9*max(fabs(ck->h.sum), fabs(op_sum))))
+    {
+        fprintf(stderr, "svds: the checkpoint is of another matrix (%lld entries summing to %.17g, not %lld / %.17g); starting afresh\n",
+                ck->h.nnz, ck->h.sum, op_nnz, op_sum);
+        resuming = 0;
+    }
+    if (ck && op.A.reduce)
+    {
+        // resume only if every process can
+        double agree[2] = {resuming, 1};
+        op.A.reduce(op.rctx, agree, 2);
+        resuming = agree[0] == agree[1];
+    }
+    if (ck)
+        ck->resume = 0;
+    ws->nconv = 0;
+    double nv;
+    if (resuming)
+        ws->warm = 0; // U and V hold the checkpoint
+    else
+    {
+        if (ws->warm)
+            ws->warm = 0; // vt already holds the start
+        else
+        {
+            initialize_random_vector(vt);
+            // the sum of the processes' vectors, the same start everywhere
+            if (op.A.reduce)
+                op.A.reduce(op.rctx, vt->d, n);
+        }
+        nv = cblas_dnrm2(n, vt->d, 1);
+        matrix_set_colm_scaled(V, 0, vt, nv);
+    }
+
+    // a workspace made for a larger k / basis serves a smaller one in the
+    // leading part of each buffer
+    svds_ritz *ritz = ws->ritz;
+    ritz->b = b;
+    ritz->k = k;
+    double sv[k];
+    mat *UBk = &ws->UBk;
+    mat *VBk = &ws->VBk;
+    UBk->nrows = VBk->nrows = b;
+    UBk->ncols = VBk->ncols = k;
+    mat *Sk = &ws->Sk;
+    mat *Uk = &ws->Uk;
+    mat *Vk = &ws->Vk;
+    Sk->nrows = k;
+    Uk->ncols = Vk->ncols = k;
+    int start = 0;
+    int iters = 0;
+    int L = 0;                 // locked triplets
+    int bcur = b;              // basis length of this pass
+    int conv_prev = 0;
+    const double t_begin = omp_get_wtime();
+    double t_pass = t_begin;
+    for(i = 0; i < b; i++)
+    {
+        alpha[i] = 0;
+        beta[i] = 0;
+    }
+    if (resuming)
+    {
+        // continue after the saved restart; the locked results are the
+        // leading columns of U and V
+        memcpy(alpha, ck->buf, k*sizeof(double));
+        memcpy(beta, ck->buf + k, k*sizeof(double));
+        memcpy(gamma, ck->buf + 2*k, k*sizeof(double));
+        memcpy(Sk->d, ck->buf + 3*k, k*sizeof(double));
+        memcpy(sv, Sk->d, k*sizeof(double));
+        iters = ck->h.iters;
+        L = ck->h.locked;
+        bcur = ck->h.bcur;
+        conv_prev = ck->h.conv_prev;
+        pro.anorm = ck->h.anorm;
+        start = k;
+        memcpy(Uk->d, U->d, (size_t)m*L*sizeof(double));
+        memcpy(Vk->d, V->d, (size_t)n*L*sizeof(double));
+    }
+    if (ck)
+        ck->last = t_begin;
+
+    while(1)
+    {
+        // extend the bidiagonalization from column 'start' to b
+        pro.again_u = pro.again_v = 0;
+        pro_reset(pro.nu, start, pro.eps1);
+        int redo_u = 0, redo_v = 0; // shared partial-reorthogonalization decisions
+        #pragma omp parallel num_threads(nthreads)
+        {
+            int ii, p;
+            double ai, bi = 0; // every thread tracks the same scalars
+            for(ii = start; ii < bcur; ++ii)
+            {
+                double *vi = V->d + (long long)ii*n;
+                double *ui = U->d + (long long)ii*m;
+                STATS_TIC(t_mv);
+                if (ii > start)
+                    team_matvec(&op, vi, bi, ui - m, ui);
+                else
+                    team_matvec(&op, vi, 0, NULL, ui);
+                STATS_TOC(stats, SVDS_PHASE_MATVEC, t_mv, op.flops, op.bytes);
+                STATS_TIC(t_ru);
+                // after a restart u_start must lose its components along the
+                // Ritz vectors, so that step is always reorthogonalized
+                if (reorth == SVDS_REORTH_PARTIAL && ii > start)
+                {
+                    ai = team_nrm2(&op, ui, m, 1);
+                    #pragma omp single
+                    redo_u = pro_update_mu(&pro, ii, start, ai, alpha, beta, gamma);
+                    if (redo_u)
+                    {
+                        for(p = 0; p < passes; ++p)
+                            team_x_minus_QQTx(&op, U->d, m, ii, ui, coef, 1);
+                        ai = team_nrm2(&op, ui, m, 1);
+                    }
+                }
+                else
+                {
+                    if (ii > 0 && passes == 1 && op.A.reduce)
+                        ai = team_u_reorth_dist(&op, U->d, m, ii, coef);
+                    else
+                    {
+                        for(p = 0; ii > 0 && p < passes; ++p)
+                            team_x_minus_QQTx(&op, U->d, m, ii, ui, coef, 1);
+                        ai = team_nrm2(&op, ui, m, 1);
+                    }
+                    if (reorth == SVDS_REORTH_PARTIAL)
+                    {
+                        #pragma omp single
+                        pro_reset(pro.mu, ii, pro.eps1);
+                    }
+                }
+                team_scale(ui, m, ai);
+                // passes over U(:,0..ii-1) actually made in this step
+                STATS_TOC(stats, SVDS_PHASE_REORTH, t_ru,
+                          4.0*m*ii*((reorth == SVDS_REORTH_PARTIAL && ii > start) ? (redo_u ? passes : 0) : (ii > 0 ? passes : 0)) + 3.0*m,
+                          16.0*m*ii*((reorth == SVDS_REORTH_PARTIAL && ii > start) ? (redo_u ? passes : 0) : (ii > 0 ? passes : 0)) + 24.0*m);
+
+                double *vnext = (ii+1 < bcur) ? vi + n : vt->d;
+                STATS_TIC(t_rmv);
+                team_matvec_transpose(&op, ui, ai, vi, vnext);
+                STATS_TOC(stats, SVDS_PHASE_RMATVEC, t_rmv, op.flops, op.bytes);
+                STATS_TIC(t_rv);
+                if (reorth == SVDS_REORTH_PARTIAL && (ii > start || start == 0))
+                {
+                    bi = team_nrm2(&op, vnext, n, 0);
+                    #pragma omp single
+                    redo_v = pro_update_nu(&pro, ii, start, ai, bi, alpha, beta, gamma);
+                    if (redo_v)
+                    {
+                        for(p = 0; p < passes; ++p)
+                            team_x_minus_QQTx(&op, V->d, n, ii+1, vnext, coef, 0);
+                        bi = team_nrm2(&op, vnext, n, 0);
+                    }
+                }
+                else
+                {
+                    for(p = 0; p < passes; ++p)
+                        team_x_minus_QQTx(&op, V->d, n, ii+1, vnext, coef, 0);
+                    bi = team_nrm2(&op, vnext, n, 0);
+                    if (reorth == SVDS_REORTH_PARTIAL)
+                    {
+                        #pragma omp single
+                        pro_reset(pro.nu, ii+1, pro.eps1);
+                    }
+                }
+                if (ii+1 < bcur)
+                    team_scale(vnext, n, bi);
+                STATS_TOC(stats, SVDS_PHASE_REORTH, t_rv,
+                          4.0*n*(ii+1)*((reorth == SVDS_REORTH_PARTIAL && (ii > start || start == 0)) ? (redo_v ? passes : 0) : passes) + 3.0*n,
+                          16.0*n*(ii+1)*((reorth == SVDS_REORTH_PARTIAL && (ii > start || start == 0)) ? (redo_v ? passes : 0) : passes) + 24.0*n);
+                #pragma omp master
+                {
+                    alpha[ii] = ai;
+                    beta[ii] = bi;
+                }
+            }
+        }
+        U->ncols = bcur;
+        V->ncols = bcur;
+
+        // B is upper bidiagonal on the first pass and an arrowhead after a
+        // restart; the locked triplets are already exact and left out
+        const int bl = bcur - L, kl = k - L;
+        ritz->b = bl;
+        ritz->k = kl;
+        UBk->nrows = VBk->nrows = bl;
+        UBk->ncols = VBk->ncols = kl;
+        STATS_TIC(t_svd);
+        if (svds_ritz_solve(ritz, start - L, alpha + L, beta + L, gamma + L, sv + L, UBk, VBk) != 0)
+        {
+            fprintf(stderr, "svds: SVD of the projected matrix failed\n");
+            break;
+        }
+        STATS_TOC(stats, SVDS_PHASE_SMALL_SVD, t_svd, 4.0*bl*bl*bl, 8.0*(2.0*bl*bl + 2.0*bl*kl));
+        int flag = L;
+        for(i=L;i<k;i++)
+        {
+            gamma[i] = beta[bcur-1]*matrix_get_element(UBk, bl-1, i-L);
+            double gi = gamma[i];
+            if(gi < 0) gi = -gi;
+            flag += (gi < eps*sv[i]);
+        }
+        ws->nconv = flag;
+        for(i=L;i<k;i++)
+        {
+            Sk->d[i] = sv[i];
+            alpha[i] = sv[i];
+            beta[i] = 0;
+        }
+#ifdef SVDS_STATS
+        if (stats && iters < SVDS_STATS_MAX_RESTARTS)
+        {
+            stats->converged[iters] = flag;
+            stats->basis[iters] = bcur;
+        }
+#endif
+        STATS_TIC(t_ritz);
+        cblas_dgemm(CblasColMajor, CblasNoTrans, CblasNoTrans, m, kl, bl, 1.0, U->d + (long long)L*m, m, UBk->d, bl, 0.0, Uk->d + (long long)L*m, m);
+        cblas_dgemm(CblasColMajor, CblasNoTrans, CblasNoTrans, n, kl, bl, 1.0, V->d + (long long)L*n, n, VBk->d, bl, 0.0, Vk->d + (long long)L*n, n);
+        STATS_TOC(stats, SVDS_PHASE_RITZ, t_ritz, 2.0*((double)m + n)*bl*kl, 8.0*((double)m + n)*(bl + kl));
+        iters++;
+        double t_now = omp_get_wtime();
+        int out_of_time = time_budget > 0 && (t_now - t_begin) + (t_now - t_pass) > time_budget;
+        t_pass = t_now;
+        if (time_budget > 0 && op.A.reduce)
+        {
+            // stop when any process runs out
+            double late = out_of_time;
+            op.A.reduce(op.rctx, &late, 1);
+            out_of_time = late > 0;
+        }
+        if(flag==k || iters >= maxiter || out_of_time)
+            break;
+
+        // next basis length: the steps the rest needs at this pass's rate
+        const int steps = bcur - start, left = k - flag, gained = flag - conv_prev;
+        int next = b - k;
+        if (gained > 0)
+            next = min(next, max((left*steps + gained - 1) / gained, min(b - k, max(2*left, 8))));
+        conv_prev = flag;
+
+        // thick restart: keep the k Ritz vectors (the locked ones are in
+        // place already), lock the converged leading run, continue from the
+        // residual
+        STATS_TIC(t_copy);
+        memcpy(V->d + (long long)L*n, Vk->d + (long long)L*n, (size_t)n*kl*sizeof(double));
+        memcpy(U->d + (long long)L*m, Uk->d + (long long)L*m, (size_t)m*kl*sizeof(double));
+        while (L < k && fabs(gamma[L]) < eps*sv[L])
+            gamma[L++] = 0;
+        nv = cblas_dnrm2(n, vt->d, 1);
+        matrix_set_colm_scaled(V, k, vt, nv);
+        start = k;
+        bcur = k + next;
+        STATS_TOC(stats, SVDS_PHASE_RITZ, t_copy, 0, 16.0*((double)m + n)*kl);
+        int due = ck && ck->path && omp_get_wtime() - ck->last >= ck->interval;
+        if (ck && ck->path && op.A.reduce)
+        {
+            double d = due;
+            op.A.reduce(op.rctx, &d, 1);
+            due = d > 0;
+        }
+        if (due)
+            checkpoint_save(ck, U, V, k, alpha, beta, gamma, sv, b, iters, L, bcur, conv_prev, pro.anorm, op_nnz, op_sum);
+    }
+    if (ck)
+        checkpoint_wait(ck);
+    // a triplet found after the locking may rank above a locked one
+    for(i = 1; i < k; i++)
+    {
+        int j;
+        for(j = i; j > 0 && Sk->d[j] > Sk->d[j-1]; j--)
+        {
+            double t = Sk->d[j];
+            Sk->d[j] = Sk->d[j-1];
+            Sk->d[j-1] = t;
+            cblas_dswap(m, Uk->d + (long long)j*m, 1, Uk->d + (long long)(j-1)*m, 1);
+            cblas_dswap(n, Vk->d + (long long)j*n, 1, Vk->d + (long long)(j-1)*n, 1);
+        }
+    }
+#ifdef SVDS_STATS
+    if (stats)
+    {
+        stats->restarts = iters - 1;
+        stats->locked = L;
+    }
+#endif
+}
+
+#ifdef SVD_USE_CUDA
+#include "svds_cuda.inc"
+#endif
+
+/* the backends a Lanczos solve can run on; lanczos is NULL for the CPU
+   (svds_lanczos_core) and for a backend this build does not include */
+typedef struct {
+    const char *name;
+    int (*available)(void);
+    int (*lanczos)(const mat *Ad, const mat_csr *As, const double *v0, int k, double eps, int maxbasis, int maxiter, double time_budget, mat *Uk, mat *Sk, mat *Vk, int *nconv, svds_stats *stats);
+} svds_backend_ops;
+
+static const svds_backend_ops backends[SVDS_NBACKENDS] = {
+    {"cpu", NULL, NULL},
+#ifdef SVD_USE_CUDA
+    {"cuda", svds_cuda_available, svds_cuda_lanczos},
+#else
+    {"cuda", NULL, NULL},
+#endif
+};
+
+static svds_backend current_backend = SVDS_BACKEND_CPU;
+
+int svds_set_backend(svds_backend b)
+{
+    if (b < 0 || b >= SVDS_NBACKENDS)
+        return 1;
+    if (b != SVDS_BACKEND_CPU && (!backends[b].lanczos || !backends[b].available()))
+        return 1;
+    current_backend = b;
+    return 0;
+}
+
+svds_backend svds_get_backend(void)
+{
+    return current_backend;
+}
+
+const char * svds_backend_name(svds_backend b)
+{
+    return b >= 0 && b < SVDS_NBACKENDS ? backends[b].name : "?";
+}
+
+/* when ws is missing or too small, a temporary workspace is made and its
+   result buffers are handed out as ordinary matrices */
+static void svds_lanczos_solve(lanczos_op op, mat **Uk, mat **Sk, mat **Vk, int k, double eps, int maxbasis, int maxiter, double time_budget, svds_reorth reorth, svds_workspace *ws, svds_stats *stats)
+{
+    const int m = (int)op.m, n = (int)op.n;
+    svds_workspace *own = NULL;
+    if (ws && !svds_workspace_fits(ws, m, n, k, maxbasis))
+    {
+        fprintf(stderr, "svds: workspace does not fit a %d x %d solve with k=%d, maxbasis=%d; using a temporary one\n", m, n, k, maxbasis);
+        ws = NULL;
+    }
+
+    if (stats)
+    {
+        memset(stats, 0, sizeof(*stats));
+#ifdef SVDS_STATS
+        stats->enabled = 1;
+        stats->total_seconds = omp_get_wtime();
+#endif
+    }
+    const svds_backend_ops *be = &backends[current_backend];
+    if (be->lanczos && (op.fmt == OP_DENSE || op.fmt == OP_CSR) && !op.center && !op.A.reduce && !(ws && ws->ckpt))
+    {
+        // the device keeps its own bases; only the results use ws
+        mat *U = ws ? &ws->Uk : matrix_new(m, k), *S = ws ? &ws->Sk : matrix_new(k, 1), *V = ws ? &ws->Vk : matrix_new(n, k);
+        U->ncols = V->ncols = k;
+        S->nrows = k;
+        const double *v0 = ws && ws->warm ? ws->vt.d : NULL;
+        int nconv = 0;
+        if (ws)
+            ws->warm = 0;
+        if (be->lanczos(op.fmt == OP_DENSE ? (const mat*)op.M : NULL, op.fmt == OP_CSR ? (const mat_csr*)op.M : NULL,
+                        v0, k, eps, maxbasis, maxiter, time_budget, U, S, V, &nconv, stats) == 0)
+        {
+            if (ws)
+                ws->nconv = nconv;
+#ifdef SVDS_STATS
+            if (stats)
+                stats->total_seconds = omp_get_wtime() - stats->total_seconds;
+#endif
+            *Uk = U;
+            *Sk = S;
+            *Vk = V;
+            return;
+        }
+        fprintf(stderr, "svds: the %s backend failed, solving on the CPU\n", be->name);
+        if (!ws)
+        {
+            matrix_delete(U);
+            matrix_delete(S);
+            matrix_delete(V);
+        }
+    }
+    if (!ws)
+        ws = own = svds_workspace_new(m, n, k, maxbasis);
+    svds_lanczos_core(op, k, eps, maxbasis, maxiter, time_budget, reorth, ws, stats);
+#ifdef SVDS_STATS
+    if (stats)
+        stats->total_seconds = omp_get_wtime() - stats->total_seconds;
+#endif
+
+    if (!own)
+    {
+        *Uk = &ws->Uk;
+        *Sk = &ws->Sk;
+        *Vk = &ws->Vk;
+        return;
+    }
+    *Uk = (mat*)malloc(sizeof(mat));
+    *Sk = (mat*)malloc(sizeof(mat));
+    *Vk = (mat*)malloc(sizeof(mat));
+    **Uk = own->Uk;
+    **Sk = own->Sk;
+    **Vk = own->Vk;
+    own->Uk.d = own->Sk.d = own->Vk.d = NULL;
+    svds_workspace_delete(own);
+}
+
+void svds_C_dense(mat *A, mat **Uk, mat **Sk, mat **Vk, int k)
+{
+    svds_C_dense_opt(A, Uk, Sk, Vk, k, 1e-10, max(3*k, 15), 10, 0, SVDS_REORTH_FULL, NULL, NULL);
+}
+
+/* the m x n matrix M of a built-in format as the solver's operand. The
+   nominal cost of a product: every stored entry is read once and
+   multiplied-added, plus the three vectors. */
+static lanczos_op lanczos_op_for(lanczos_format fmt, const void *M, int m, int n)
+{
+    static void (*const products[][2])(void*, const double*, double*) = {
+        {NULL, NULL},
+        {op_dense_matvec, op_dense_rmatvec},
+        {op_csr_matvec, op_csr_rmatvec},
+        {op_dense_f_matvec, op_dense_f_rmatvec},
+        {op_csr_f_matvec, op_csr_f_rmatvec},
+        {op_sell_matvec, op_sell_rmatvec},
+    };
+    lanczos_op op;
+    memset(&op, 0, sizeof(op));
+    op.fmt = fmt;
+    op.M = M;
+    op.m = m;
+    op.n = n;
+    op.A.m = m;
+    op.A.n = n;
+    op.A.matvec = products[fmt][0];
+    op.A.rmatvec = products[fmt][1];
+    const double vecs = 8.0 * (2.0*m + n);
+    switch (fmt) {
+    case OP_CSR:
+        op.A.nnz = ((const mat_csr*)M)->nnz;
+        op.bytes = 12.0 * op.A.nnz + 16.0 * m + vecs;
+        break;
+    case OP_CSR_F:
+        op.A.nnz = ((const mat_csr_f*)M)->nnz;
+        op.bytes = 8.0 * op.A.nnz + 16.0 * m + vecs;
+        break;
+    case OP_SELL:   // the padding is streamed too
+        op.A.nnz = ((const mat_sell*)M)->nnz;
+        op.bytes = 12.0 * ((const mat_sell*)M)->chunk_ptr[((const mat_sell*)M)->nchunks] + 4.0 * m + vecs;
+        break;
+    default:
+        op.A.nnz = (long long)m * n;
+        op.bytes = (fmt == OP_DENSE_F ? 4.0 : 8.0) * m * n + vecs;
+        break;
+    }
+    op.flops = 2.0 * op.A.nnz;
+    return op;
+}
+
+/* a caller's operator; without nnz it costs as dense, with it as CSR */
+static lanczos_op lanczos_op_callback(const svds_operator *A)
+{
+    lanczos_op op;
+    memset(&op, 0, sizeof(op));
+    op.A = *A;
+    op.fmt = OP_CALLBACK;
+    op.rctx = A->ctx;
+    op.m = A->m;
+    op.n = A->n;
+    const double vecs = 8.0 * (2.0*A->m + A->n);
+    op.flops = 2.0 * (A->nnz > 0 ? (double)A->nnz : (double)A->m * A->n);
+    op.bytes = A->nnz > 0 ? 12.0 * A->nnz + 16.0 * A->m + vecs : 8.0 * A->m * A->n + vecs;
+    return op;
+}
+
+void svds_C_dense_opt(mat *A, mat **Uk, mat **Sk, mat **Vk, int k, double eps, int maxbasis, int maxiter, double time_budget, svds_reorth reorth, svds_workspace *ws, svds_stats *stats)
+{
+    svds_lanczos_solve(lanczos_op_for(OP_DENSE, A, A->nrows, A->ncols), Uk, Sk, Vk, k, eps, maxbasis, maxiter, time_budget, reorth, ws, stats);
+}
+
+void svds_C(mat_csr *A, mat **Uk, mat **Sk, mat **Vk, int k)
+{
+    svds_C_opt(A, Uk, Sk, Vk, k, 1e-10, max(3*k, 15), 10, 0, SVDS_REORTH_FULL, NULL, NULL);
+}
+
+void svds_C_opt(mat_csr *A, mat **Uk, mat **Sk, mat **Vk, int k, double eps, int maxbasis, int maxiter, double time_budget, svds_reorth reorth, svds_workspace *ws, svds_stats *stats)
+{
+    svds_lanczos_solve(lanczos_op_for(OP_CSR, A, A->nrows, A->ncols), Uk, Sk, Vk, k, eps, maxbasis, maxiter, time_budget, reorth, ws, stats);
+}
+
+void svds_C_sell(mat_sell *A, mat **Uk, mat **Sk, mat **Vk, int k)
+{
+    svds_C_sell_opt(A, Uk, Sk, Vk, k, 1e-10, max(3*k, 15), 10, 0, SVDS_REORTH_FULL, NULL, NULL);
+}
+
+void svds_C_sell_opt(mat_sell *A, mat **Uk, mat **Sk, mat **Vk, int k, double eps, int maxbasis, int maxiter, double time_budget, svds_reorth reorth, svds_workspace *ws, svds_stats *stats)
+{
+    svds_lanczos_solve(lanczos_op_for(OP_SELL, A, A->nrows, A->ncols), Uk, Sk, Vk, k, eps, maxbasis, maxiter, time_budget, reorth, ws, stats);
+}
+
+void svds_C_centered(mat_csr *A, const svds_centering *c, mat **Uk, mat **Sk, mat **Vk, int k)
+{
+    svds_C_centered_opt(A, c, Uk, Sk, Vk, k, 1e-10, max(3*k, 15), 10, 0, SVDS_REORTH_FULL, NULL, NULL);
+}
+
+void svds_C_centered_opt(mat_csr *A, const svds_centering *c, mat **Uk, mat **Sk, mat **Vk, int k, double eps, int maxbasis, int maxiter, double time_budget, svds_reorth reorth, svds_workspace *ws, svds_stats *stats)
+{
+    lanczos_op op = lanczos_op_for(OP_CSR, A, A->nrows, A->ncols);
+    op.center = c;
+    svds_lanczos_solve(op, Uk, Sk, Vk, k, eps, maxbasis, maxiter, time_budget, reorth, ws, stats);
+}
+
+void svds_C_dist_opt(mat_csr *A, void (*reduce)(void *ctx, double *buf, int n), void *ctx, mat **Uk, mat **Sk, mat **Vk, int k, double eps, int maxbasis, int maxiter, double time_budget, svds_reorth reorth, svds_workspace *ws, svds_stats *stats)
+{
+    lanczos_op op = lanczos_op_for(OP_CSR, A, A->nrows, A->ncols);
+    op.A.reduce = reduce;
+    op.rctx = ctx;
+    svds_lanczos_solve(op, Uk, Sk, Vk, k, eps, maxbasis, maxiter, time_budget, reorth, ws, stats);
+}
+
+void svds_C_dense_dist_opt(mat *A, void (*reduce)(void *ctx, double *buf, int n), void *ctx, mat **Uk, mat **Sk, mat **Vk, int k, double eps, int maxbasis, int maxiter, double time_budget, svds_reorth reorth, svds_workspace *ws, svds_stats *stats)
+{
+    lanczos_op op = lanczos_op_for(OP_DENSE, A, A->nrows, A->ncols);
+    op.A.reduce = reduce;
+    op.rctx = ctx;
+    svds_lanczos_solve(op, Uk, Sk, Vk, k, eps, maxbasis, maxiter, time_budget, reorth, ws, stats);
+}
+
+void svds_C_op(const svds_operator *A, mat **Uk, mat **Sk, mat **Vk, int k)
+{
+    svds_C_op_opt(A, Uk, Sk, Vk, k, 1e-10, max(3*k, 15), 10, 0, SVDS_REORTH_FULL, NULL, NULL);
+}
+
+void svds_C_op_opt(const svds_operator *A, mat **Uk, mat **Sk, mat **Vk, int k, double eps, int maxbasis, int maxiter, double time_budget, svds_reorth reorth, svds_workspace *ws, svds_stats *stats)
+{
+    svds_lanczos_solve(lanczos_op_callback(A), Uk, Sk, Vk, k, eps, maxbasis, maxiter, time_budget, reorth, ws, stats);
+}
+
+/* the Lanczos solve of one batch item on the calling thread's team */
+static void svds_batch_solve(svds_batch_item *it, int index, double eps, int maxiter, svds_reorth reorth)
+{
+    const int m = it->A->nrows, n = it->A->ncols;
+    const int b = min(max(3*it->k, 15), min(m, n));
+    double t = omp_get_wtime();
+    it->Uk = it->Sk = it->Vk = NULL;
+    it->seconds = 0;
+    it->status = it->k < 1 || it->k >= b;
+    if (it->status)
+        return;
+    svds_workspace *ws = svds_workspace_new(m, n, it->k, b);
+    unsigned int seed = 2654435761u * (unsigned int)(index + 1);
+    initialize_random_vector_r(&ws->vt, &seed);
+    ws->warm = 1;
+    svds_lanczos_core(lanczos_op_for(OP_CSR, it->A, m, n), it->k, eps, b, maxiter, 0, reorth, ws, NULL);
+    it->Uk = (mat*)malloc(sizeof(mat));
+    it->Sk = (mat*)malloc(sizeof(mat));
+    it->Vk = (mat*)malloc(sizeof(mat));
+    *it->Uk = ws->Uk;
+    *it->Sk = ws->Sk;
+    *it->Vk = ws->Vk;
+    ws->Uk.d = ws->Sk.d = ws->Vk.d = NULL;
+    svds_workspace_delete(ws);
+    it->seconds = omp_get_wtime() - t;
+}
+
+typedef struct {
+    long long nnz;
+    int item;
+} batch_order;
+
+static int batch_order_cmp(const void *a, const void *b)
+{
+    const batch_order *p = (const batch_order*)a, *q = (const batch_order*)b;
+    if (p->nnz != q->nnz)
+        return p->nnz > q->nnz ? -1 : 1;
+    return p->item - q->item;
+}
+
+int svds_C_batch(svds_batch_item *items, int nitems, double eps, int maxiter, svds_reorth reorth, long long split_nnz)
+{
+    int i, nsmall = 0, failed = 0;
+    if (split_nnz <= 0)
+        split_nnz = 1LL << 20;
+    batch_order *order = (batch_order*)malloc(max(nitems, 1) * sizeof(batch_order));
+    for (i = 0; i < nitems; i++)
+    {
+        order[i].nnz = items[i].A->nnz;
+        order[i].item = i;
+    }
+    qsort(order, nitems, sizeof(batch_order), batch_order_cmp);
+
+    // large items: the whole team, threaded BLAS included
+    for (i = 0; i < nitems && order[i].nnz >= split_nnz; i++)
+        svds_batch_solve(&items[order[i].item], order[i].item, eps, maxiter, reorth);
+    nsmall = nitems - i;
+
+#ifdef OPENBLAS_VERSION
+    const int blas_threads = openblas_get_num_threads();
+    openblas_set_num_threads(1);
+#endif
+    #pragma omp parallel
+    #pragma omp single
+    {
+        int j;
+        for (j = nitems - nsmall; j < nitems; j++)
+        {
+            #pragma omp task firstprivate(j)
+            {
+                omp_set_num_threads(1); // the solve's own regions run on this thread
+                svds_batch_solve(&items[order[j].item], order[j].item, eps, maxiter, reorth);
+            }
+        }
+    }
+#ifdef OPENBLAS_VERSION
+    openblas_set_num_threads(blas_threads);
+#endif
+
+    for (i = 0; i < nitems; i++)
+        failed += items[i].status != 0;
+    free(order);
+    return failed;
+}
+
+void svds_C_mixed(mat_csr_f *A, mat **Uk, mat **Sk, mat **Vk, int k)
+{
+    svds_C_mixed_opt(A, Uk, Sk, Vk, k, 1e-10, max(3*k, 15), 10, 0, SVDS_REORTH_FULL, NULL, NULL);
+}
+
+void svds_C_mixed_opt(mat_csr_f *A, mat **Uk, mat **Sk, mat **Vk, int k, double eps, int maxbasis, int maxiter, double time_budget, svds_reorth reorth, svds_workspace *ws, svds_stats *stats)
+{
+    svds_lanczos_solve(lanczos_op_for(OP_CSR_F, A, A->nrows, A->ncols), Uk, Sk, Vk, k, eps, maxbasis, maxiter, time_budget, reorth, ws, stats);
+}
+
+void svds_C_dense_mixed(mat_f *A, mat **Uk, mat **Sk, mat **Vk, int k)
+{
+    svds_C_dense_mixed_opt(A, Uk, Sk, Vk, k, 1e-10, max(3*k, 15), 10, 0, SVDS_REORTH_FULL, NULL, NULL);
+}
+
+void svds_C_dense_mixed_opt(mat_f *A, mat **Uk, mat **Sk, mat **Vk, int k, double eps, int maxbasis, int maxiter, double time_budget, svds_reorth reorth, svds_workspace *ws, svds_stats *stats)
+{
+    svds_lanczos_solve(lanczos_op_for(OP_DENSE_F, A, A->nrows, A->ncols), Uk, Sk, Vk, k, eps, maxbasis, maxiter, time_budget, reorth, ws, stats);
+}
+
+/* the operand of the block solvers: one of Ad, As, St, or LU*LV^T + As
+   (LU set, As may be NULL; svds_update). A stream keeps its first I/O
+   error, after which the products are skipped and the solve runs to its
+   end on garbage; the stream entry points return it. */
+typedef struct {
+    mat *Ad;
+    mat_csr *As;
+    matrix_stream *St;
+    mat *LU, *LV;
+} block_op;
+
+/* W = LU*(LV^T*X) + beta*W */
+static void lowrank_matvec(mat *LU, mat *LV, mat *X, double beta, mat *W)
+{
+    mat *T = matrix_new(LV->ncols, X->ncols);
+    matrix_transpose_matrix_mult(LV, X, T);
+    cblas_dgemm(CblasColMajor, CblasNoTrans, CblasNoTrans, W->nrows, W->ncols, LU->ncols, 1.0, LU->d, LU->nrows, T->d, T->nrows, beta, W->d, W->nrows);
+    matrix_delete(T);
+}
+
+static void block_matvec(block_op op, mat *X, mat *W)
+{
+    if (op.LU) {
+        if (op.As)
+            csr_matrix_matrix_mult(op.As, X, W);
+        lowrank_matvec(op.LU, op.LV, X, op.As ? 1.0 : 0.0, W);
+    } else if (op.St)
+        matrix_stream_mult(op.St, X, W);
+    else if (op.As)
+        csr_matrix_matrix_mult(op.As, X, W);
+    else
+        matrix_matrix_mult(op.Ad, X, W);
+}
+
+/* W = A^T*X for the dense, the CSR or the streamed operand */
+static void block_matvec_transpose(block_op op, mat *X, mat *W)
+{
+    if (op.LU) {
+        if (op.As)
+            csr_matrix_transpose_matrix_mult(op.As, X, W);
+        lowrank_matvec(op.LV, op.LU, X, op.As ? 1.0 : 0.0, W);
+    } else if (op.St)
+        matrix_stream_transpose_mult(op.St, X, W);
+    else if (op.As)
+        csr_matrix_transpose_matrix_mult(op.As, X, W);
+    else
+        matrix_transpose_matrix_mult(op.Ad, X, W);
+}
+
+/* W = W - Q*(Q^T*W) applied twice (CGS2); C receives the accumulated
+   coefficients Q^T*W of the original block, T is a scratch of C's size */
+static void block_x_minus_QQTx(mat *Q, mat *W, mat *C, mat *T)
+{
+    int pass;
+    long long i;
+    for(pass = 0; pass < 2; ++pass)
+    {
+        matrix_transpose_matrix_mult(Q, W, T);
+        cblas_dgemm(CblasColMajor, CblasNoTrans, CblasNoTrans, W->nrows, W->ncols, Q->ncols, -1.0, Q->d, Q->nrows, T->d, T->nrows, 1.0, W->d, W->nrows);
+        for(i = 0; i < (long long)C->nrows*C->ncols; ++i)
+            C->d[i] = (pass == 0) ? T->d[i] : C->d[i] + T->d[i];
+    }
+}
+
+/* a column range [j0, j0+ncols) of M viewed as a matrix, no copy */
+static mat matrix_col_view(mat *M, int j0, int ncols)
+{
+    mat view;
+    view.nrows = M->nrows;
+    view.ncols = ncols;
+    view.d = M->d + (long long)j0*M->nrows;
+    return view;
+}
+
+/*
+ * Block Golub-Kahan bidiagonalization with thick restart.
+ * Every pass over A multiplies a block of p vectors (GEMM / SpMM) instead of
+ * a single one, and B = U^T*A*V is assembled from the block
+ * reorthogonalization coefficients. A restart keeps kr = k + p Ritz pairs
+ * (k if the basis has no room for them), U = [Ur], V = [Vr, Vres] with Vres
+ * the last residual block, so the same expansion loop continues; the basis
+ * is cut down to k plus whole blocks so that no restart leaves columns
+ * unused. Returns the number of converged triplets.
+ */
+static int svds_block_core(block_op op, int m, int n, mat **Uk, mat **Sk, mat **Vk, int k, int p, double eps, int maxbasis, int maxiter)
+{
+    const int b = k + max((maxbasis - k)/p, 1)*p;
+    int i, j;
+    mat *U = matrix_new(m, b);
+    mat *V = matrix_new(n, b + p);
+    mat *B = matrix_new(b, b);
+    mat *W = matrix_new(m, p);
+    mat *Z = matrix_new(n, p);
+    mat *R = matrix_new(p, p);
+    mat *Slast = matrix_new(p, p);
+    mat *C = matrix_new(b + p, p);
+    mat *T = matrix_new(b + p, p);
+    // the restart keeps one block of Ritz vectors beyond k when there is room
+    const int kr = (k + 2*p <= b) ? k + p : k;
+    mat *G = matrix_new(p, kr);
+    mat *XU = matrix_new(m, kr);
+    mat *XV = matrix_new(n, kr);
+    vec *Sr = vector_new(kr);
+
+    // first block of V: orthonormalized random vectors
+    mat V0 = matrix_col_view(V, 0, p);
+    initialize_random_matrix_double(&V0);
+    compact_QR_factorization(&V0, &V0, R);
+
+    (*Sk) = matrix_new(k, 1);
+    (*Uk) = matrix_new(m, k);
+    (*Vk) = matrix_new(n, k);
+    int cu = 0;
+    int iters = 0;
+    int flag = 0;
+    while(iters < maxiter)
+    {
+        // expand until the U basis cannot take another block
+        while(cu + p <= b)
+        {
+            mat Vb = matrix_col_view(V, cu, p);
+            block_matvec(op, &Vb, W);
+            if (cu > 0)
+            {
+                mat Uv = matrix_col_view(U, 0, cu);
+                C->nrows = cu; T->nrows = cu;
+                block_x_minus_QQTx(&Uv, W, C, T);
+                for(j = 0; j < p; j++)
+                    for(i = 0; i < cu; i++)
+                        matrix_set_element(B, i, cu + j, matrix_get_element(C, i, j));
+            }
+            mat Ub = matrix_col_view(U, cu, p);
+            compact_QR_factorization(W, &Ub, R);
+            for(j = 0; j < p; j++)
+                for(i = 0; i < p; i++)
+                    matrix_set_element(B, cu + i, cu + j, matrix_get_element(R, i, j));
+
+            block_matvec_transpose(op, &Ub, Z);
+            mat Vv = matrix_col_view(V, 0, cu + p);
+            C->nrows = cu + p; T->nrows = cu + p;
+            block_x_minus_QQTx(&Vv, Z, C, T);
+            mat Vn = matrix_col_view(V, cu + p, p);
+            compact_QR_factorization(Z, &Vn, Slast);
+            cu += p;
+        }
+
+        // Ritz triplets of the cu x cu block upper triangular B
+        mat *Bs = matrix_new(cu, cu);
+        mat *UB = matrix_new(cu, cu);
+        mat *SB = matrix_new(cu, cu);
+        mat *VBt = matrix_new(cu, cu);
+        for(j = 0; j < cu; j++)
+            for(i = 0; i < cu; i++)
+                matrix_set_element(Bs, i, j, matrix_get_element(B, i, j));
+        singular_value_decomposition(Bs, UB, SB, VBt);
+
+        mat *UBk = matrix_new(cu, kr);
+        mat *VBk = matrix_new(cu, kr);
+        for(j = 0; j < kr; j++)
+        {
+            Sr->d[j] = matrix_get_element(SB, j, j);
+            if (j < k)
+                (*Sk)->d[j] = Sr->d[j];
+            for(i = 0; i < cu; i++)
+            {
+                matrix_set_element(UBk, i, j, matrix_get_element(UB, i, j));
+                matrix_set_element(VBk, i, j, matrix_get_element(VBt, j, i));
+            }
+        }
+        mat Uv = matrix_col_view(U, 0, cu);
+        mat Vv = matrix_col_view(V, 0, cu);
+        matrix_matrix_mult(&Uv, UBk, XU);
+        matrix_matrix_mult(&Vv, VBk, XV);
+        memcpy((*Uk)->d, XU->d, (size_t)m*k*sizeof(double));
+        memcpy((*Vk)->d, XV->d, (size_t)n*k*sizeof(double));
+
+        // A^T*Uk - Vk*Sk = Vr*G with G = Slast*UBk(last block rows, :)
+        cblas_dgemm(CblasColMajor, CblasNoTrans, CblasNoTrans, p, kr, p, 1.0, Slast->d, p, UBk->d + cu - p, cu, 0.0, G->d, p);
+        flag = 0;
+        for(j = 0; j < k; j++)
+        {
+            double gj = cblas_dnrm2(p, G->d + (long long)j*p, 1);
+            flag += (gj < eps*(*Sk)->d[j]);
+        }
+        matrix_delete(Bs);
+        matrix_delete(UB);
+        matrix_delete(SB);
+        matrix_delete(VBt);
+        matrix_delete(UBk);
+        matrix_delete(VBk);
+        iters++;
+        if (flag == k || iters >= maxiter)
+            break;
+
+        // thick restart: U = Ur, V = [Vr, Vres], B = [diag(Sr) 0]
+        memcpy(U->d, XU->d, (size_t)m*kr*sizeof(double));
+        memcpy(V->d, XV->d, (size_t)n*kr*sizeof(double));
+        memmove(V->d + (long long)kr*n, V->d + (long long)cu*n, (size_t)n*p*sizeof(double));
+        memset(B->d, 0, (size_t)b*b*sizeof(double));
+        for(j = 0; j < kr; j++)
+            matrix_set_element(B, j, j, Sr->d[j]);
+        cu = kr;
+    }
+
+    matrix_delete(U);
+    matrix_delete(V);
+    matrix_delete(B);
+    matrix_delete(W);
+    matrix_delete(Z);
+    matrix_delete(R);
+    matrix_delete(Slast);
+    matrix_delete(C);
+    matrix_delete(T);
+    matrix_delete(G);
+    matrix_delete(XU);
+    matrix_delete(XV);
+    vector_delete(Sr);
+    return flag;
+}
+
+int svds_block_basis(int m, int n, int k, int blocksize)
+{
+    int nb = 1 + max(4, (2*k + blocksize - 1)/blocksize);
+    // U needs b columns in R^m, V b + blocksize in R^n
+    int room = (min(m, n - blocksize) - k)/blocksize;
+    if (room >= 1 && nb > room)
+        nb = room;
+    return k + nb*blocksize;
+}
+
+static block_op block_op_for(mat *Ad, mat_csr *As, matrix_stream *St)
+{
+    block_op op;
+    op.Ad = Ad;
+    op.As = As;
+    op.St = St;
+    op.LU = op.LV = NULL;
+    return op;
+}
+
+void svds_C_block_opt(mat_csr *A, mat **Uk, mat **Sk, mat **Vk, int k, int blocksize, double eps, int maxbasis, int maxiter, int *nconv)
+{
+    int c = svds_block_core(block_op_for(NULL, A, NULL), A->nrows, A->ncols, Uk, Sk, Vk, k, blocksize, eps, maxbasis, maxiter);
+    if (nconv)
+        *nconv = c;
+}
+
+void svds_C_block(mat_csr *A, mat **Uk, mat **Sk, mat **Vk, int k, int blocksize)
+{
+    svds_C_block_opt(A, Uk, Sk, Vk, k, blocksize, 1e-10, svds_block_basis(A->nrows, A->ncols, k, blocksize), 20, NULL);
+}
+
+void svds_C_dense_block_opt(mat *A, mat **Uk, mat **Sk, mat **Vk, int k, int blocksize, double eps, int maxbasis, int maxiter, int *nconv)
+{
+    int c = svds_block_core(block_op_for(A, NULL, NULL), A->nrows, A->ncols, Uk, Sk, Vk, k, blocksize, eps, maxbasis, maxiter);
+    if (nconv)
+        *nconv = c;
+}
+
+void svds_C_dense_block(mat *A, mat **Uk, mat **Sk, mat **Vk, int k, int blocksize)
+{
+    svds_C_dense_block_opt(A, Uk, Sk, Vk, k, blocksize, 1e-10, svds_block_basis(A->nrows, A->ncols, k, blocksize), 20, NULL);
+}
+
+int svds_C_stream_block_opt(matrix_stream *A, mat **Uk, mat **Sk, mat **Vk, int k, int blocksize, double eps, int maxbasis, int maxiter, int *nconv)
+{
+    int c = svds_block_core(block_op_for(NULL, NULL, A), A->nrows, A->ncols, Uk, Sk, Vk, k, blocksize, eps, maxbasis, maxiter);
+    if (nconv)
+        *nconv = c;
+    return A->error;
+}
+
+int svds_C_stream_block(matrix_stream *A, mat **Uk, mat **Sk, mat **Vk, int k, int blocksize)
+{
+    return svds_C_stream_block_opt(A, Uk, Sk, Vk, k, blocksize, 1e-10, svds_block_basis(A->nrows, A->ncols, k, blocksize), 20, NULL);
+}
+
+/*
+ * Randomized SVD (range finder with power iterations).
+ * A Gaussian sketch of l = k + oversample columns is pushed through A, then
+ * q power iterations with QR re-orthonormalization sharpen the range basis
+ * Q. The factorization finishes with a small dense SVD of B^T = A^T*Q.
+ * The cost is a fixed 2q+2 block passes over A; accuracy depends on the
+ * spectral decay, not on a convergence tolerance.
+ * With start set, its columns (zero rows appended up to n) replace the
+ * first columns of the sketch (svds_update).
+ */
+static void svds_randomized_core(block_op op, int m, int n, mat **Uk, mat **Sk, mat **Vk, int k, int oversample, int q, const mat *start)
+{
+    int i, j, it;
+    const int l = min(k + max(oversample, 0), min(m, n));
+    mat *Omega = matrix_new(n, l);
+    mat *Q = matrix_new(m, l);
+    mat *Z = matrix_new(n, l);
+    mat *R = matrix_new(l, l);
+
+    initialize_random_matrix_gaussian(Omega);
+    if (start) {
+        for(j = 0; j < min(start->ncols, l); j++)
+            for(i = 0; i < n; i++)
+                Omega->d[(long long)j*n + i] = i < start->nrows ? start->d[(long long)j*start->nrows + i] : 0.0;
+    }
+    block_matvec(op, Omega, Q);
+    compact_QR_factorization(Q, Q, R);
+    for(it = 0; it < q; ++it)
+    {
+        block_matvec_transpose(op, Q, Z);
+        compact_QR_factorization(Z, Z, R);
+        block_matvec(op, Z, Q);
+        compact_QR_factorization(Q, Q, R);
+    }
+
+    // B^T = A^T*Q = W*S*X^T, so A ~ Q*B = (Q*X)*S*W^T
+    block_matvec_transpose(op, Q, Z);
+    mat *W = matrix_new(n, l);
+    mat *S = matrix_new(l, l);
+    mat *Xt = matrix_new(l, l);
+    singular_value_decomposition(Z, W, S, Xt);
+
+    mat *Xk = matrix_new(l, k);
+    for(j = 0; j < k; j++)
+        for(i = 0; i < l; i++)
+            matrix_set_element(Xk, i, j, matrix_get_element(Xt, j, i));
+    (*Uk) = matrix_new(m, k);
+    matrix_matrix_mult(Q, Xk, *Uk);
+    (*Vk) = matrix_new(n, k);
+    memcpy((*Vk)->d, W->d, (size_t)n*k*sizeof(double));
+    (*Sk) = matrix_new(k, 1);
+    for(j = 0; j < k; j++)
+        (*Sk)->d[j] = matrix_get_element(S, j, j);
+
+    matrix_delete(Omega);
+    matrix_delete(Q);
+    matrix_delete(Z);
+    matrix_delete(R);
+    matrix_delete(W);
+    matrix_delete(S);
+    matrix_delete(Xt);
+    matrix_delete(Xk);
+}
+
+void svds_C_randomized(mat_csr *A, mat **Uk, mat **Sk, mat **Vk, int k, int oversample, int power_iters)
+{
+    svds_randomized_core(block_op_for(NULL, A, NULL), A->nrows, A->ncols, Uk, Sk, Vk, k, oversample, power_iters, NULL);
+}
+
+void svds_C_dense_randomized(mat *A, mat **Uk, mat **Sk, mat **Vk, int k, int oversample, int power_iters)
+{
+    svds_randomized_core(block_op_for(A, NULL, NULL), A->nrows, A->ncols, Uk, Sk, Vk, k, oversample, power_iters, NULL);
+}
+
+int svds_C_stream_randomized(matrix_stream *A, mat **Uk, mat **Sk, mat **Vk, int k, int oversample, int power_iters)
+{
+    svds_randomized_core(block_op_for(NULL, NULL, A), A->nrows, A->ncols, Uk, Sk, Vk, k, oversample, power_iters, NULL);
+    return A->error;
+}
+
+/*
+ * Brand's update of A = U*diag(s)*V^T (U m x k, V n x k orthonormal) by
+ * E*Y^T, E the r columns of the identity at idx and Y n x r: with
+ * E = U*C + P*RP and Y = V*M + Q*RQ (block CGS2, then QR of the residuals)
+ * A + E*Y^T = [U P] * [diag(s) + C*M^T, C*RQ^T; RP*M^T, RP*RQ^T] * [V Q]^T,
+ * so the SVD of that (k+r) x (k+r) core gives the exact factors. Y is
+ * overwritten; needs k + r <= min(m, n).
+ */
+static void brand_update(mat *U, const double *s, mat *V, const int *idx, int r, mat *Y, mat **Uk, mat **Sk, mat **Vk)
+{
+    const int m = U->nrows, n = V->nrows, k = U->ncols, l = k + r;
+    int i, j;
+    mat *P = matrix_new(m, r);
+    mat *C = matrix_new(k, r);
+    mat *M = matrix_new(k, r);
+    mat *T = matrix_new(k, r);
+    mat *RP = matrix_new(r, r);
+    mat *RQ = matrix_new(r, r);
+    for (j = 0; j < r; j++)
+        matrix_set_element(P, idx[j], j, 1.0);
+    block_x_minus_QQTx(U, P, C, T);
+    compact_QR_factorization(P, P, RP);
+    block_x_minus_QQTx(V, Y, M, T);
+    compact_QR_factorization(Y, Y, RQ);
+
+    // the core is L*R^T with L = [diag(s) C; 0 RP] and R = [I M; 0 RQ]
+    mat *L = matrix_new(l, l);
+    mat *R = matrix_new(l, l);
+    for (j = 0; j < k; j++) {
+        matrix_set_element(L, j, j, s[j]);
+        matrix_set_element(R, j, j, 1.0);
+    }
+    for (j = 0; j < r; j++) {
+        for (i = 0; i < k; i++) {
+            matrix_set_element(L, i, k + j, matrix_get_element(C, i, j));
+            matrix_set_element(R, i, k + j, matrix_get_element(M, i, j));
+        }
+        for (i = 0; i < r; i++) {
+            matrix_set_element(L, k + i, k + j, matrix_get_element(RP, i, j));
+            matrix_set_element(R, k + i, k + j, matrix_get_element(RQ, i, j));
+        }
+    }
+    mat *K = matrix_new(l, l);
+    cblas_dgemm(CblasColMajor, CblasNoTrans, CblasTrans, l, l, l, 1.0, L->d, l, R->d, l, 0.0, K->d, l);
+    mat *X = matrix_new(l, l);
+    mat *S = matrix_new(l, l);
+    mat *Wt = matrix_new(l, l);
+    singular_value_decomposition(K, X, S, Wt);
+
+    // Uk = [U P]*X(:, 1:k), Vk = [V Q]*W(:, 1:k)
+    (*Uk) = matrix_new(m, k);
+    (*Vk) = matrix_new(n, k);
+    (*Sk) = matrix_new(k, 1);
+    for (j = 0; j < k; j++)
+        (*Sk)->d[j] = matrix_get_element(S, j, j);
+    cblas_dgemm(CblasColMajor, CblasNoTrans, CblasNoTrans, m, k, k, 1.0, U->d, m, X->d, l, 0.0, (*Uk)->d, m);
+    cblas_dgemm(CblasColMajor, CblasNoTrans, CblasNoTrans, m, k, r, 1.0, P->d, m, X->d + k, l, 1.0, (*Uk)->d, m);
+    cblas_dgemm(CblasColMajor, CblasNoTrans, CblasTrans, n, k, k, 1.0, V->d, n, Wt->d, l, 0.0, (*Vk)->d, n);
+    cblas_dgemm(CblasColMajor, CblasNoTrans, CblasTrans, n, k, r, 1.0, Y->d, n, Wt->d + (long long)k*l, l, 1.0, (*Vk)->d, n);
+
+    matrix_delete(P);
+    matrix_delete(C);
+    matrix_delete(M);
+    matrix_delete(T);
+    matrix_delete(RP);
+    matrix_delete(RQ);
+    matrix_delete(L);
+    matrix_delete(R);
+    matrix_delete(K);
+    matrix_delete(X);
+    matrix_delete(S);
+    matrix_delete(Wt);
+}
+
+int svds_update(const mat *US, const mat *Vk, mat_csr *D, mat **Uk_new, mat **Sk_new, mat **Vk_new, int oversample, int power_iters)
+{
+    const int m = D->nrows, n = D->ncols, k = Vk->ncols;
+    long long i, q;
+    int j, r, rrows = 0, rcols = 0;
+    mat *LU = matrix_new(m, k);
+    mat *LV = matrix_new(n, k);
+    for (j = 0; j < k; j++) {
+        for (i = 0; i < US->nrows; i++)
+            LU->d[(long long)j*m + i] = US->d[(long long)j*US->nrows + i];
+        for (i = 0; i < Vk->nrows; i++)
+            LV->d[(long long)j*n + i] = Vk->d[(long long)j*Vk->nrows + i];
+    }
+
+    // the rows and columns the new ratings touch, numbered in order
+    int *rowid = (int*)malloc((size_t)m*sizeof(int));
+    int *colid = (int*)malloc((size_t)n*sizeof(int));
+    for (i = 0; i < m; i++)
+        rowid[i] = D->pointerE[i] > D->pointerB[i] ? rrows++ : -1;
+    for (i = 0; i < n; i++)
+        colid[i] = -1;
+    for (i = 0; i < m; i++)
+        for (q = D->pointerB[i]; q < D->pointerE[i]; q++)
+            if (colid[D->cols[q-1] - 1] < 0)
+                colid[D->cols[q-1] - 1] = rcols++;
+    r = min(rrows, rcols);
+    if (r == 0 || r > SVDS_UPDATE_EXACT_MAX || k + r > min(m, n)) {
+        block_op op = block_op_for(NULL, D->nnz > 0 ? D : NULL, NULL);
+        op.LU = LU;
+        op.LV = LV;
+        svds_randomized_core(op, m, n, Uk_new, Sk_new, Vk_new, k, oversample, power_iters, Vk);
+        matrix_delete(LU);
+        matrix_delete(LV);
+        free(rowid);
+        free(colid);
+        return r == 0 ? 0 : 1;
+    }
+
+    // US = U*diag(s) with orthonormal U
+    double *s = (double*)malloc((size_t)k*sizeof(double));
+    for (j = 0; j < k; j++) {
+        s[j] = cblas_dnrm2(m, LU->d + (long long)j*m, 1);
+        if (s[j] > 0)
+            cblas_dscal(m, 1.0/s[j], LU->d + (long long)j*m, 1);
+    }
+    // D = E*Y^T over the fewer of the touched rows (Y = D(rows, :)^T) and
+    // columns (the update of A^T, Y = D(:, cols))
+    int *idx = (int*)malloc((size_t)r*sizeof(int));
+    if (rrows <= rcols) {
+        mat *Y = matrix_new(n, r);
+        for (i = 0; i < m; i++) {
+            if (rowid[i] < 0)
+                continue;
+            idx[rowid[i]] = (int)i;
+            for (q = D->pointerB[i]; q < D->pointerE[i]; q++)
+                Y->d[(long long)rowid[i]*n + D->cols[q-1] - 1] += D->values[q-1];
+        }
+        brand_update(LU, s, LV, idx, r, Y, Uk_new, Sk_new, Vk_new);
+        matrix_delete(Y);
+    } else {
+        mat *Y = matrix_new(m, r);
+        for (i = 0; i < n; i++)
+            if (colid[i] >= 0)
+                idx[colid[i]] = (int)i;
+        for (i = 0; i < m; i++)
+            for (q = D->pointerB[i]; q < D->pointerE[i]; q++)
+                Y->d[(long long)colid[D->cols[q-1] - 1]*m + i] += D->values[q-1];
+        brand_update(LV, s, LU, idx, r, Y, Vk_new, Sk_new, Uk_new);
+        matrix_delete(Y);
+    }
+    matrix_delete(LU);
+    matrix_delete(LV);
+    free(rowid);
+    free(colid);
+    free(s);
+    free(idx);
+    return 0;
+}
+
+int svds_split_ranks(const mat *Uk, const mat *Sk, const mat *Vk, const int *ranks, int nranks, mat **Ur, mat **Sr, mat **Vr, double *energy)
+{
+    const int k = Sk->nrows;
+    int i, j;
+    for (i = 0; i < nranks; i++) {
+        if (ranks[i] < 1 || ranks[i] > k)
+            return 1;
+    }
+    for (i = 0; i < nranks; i++) {
+        const int r = ranks[i];
+        // column-major: the leading r columns are one contiguous block
+        Ur[i] = matrix_new(Uk->nrows, r);
+        memcpy(Ur[i]->d, Uk->d, (size_t)Uk->nrows*r*sizeof(double));
+        Sr[i] = matrix_new(r, 1);
+        memcpy(Sr[i]->d, Sk->d, (size_t)r*sizeof(double));
+        Vr[i] = matrix_new(Vk->nrows, r);
+        memcpy(Vr[i]->d, Vk->d, (size_t)Vk->nrows*r*sizeof(double));
+    }
+    if (energy) {
+        double e = 0;
+        for (j = 0; j < k; j++) {
+            e += Sk->d[j]*Sk->d[j];
+            energy[j] = e;
+        }
+    }
+    return 0;
+}
+
+static int max_rank(const int *ranks, int nranks)
+{
+    int i, k = 0;
+    for (i = 0; i < nranks; i++)
+        k = max(k, ranks[i]);
+    return k;
+}
+
+int svds_C_ranks(mat_csr *A, const int *ranks, int nranks, mat **Ur, mat **Sr, mat **Vr, double *energy)
+{
+    const int k = max_rank(ranks, nranks);
+    mat *Uk, *Sk, *Vk;
+    if (k < 1)
+        return 1;
+    svds_C(A, &Uk, &Sk, &Vk, k);
+    int err = svds_split_ranks(Uk, Sk, Vk, ranks, nranks, Ur, Sr, Vr, energy);
+    matrix_delete(Uk);
+    matrix_delete(Sk);
+    matrix_delete(Vk);
+    return err;
+}
+
+int svds_C_dense_ranks(mat *A, const int *ranks, int nranks, mat **Ur, mat **Sr, mat **Vr, double *energy)
+{
+    const int k = max_rank(ranks, nranks);
+    mat *Uk, *Sk, *Vk;
+    if (k < 1)
+        return 1;
+    svds_C_dense(A, &Uk, &Sk, &Vk, k);
+    int err = svds_split_ranks(Uk, Sk, Vk, ranks, nranks, Ur, Sr, Vr, energy);
+    matrix_delete(Uk);
+    matrix_delete(Sk);
+    matrix_delete(Vk);
+    return err;
+}
@@ -1,11 +1,363 @@
-#pragma once
-
-#include "matrix_funcs.h"
-
-void svds_C(mat_csr *A, mat **Uk, mat **Sk, mat **Vk, int k);
-
-void svds_C_opt(mat_csr *A, mat **Uk, mat **Sk, mat **Vk, int k, double eps, int maxbasis, int maxiter);
-
-void svds_C_dense(mat *A, mat **Uk, mat **Sk, mat **Vk, int k);
-
-void svds_C_dense_opt(mat *A, mat **Uk, mat **Sk, mat **Vk, int k, double eps, int maxbasis, int maxiter);
+#pragma once
+
+#include "matrix_funcs.h"
+#include "matrix_io.h"
+
+void x_minus_VVTx(mat *V, vec *x, vec *xt);
+
+void matrix_set_colm(mat* M, long long j, vec *column_vec);
+
+void matrix_set_colm_scaled(mat* M, long long j, vec *v, double scalar);
+
+vec matrix_col_vec(mat *M, long long j);
+
+void vector_scale_d(vec *v, double scalar);
+
+/* Top-k SVD of the b x b projected matrix B of the restarted Lanczos
+   bidiagonalization. B is upper bidiagonal (alpha on the diagonal, beta above
+   it) from row 'start' on; rows j < start = k hold the arrowhead of the last
+   restart, alpha_j at (j,j) and gamma_j at (j,k). The arrowhead block is
+   brought back to bidiagonal form by k x k Householder reflectors, the
+   bidiagonal goes to dbdsdc, and only the k leading singular vectors are
+   mapped back to B. All workspace is allocated once by svds_ritz_new. */
+typedef struct {
+    int b, k;
+    double *d, *e;           // bidiagonal handed to dbdsdc, d returns its singular values
+    mat *U, *VT;             // b x b singular vectors of the bidiagonal
+    double *house;           // Householder vector folding gamma into e_{k-1}, plus k scratch
+    double *dk, *ek;         // bidiagonal of the reversed k x k block
+    double *tauq, *taup;
+    mat *G, *T;              // k x k dgebrd factors, then the generated reflectors
+    mat *Q, *P;              // k x k left / right transforms of the arrowhead block
+    double *work, *bdwork;
+    int lwork;
+    int *iwork;
+} svds_ritz;
+
+svds_ritz * svds_ritz_new(int b, int k);
+
+void svds_ritz_delete(svds_ritz *r);
+
+/* s receives the k largest singular values in decreasing order, UBk / VBk
+   (b x k) the matching singular vectors of B; returns 0 on success and the
+   LAPACK info otherwise */
+int svds_ritz_solve(svds_ritz *r, int start, const double *alpha, const double *beta, const double *gamma, double *s, mat *UBk, mat *VBk);
+
+/* reorthogonalization of the Lanczos vectors in the _opt variants
+   (svds_C / svds_C_dense use SVDS_REORTH_FULL) */
+typedef enum {
+    SVDS_REORTH_FULL,    // one classical Gram-Schmidt pass against the whole basis per step
+    SVDS_REORTH_CGS2,    // two passes per step, robust when orthogonality is lost quickly
+    SVDS_REORTH_PARTIAL  // only when the recurrence estimate of the loss exceeds sqrt(eps)
+} svds_reorth;
+
+/* Everything a Lanczos solve allocates, made once for an m x n matrix, up to
+   k singular triplets and a basis of up to maxbasis vectors, so that repeated
+   solves (K sweeps, periodic refreshes) do no heap allocation. Arrays are
+   64-byte aligned and the m- and n-long ones are first touched by the row
+   blocks of the threads that later stream them. */
+typedef struct {
+    int m, n, k, b, nthreads;
+    mat U, V;                // Lanczos bases, m x b and n x b
+    mat Uk, Sk, Vk;          // results of the last solve
+    int nconv;               // triplets of the last solve within eps, k if it converged
+    mat UBk, VBk;            // b x k singular vectors of the projected matrix
+    vec vt;                  // residual of the last Lanczos step, or the start of the next solve
+    int warm;                // vt holds a start vector (svds_workspace_warm_start)
+    double *coef, *part, *red, *mu, *nu;
+    svds_ritz *ritz;
+    struct svds_checkpoint *ckpt; // checkpoint / resume state, NULL if unused
+} svds_workspace;
+
+svds_workspace * svds_workspace_new(int m, int n, int k, int maxbasis);
+
+void svds_workspace_delete(svds_workspace *ws);
+
+/* Makes the next Lanczos solve with ws start from the previous right
+   singular vectors V0 (n0 x k0 with n0 <= n, e.g. before new movies were
+   added; the new rows are 0) instead of a random vector: the start is
+   their sum plus a 1% random part, so the first pass over the basis
+   already spans the old dominant subspace and an updated matrix converges
+   in fewer restarts. One-shot: later solves start randomly again. */
+void svds_workspace_warm_start(svds_workspace *ws, const mat *V0);
+
+/* Checkpoints for solves that may outlive a walltime limit. After a
+   restart, once at least interval seconds (0: every restart) passed since
+   the last checkpoint or the start, the Lanczos solve with ws copies its
+   state (the k Ritz vectors of U and V plus the normalized residual, the
+   Ritz values, gamma, alpha / beta, the restart and lock counts) and a
+   background thread writes it to path while the next pass runs. The file
+   is written as path.tmp and renamed, so path always holds a complete
+   checkpoint. The random start only matters before the first one, so it
+   is not stored. Returns 0, or 1 on allocation failure. */
+int svds_workspace_checkpoint(svds_workspace *ws, const char *path, double interval);
+
+/* Makes the next Lanczos solve with ws continue from the checkpoint in
+   path instead of starting afresh: it picks up at the saved restart, and
+   maxiter counts the passes made before it. The solve must be of the same
+   matrix with the same m x n and k. The checkpoint records the number of
+   stored entries and their sum (plus the centering terms); a checkpoint
+   of another shape or matrix is reported by the solve and ignored.
+   Returns 0, 1 if path cannot be read, 2 if it is not a checkpoint for
+   this workspace. */
+int svds_workspace_resume(svds_workspace *ws, const char *path);
+
+/* close estimate of the bytes svds_workspace_new(m, n, k, maxbasis)
+   allocates, i.e. what a Lanczos solve needs on top of A */
+size_t svds_workspace_bytes(int m, int n, int k, int maxbasis);
+
+/* Per-phase instrumentation of a Lanczos solve, filled by the _opt entry
+   points when stats is not NULL. Timing and counting are compiled in only
+   with -DSVDS_STATS; otherwise the struct is just zeroed (enabled = 0) and
+   the solver runs uninstrumented. Phase times are wall times of the master
+   thread between the barriers that close each kernel. Flop and byte counts
+   are nominal (one pass over A and the vectors per product, 4 b^3 flops for
+   the bidiagonal SVD of a b x b projected matrix). */
+typedef enum {
+    SVDS_PHASE_MATVEC,    // A*v
+    SVDS_PHASE_RMATVEC,   // A^T*u
+    SVDS_PHASE_REORTH,    // Gram-Schmidt passes, norms and scaling of u and v
+    SVDS_PHASE_SMALL_SVD, // svds_ritz_solve
+    SVDS_PHASE_RITZ,      // Ritz vector GEMMs and the restart copies
+    SVDS_NPHASES
+} svds_phase;
+
+#define SVDS_STATS_MAX_RESTARTS 64
+
+typedef struct {
+    int enabled;
+    double seconds[SVDS_NPHASES];
+    long long calls[SVDS_NPHASES];
+    double flops[SVDS_NPHASES];
+    double bytes[SVDS_NPHASES];
+    double total_seconds;
+    int restarts;
+    int converged[SVDS_STATS_MAX_RESTARTS]; // converged triplets after each pass over the basis
+    int basis[SVDS_STATS_MAX_RESTARTS];     // basis length of each pass
+    int locked;                             // triplets locked when the solve stopped
+} svds_stats;
+
+const char * svds_phase_name(svds_phase p);
+
+/* derived rates of one phase, 0 when it did not run */
+double svds_stats_gflops(const svds_stats *s, svds_phase p);
+
+double svds_stats_gbs(const svds_stats *s, svds_phase p);
+
+void svds_C(mat_csr *A, mat **Uk, mat **Sk, mat **Vk, int k);
+
+/* Where the Lanczos solves below run, chosen at run time for the whole
+   process. SVDS_BACKEND_CPU is the OpenMP/OpenBLAS code. SVDS_BACKEND_CUDA
+   (build with -DSVD_USE_CUDA, link -lcudart -lcublas -lcusparse) keeps A,
+   the bases and the Ritz vectors in device memory and uses cuBLAS and
+   cuSPARSE for every product; only the small SVD of the projected matrix
+   runs on the host. It serves the double-precision solvers (the mixed ones,
+   the block, randomized and streamed solvers stay on the CPU), and a solve
+   that fails on the device (e.g. out of device memory) is redone on the
+   CPU. The device loop always reorthogonalizes fully, whatever reorth is,
+   and neither locks converged triplets nor shrinks the basis.
+   svds_set_backend returns 0, or 1 when the backend is not built in or no
+   device is present, leaving the current one selected. */
+typedef enum {
+    SVDS_BACKEND_CPU,
+    SVDS_BACKEND_CUDA,
+    SVDS_NBACKENDS
+} svds_backend;
+
+int svds_set_backend(svds_backend b);
+
+svds_backend svds_get_backend(void);
+
+const char * svds_backend_name(svds_backend b);
+
+/* A triplet has converged when its residual |gamma_i| is below eps*s_i;
+   the leading converged ones are locked and no longer iterated. maxbasis
+   caps the basis, which shrinks when few triplets are left to converge.
+   The solve stops when all k converged, after maxiter passes over the
+   basis, or, with time_budget > 0 seconds, before a pass that would likely
+   end past the budget; the unconverged triplets are then returned as they
+   stand (their count is in stats).
+   ws may be NULL, and is otherwise used if it was made for this m x n with at
+   least k and maxbasis. Then *Uk, *Sk and *Vk point into ws: they stay valid
+   until the next solve with ws and are freed by svds_workspace_delete, not
+   matrix_delete. */
+void svds_C_opt(mat_csr *A, mat **Uk, mat **Sk, mat **Vk, int k, double eps, int maxbasis, int maxiter, double time_budget, svds_reorth reorth, svds_workspace *ws, svds_stats *stats);
+
+void svds_C_dense(mat *A, mat **Uk, mat **Sk, mat **Vk, int k);
+
+void svds_C_dense_opt(mat *A, mat **Uk, mat **Sk, mat **Vk, int k, double eps, int maxbasis, int maxiter, double time_budget, svds_reorth reorth, svds_workspace *ws, svds_stats *stats);
+
+/* mixed precision: A is stored and multiplied in single precision (with
+   double accumulation), while the Lanczos vectors, alpha/beta, the
+   reorthogonalization and the small SVD stay double. Ratings (integers,
+   half stars) are exact in float, so the results match the double solve to
+   rounding; for other data they are those of A rounded to float. */
+void svds_C_mixed(mat_csr_f *A, mat **Uk, mat **Sk, mat **Vk, int k);
+
+void svds_C_mixed_opt(mat_csr_f *A, mat **Uk, mat **Sk, mat **Vk, int k, double eps, int maxbasis, int maxiter, double time_budget, svds_reorth reorth, svds_workspace *ws, svds_stats *stats);
+
+void svds_C_dense_mixed(mat_f *A, mat **Uk, mat **Sk, mat **Vk, int k);
+
+void svds_C_dense_mixed_opt(mat_f *A, mat **Uk, mat **Sk, mat **Vk, int k, double eps, int maxbasis, int maxiter, double time_budget, svds_reorth reorth, svds_workspace *ws, svds_stats *stats);
+
+/* SpMV from the SELL-C-sigma copy (sell_matrix_from_csr, which must hold
+   ->At): both products are vectorized row gathers, with no scatter for
+   A^T*u. Same results as svds_C_opt; the CPU backend is always used. */
+void svds_C_sell(mat_sell *A, mat **Uk, mat **Sk, mat **Vk, int k);
+
+void svds_C_sell_opt(mat_sell *A, mat **Uk, mat **Sk, mat **Vk, int k, double eps, int maxbasis, int maxiter, double time_budget, svds_reorth reorth, svds_workspace *ws, svds_stats *stats);
+
+/* Matrix-free operand: the Lanczos solver only ever applies A and A^T, so
+   any operator with those two products can be factorized without being
+   stored, e.g. a product, a normalized or filtered matrix, or a format
+   svds does not know. matvec sets y = A*x (m entries from n), rmatvec
+   y = A^T*x (n from m). Both are called by every thread of the solver's
+   team from inside its parallel region, so they may split the work with
+   orphaned worksharing ("#pragma omp for" over the rows of y) but must not
+   open a parallel region of their own (it would run on one thread); y
+   must be complete when all threads return. A callback that does not
+   split its work can do everything on thread 0. nnz, if not 0, is the
+   number of stored entries behind the products, only used for stats
+   (0 counts m*n). The built-in formats reach the solver through this same
+   interface.
+   reduce, if not NULL, makes the operator row-distributed over several
+   processes (svds_mpi.h): m counts this process's rows, matvec fills them
+   and rmatvec returns this process's part of A^T*x, which the solver sums.
+   reduce(ctx, buf, n) must replace buf by its elementwise sum over the
+   processes; thread 0 of the team calls it, and every process reaches the
+   same calls in the same order. The processes then make the same solve
+   (k, options, checkpointing, thread count), so that the replicated V and
+   B agree to the bit; the centered solve is not distributed. */
+typedef struct {
+    int m, n;
+    void *ctx;
+    void (*matvec)(void *ctx, const double *x, double *y);
+    void (*rmatvec)(void *ctx, const double *x, double *y);
+    long long nnz;
+    void (*reduce)(void *ctx, double *buf, int n);
+} svds_operator;
+
+/* Implicit centering: the solve factorizes
+       C = A - row*1^T - 1*col^T - bias*1*1^T
+   (row: m entries, col: n, either may be NULL) without forming C, which
+   would be dense. Every product with C is the product with A plus a
+   rank-one correction per term, O(m+n) on top of the SpMV. For ratings
+   centered by the baseline user mean + movie mean - global mean, take the
+   row and col means of csr_matrix_means and bias = -mean. Centering
+   applies to every entry, rated or not, as on the dense matrix. */
+typedef struct {
+    const double *row;
+    const double *col;
+    double bias;
+} svds_centering;
+
+void svds_C_centered(mat_csr *A, const svds_centering *c, mat **Uk, mat **Sk, mat **Vk, int k);
+
+void svds_C_centered_opt(mat_csr *A, const svds_centering *c, mat **Uk, mat **Sk, mat **Vk, int k, double eps, int maxbasis, int maxiter, double time_budget, svds_reorth reorth, svds_workspace *ws, svds_stats *stats);
+
+void svds_C_op(const svds_operator *A, mat **Uk, mat **Sk, mat **Vk, int k);
+
+void svds_C_op_opt(const svds_operator *A, mat **Uk, mat **Sk, mat **Vk, int k, double eps, int maxbasis, int maxiter, double time_budget, svds_reorth reorth, svds_workspace *ws, svds_stats *stats);
+
+/* row-distributed CSR / dense solves, as a svds_operator with reduce: A is
+   this process's block of rows (all columns), Uk comes back with the same
+   rows, Sk and Vk on every process. ws, if used, is made for A's local
+   rows; with a checkpoint, every process writes its own path. The CPU
+   backend is always used. */
+void svds_C_dist_opt(mat_csr *A, void (*reduce)(void *ctx, double *buf, int n), void *ctx, mat **Uk, mat **Sk, mat **Vk, int k, double eps, int maxbasis, int maxiter, double time_budget, svds_reorth reorth, svds_workspace *ws, svds_stats *stats);
+
+void svds_C_dense_dist_opt(mat *A, void (*reduce)(void *ctx, double *buf, int n), void *ctx, mat **Uk, mat **Sk, mat **Vk, int k, double eps, int maxbasis, int maxiter, double time_budget, svds_reorth reorth, svds_workspace *ws, svds_stats *stats);
+
+/* one solve of a batch: A and k are inputs, the rest is filled in */
+typedef struct {
+    mat_csr *A;
+    int k;
+    mat *Uk, *Sk, *Vk;       // ordinary matrices (matrix_delete), NULL on failure
+    int status;              // 0, or 1 if k does not fit A
+    double seconds;          // wall time of this solve
+} svds_batch_item;
+
+/* Throughput mode for many independent small factorizations (per-segment
+   submatrices): the Lanczos solve of every item, with a basis of
+   min(max(3k, 15), min(m, n)). Items of at least split_nnz nonzeros
+   (0: 2^20) run one after another on the whole team, as svds_C_opt would.
+   The others become OpenMP tasks, the largest first, each solved by the
+   thread that picks it up with a team of one and single-threaded BLAS, so
+   that the threads stay busy on whole solves instead of meeting at the
+   barriers of tiny ones. Every item starts from its own seeded vector,
+   so results do not depend on the schedule. Returns the number of failed
+   items. */
+int svds_C_batch(svds_batch_item *items, int nitems, double eps, int maxiter, svds_reorth reorth, long long split_nnz);
+
+/* block variants: every pass over A works on 'blocksize' vectors at once
+   (cblas_dgemm / CSR SpMM instead of dgemv). maxbasis is cut down to k
+   plus whole blocks, and the defaults use svds_block_basis with 20
+   restarts. The _opt variants store the number of converged triplets in
+   *nconv (k if the solve converged) unless nconv is NULL. */
+void svds_C_block(mat_csr *A, mat **Uk, mat **Sk, mat **Vk, int k, int blocksize);
+
+void svds_C_block_opt(mat_csr *A, mat **Uk, mat **Sk, mat **Vk, int k, int blocksize, double eps, int maxbasis, int maxiter, int *nconv);
+
+void svds_C_dense_block(mat *A, mat **Uk, mat **Sk, mat **Vk, int k, int blocksize);
+
+void svds_C_dense_block_opt(mat *A, mat **Uk, mat **Sk, mat **Vk, int k, int blocksize, double eps, int maxbasis, int maxiter, int *nconv);
+
+/* default block basis: k plus 1 + max(4, 2k/blocksize) blocks (one of them
+   kept over restarts), fewer if the matrix is too small to hold them */
+int svds_block_basis(int m, int n, int k, int blocksize);
+
+/* randomized SVD: Gaussian sketch with k+oversample columns and
+   power_iters QR-stabilized power iterations; no convergence test */
+void svds_C_randomized(mat_csr *A, mat **Uk, mat **Sk, mat **Vk, int k, int oversample, int power_iters);
+
+void svds_C_dense_randomized(mat *A, mat **Uk, mat **Sk, mat **Vk, int k, int oversample, int power_iters);
+
+/* out-of-core variants: A is streamed from a binary cache by panels
+   (matrix_stream, matrix_io.h), so only U, V and the small projected matrix
+   are in memory. Each block of the basis costs two sequential scans of the
+   file (A*V_j, then A^T*U_j), the randomized solver 2*power_iters+2 in
+   total; a large blocksize means few scans per restart. Both return 0, or
+   the stream's I/O error, in which case the results are meaningless. */
+int svds_C_stream_block(matrix_stream *A, mat **Uk, mat **Sk, mat **Vk, int k, int blocksize);
+
+int svds_C_stream_block_opt(matrix_stream *A, mat **Uk, mat **Sk, mat **Vk, int k, int blocksize, double eps, int maxbasis, int maxiter, int *nconv);
+
+int svds_C_stream_randomized(matrix_stream *A, mat **Uk, mat **Sk, mat **Vk, int k, int oversample, int power_iters);
+
+/* Incremental update without a new solve: the rank-k factorization of
+   [A 0; 0 0] + D from A ~ US*Vk^T, US = Uk*Sk (as in svd_model), the
+   previous factors of the m x n matrix A. D is m2 x n2 (m2 >= m,
+   n2 >= n) and holds the new ratings, the rows of new users and the
+   columns of new movies, and for a changed rating the difference to the
+   old one. A is only used through US*Vk^T.
+   When D touches r <= SVDS_UPDATE_EXACT_MAX rows (or columns, whichever
+   are fewer), this is Brand's update: the residuals of those unit vectors
+   and of the rows of D against Uk and Vk are orthonormalized, and the SVD
+   of a (k+r) x (k+r) core gives the exact rank-k SVD of US*Vk^T + D in
+   O((m2+n2)*(k+r)^2 + nnz(D)) time and (m2+n2)*(k+r) memory. Otherwise
+   the range finder of the randomized solver runs on the operator
+   US*Vk^T + D instead, starting from Vk (padded) plus oversample random
+   columns with power_iters power passes: an approximation whose accuracy
+   depends on both. Returns 0 for the exact update, 1 for the approximate
+   one. Either way it loses what A had outside its top k; re-solve on the
+   full matrix now and then. The results are new matrices
+   (matrix_delete). */
+#define SVDS_UPDATE_EXACT_MAX 256
+
+int svds_update(const mat *US, const mat *Vk, mat_csr *D, mat **Uk_new, mat **Sk_new, mat **Vk_new, int oversample, int power_iters);
+
+/* Rank sweep from one solve: the leading r triplets of a rank-k
+   factorization are the rank-r factorization for every r <= k, so model
+   selection over several K needs only the solve at the largest.
+   svds_split_ranks copies the leading ranks[i] columns of Uk, Sk, Vk into
+   new matrices Ur[i], Sr[i], Vr[i] (matrix_delete) and, if energy is not
+   NULL, writes the captured-energy curve energy[j] = s_0^2 + ... + s_j^2
+   for j < k (divide by ||A||_F^2 for the captured fraction). Returns 0,
+   or 1 if a rank is outside 1..k. */
+int svds_split_ranks(const mat *Uk, const mat *Sk, const mat *Vk, const int *ranks, int nranks, mat **Ur, mat **Sr, mat **Vr, double *energy);
+
+/* one Lanczos solve with the svds_C / svds_C_dense defaults at the largest
+   of the ranks, split as above (energy has as many entries) */
+int svds_C_ranks(mat_csr *A, const int *ranks, int nranks, mat **Ur, mat **Sr, mat **Vr, double *energy);
+
+int svds_C_dense_ranks(mat *A, const int *ranks, int nranks, mat **Ur, mat **Sr, mat **Vr, double *energy);
@@ -0,0 +1,84 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "svds_mpi.h"
+
+/*
+ * Row-distributed Lanczos bidiagonalization: the solve is svds_lanczos_core
+ * (svds.c) on this rank's rows of A, with the reductions of the U side and
+ * of A^T*u summed over the ranks by one MPI_Allreduce each (see
+ * svds_operator.reduce). V, the bidiagonal B and the small SVD are
+ * replicated, so locking, the adaptive basis, every reorth mode, stats,
+ * the time budget and checkpoints work as in the shared-memory solve.
+ */
+
+static svds_mpi_stats last_stats;
+
+typedef struct {
+    MPI_Comm comm;
+} mpi_reduce_ctx;
+
+/* buf summed over the ranks of ctx->comm; called from the master thread only */
+static void mpi_reduce(void *ctx, double *buf, int n)
+{
+    double t = MPI_Wtime();
+    MPI_Allreduce(MPI_IN_PLACE, buf, n, MPI_DOUBLE, MPI_SUM, ((mpi_reduce_ctx*)ctx)->comm);
+    last_stats.comm_seconds += MPI_Wtime() - t;
+    last_stats.collectives++;
+    last_stats.doubles += n;
+}
+
+void svds_mpi_get_stats(svds_mpi_stats *s)
+{
+    *s = last_stats;
+}
+
+void svds_C_mpi_opt(mat_csr *A, mat **Uk, mat **Sk, mat **Vk, int k, double eps, int maxbasis, int maxiter, double time_budget, svds_reorth reorth, svds_workspace *ws, svds_stats *stats, MPI_Comm comm)
+{
+    mpi_reduce_ctx c = {comm};
+    memset(&last_stats, 0, sizeof(last_stats));
+    svds_C_dist_opt(A, mpi_reduce, &c, Uk, Sk, Vk, k, eps, maxbasis, maxiter, time_budget, reorth, ws, stats);
+}
+
+void svds_C_mpi(mat_csr *A, mat **Uk, mat **Sk, mat **Vk, int k, MPI_Comm comm)
+{
+    svds_C_mpi_opt(A, Uk, Sk, Vk, k, 1e-10, max(3*k, 15), 10, 0, SVDS_REORTH_FULL, NULL, NULL, comm);
+}
+
+void svds_C_dense_mpi_opt(mat *A, mat **Uk, mat **Sk, mat **Vk, int k, double eps, int maxbasis, int maxiter, double time_budget, svds_reorth reorth, svds_workspace *ws, svds_stats *stats, MPI_Comm comm)
+{
+    mpi_reduce_ctx c = {comm};
+    memset(&last_stats, 0, sizeof(last_stats));
+    svds_C_dense_dist_opt(A, mpi_reduce, &c, Uk, Sk, Vk, k, eps, maxbasis, maxiter, time_budget, reorth, ws, stats);
+}
+
+void svds_C_dense_mpi(mat *A, mat **Uk, mat **Sk, mat **Vk, int k, MPI_Comm comm)
+{
+    svds_C_dense_mpi_opt(A, Uk, Sk, Vk, k, 1e-10, max(3*k, 15), 10, 0, SVDS_REORTH_FULL, NULL, NULL, comm);
+}
+
+mat * matrix_gather_rows(mat *M_local, int root, MPI_Comm comm)
+{
+    int rank, size, r, j;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+    int *counts = (int*)malloc(size*sizeof(int));
+    int *displs = (int*)malloc(size*sizeof(int));
+    MPI_Allgather(&M_local->nrows, 1, MPI_INT, counts, 1, MPI_INT, comm);
+    int nrows = 0;
+    for (r = 0; r < size; r++) {
+        displs[r] = nrows;
+        nrows += counts[r];
+    }
+    mat *M = NULL;
+    if (rank == root)
+        M = matrix_new(nrows, M_local->ncols);
+    // column-major: every column is gathered separately
+    for (j = 0; j < M_local->ncols; j++) {
+        MPI_Gatherv(M_local->d + (long long)j*M_local->nrows, M_local->nrows, MPI_DOUBLE,
+                    rank == root ? M->d + (long long)j*nrows : NULL, counts, displs, MPI_DOUBLE, root, comm);
+    }
+    free(counts);
+    free(displs);
+    return M;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <mpi.h>
+#include "svds.h"
+
+/* Distributed variants of svds_C / svds_C_dense.
+   A is split by contiguous row blocks: every rank passes only its own rows
+   (all columns), in rank order. Uk is returned distributed the same way
+   (local rows x k), while Sk and Vk are replicated on every rank. The
+   _opt variants take the options of svds_C_opt, which every rank must pass
+   alike (see svds_C_dist_opt); ws is made for the local rows. */
+
+void svds_C_mpi(mat_csr *A, mat **Uk, mat **Sk, mat **Vk, int k, MPI_Comm comm);
+
+void svds_C_mpi_opt(mat_csr *A, mat **Uk, mat **Sk, mat **Vk, int k, double eps, int maxbasis, int maxiter, double time_budget, svds_reorth reorth, svds_workspace *ws, svds_stats *stats, MPI_Comm comm);
+
+void svds_C_dense_mpi(mat *A, mat **Uk, mat **Sk, mat **Vk, int k, MPI_Comm comm);
+
+void svds_C_dense_mpi_opt(mat *A, mat **Uk, mat **Sk, mat **Vk, int k, double eps, int maxbasis, int maxiter, double time_budget, svds_reorth reorth, svds_workspace *ws, svds_stats *stats, MPI_Comm comm);
+
+/* communication of the last distributed solve on this rank */
+typedef struct {
+    long long collectives;  // MPI_Allreduce calls, two per Lanczos step with full reorthogonalization
+    long long doubles;      // entries reduced by them
+    double comm_seconds;    // time spent in them
+} svds_mpi_stats;
+
+void svds_mpi_get_stats(svds_mpi_stats *s);
+
+/* collect a row-distributed matrix (e.g. Uk) on rank 'root'; returns NULL on the other ranks */
+mat * matrix_gather_rows(mat *M_local, int root, MPI_Comm comm);
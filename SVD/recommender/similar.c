@@ -0,0 +1,145 @@
+/*****************************************************************************
+ * similar.c
+ *
+ * "More like this": the K nearest movies of every movie in the latent
+ * space of the last factorization (cosine between rows of Vk*Sk).
+ *
+ * 1) mmaps "svd_mpi_results.dat" and builds the item index (recommend.c)
+ *    in --precision=double|float|int8, optionally with --lists=L inverted
+ *    lists (spherical k-means) for catalogs too large to scan per query.
+ *
+ * 2) Queries the movies FIRST .. FIRST+COUNT-1 (all by default) in one
+ *    batch, scanning --probe=P lists per query when the index has lists.
+ *    --recall also runs the exact search in double and reports the recall
+ *    of the approximate neighbours against it.
+ *
+ * 3) Writes "movie_id,rank,neighbor_id,similarity" lines (0-based ids,
+ *    rank 1 = most similar) to --out.
+ *
+ * Compilation (example):
+ *   gcc -O2 -fopenmp similar.c ../common/recommend.c ../common/matrix_funcs.c ../common/matrix_io.c -o svd_similar -lopenblas -llapacke -lm
+ *
+ * Run:
+ *   ./svd_similar svd_mpi_results.dat K [--precision=double|float|int8] [--lists=L] [--probe=P] [--movies=FIRST:COUNT] [--recall] [--out=similar_movies.csv]
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+#include "../common/recommend.h"
+
+int main(int argc, char *argv[])
+{
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s <svd_results.dat> <K> [--precision=double|float|int8] [--lists=L] [--probe=P] [--movies=FIRST:COUNT] [--recall] [--out=FILE]\n", argv[0]);
+        return 1;
+    }
+    const char *results = argv[1];
+    int K = atoi(argv[2]);
+    const char *precision_name = "float";
+    const char *out = "similar_movies.csv";
+    int nlists = 0, nprobe = 0, recall = 0;
+    int first = 0, count = -1;
+    int a, i, r;
+    for (a = 3; a < argc; a++) {
+        if (strncmp(argv[a], "--precision=", 12) == 0) {
+            precision_name = argv[a] + 12;
+        } else if (strncmp(argv[a], "--lists=", 8) == 0) {
+            nlists = atoi(argv[a] + 8);
+        } else if (strncmp(argv[a], "--probe=", 8) == 0) {
+            nprobe = atoi(argv[a] + 8);
+        } else if (strncmp(argv[a], "--movies=", 9) == 0) {
+            if (sscanf(argv[a] + 9, "%d:%d", &first, &count) != 2) {
+                fprintf(stderr, "Error: --movies must be FIRST:COUNT.\n");
+                return 1;
+            }
+        } else if (strcmp(argv[a], "--recall") == 0) {
+            recall = 1;
+        } else if (strncmp(argv[a], "--out=", 6) == 0) {
+            out = argv[a] + 6;
+        }
+    }
+    svd_index_precision precision;
+    if (strcmp(precision_name, "double") == 0) {
+        precision = SVD_INDEX_DOUBLE;
+    } else if (strcmp(precision_name, "float") == 0) {
+        precision = SVD_INDEX_FLOAT;
+    } else if (strcmp(precision_name, "int8") == 0) {
+        precision = SVD_INDEX_INT8;
+    } else {
+        fprintf(stderr, "Error: --precision must be 'double', 'float' or 'int8'.\n");
+        return 1;
+    }
+
+    svd_model M;
+    int err = svd_model_load(results, &M);
+    if (err) {
+        fprintf(stderr, "Error loading '%s' (code=%d)\n", results, err);
+        return 1;
+    }
+    if (count < 0)
+        count = M.nmovies - first;
+    if (K < 1 || first < 0 || count < 0 || first + count > M.nmovies || nlists < 0 || nlists > M.nmovies) {
+        fprintf(stderr, "Error: need K >= 1, movies within 0..%d and at most that many lists.\n", M.nmovies);
+        svd_model_free(&M);
+        return 1;
+    }
+    if (nlists > 0 && nprobe <= 0)
+        nprobe = max(1, nlists / 8);
+
+    double t = omp_get_wtime();
+    svd_item_index ix;
+    svd_item_index_build(&M.V, M.s, precision, nlists, &ix);
+    printf("Built a %s index of %d movies (rank %d, %d lists) in %.6f sec.\n", precision_name, M.nmovies, M.k, nlists, omp_get_wtime() - t);
+
+    int *queries = (int*)malloc(max(count, 1) * sizeof(int));
+    int *nbr = (int*)malloc((size_t)max(count, 1) * K * sizeof(int));
+    double *sim = (double*)malloc((size_t)max(count, 1) * K * sizeof(double));
+    for (i = 0; i < count; i++)
+        queries[i] = first + i;
+    t = omp_get_wtime();
+    svd_item_index_query(&ix, queries, count, K, nprobe, nbr, sim);
+    t = omp_get_wtime() - t;
+    printf("Queried %d movies (top %d%s) in %.6f sec, %.3f us per movie.\n", count, K, nlists > 0 ? ", approximate" : "", t, count > 0 ? 1e6 * t / count : 0.0);
+
+    if (recall) {
+        svd_item_index exact;
+        int *nbr_x = (int*)malloc((size_t)max(count, 1) * K * sizeof(int));
+        double *sim_x = (double*)malloc((size_t)max(count, 1) * K * sizeof(double));
+        long long hits = 0, total = 0;
+        svd_item_index_build(&M.V, M.s, SVD_INDEX_DOUBLE, 0, &exact);
+        svd_item_index_query(&exact, queries, count, K, 0, nbr_x, sim_x);
+        for (i = 0; i < count; i++) {
+            for (r = 0; r < K && nbr_x[(long long)i*K + r] >= 0; r++) {
+                int e;
+                total++;
+                for (e = 0; e < K; e++)
+                    hits += nbr[(long long)i*K + e] == nbr_x[(long long)i*K + r];
+            }
+        }
+        printf("Recall@%d against the exact double search: %.4f.\n", K, total > 0 ? (double)hits / total : 1.0);
+        svd_item_index_free(&exact);
+        free(nbr_x);
+        free(sim_x);
+    }
+
+    FILE *fp = fopen(out, "w");
+    if (!fp) {
+        fprintf(stderr, "Error: cannot open '%s' for writing.\n", out);
+    } else {
+        fprintf(fp, "movie_id,rank,neighbor_id,similarity\n");
+        for (i = 0; i < count; i++) {
+            for (r = 0; r < K && nbr[(long long)i*K + r] >= 0; r++)
+                fprintf(fp, "%d,%d,%d,%.6f\n", queries[i], r + 1, nbr[(long long)i*K + r], sim[(long long)i*K + r]);
+        }
+        fclose(fp);
+    }
+
+    free(queries);
+    free(nbr);
+    free(sim);
+    svd_item_index_free(&ix);
+    svd_model_free(&M);
+    return fp ? 0 : 1;
+}
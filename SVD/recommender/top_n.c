@@ -0,0 +1,155 @@
+/*****************************************************************************
+ * top_n.c
+ *
+ * Serving side of the pipeline: turns the factors the drivers save to
+ * "svd_mpi_results.dat" into the top-N movies of every user, without
+ * reloading them into separate tooling.
+ *
+ * 1) mmaps the results file and scales Uk by Sk once (recommend.c).
+ *
+ * 2) Optionally loads the ratings (the CSV, or a sparse binary cache saved
+ *    with --save-cache) as a CSR, so that movies a user already rated are
+ *    never recommended back.
+ *
+ * 3) Scores users --batch at a time with one cblas_dgemm against all
+ *    movies and keeps the N best of each user with a per-thread heap, in
+ *    chunks of users so that the output buffers stay small.
+ *
+ * 4) Writes "user_id,rank,movie_id,score" lines (0-based ids like the
+ *    rating CSV, rank 1 = best) to --out.
+ *
+ * Compilation (example):
+ *   gcc -O2 -fopenmp top_n.c ../common/recommend.c ../common/matrix_funcs.c ../common/csv_loader.c ../common/matrix_io.c -o svd_top_n -lopenblas -llapacke -lm
+ *
+ * Run:
+ *   ./svd_top_n svd_mpi_results.dat N [--ratings=FILE] [--batch=B] [--users=FIRST:COUNT] [--out=recommendations.csv]
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+#include "../common/recommend.h"
+#include "../common/csv_loader.h"
+
+#define USER_CHUNK 65536
+
+int main(int argc, char *argv[])
+{
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s <svd_results.dat> <N> [--ratings=FILE] [--batch=B] [--users=FIRST:COUNT] [--out=FILE]\n", argv[0]);
+        return 1;
+    }
+    const char *results = argv[1];
+    int n = atoi(argv[2]);
+    const char *ratings = NULL;
+    const char *out = "recommendations.csv";
+    int batch = 0;
+    int first = 0, count = -1;
+    int a;
+    for (a = 3; a < argc; a++) {
+        if (strncmp(argv[a], "--ratings=", 10) == 0) {
+            ratings = argv[a] + 10;
+        } else if (strncmp(argv[a], "--batch=", 8) == 0) {
+            batch = atoi(argv[a] + 8);
+        } else if (strncmp(argv[a], "--users=", 8) == 0) {
+            if (sscanf(argv[a] + 8, "%d:%d", &first, &count) != 2) {
+                fprintf(stderr, "Error: --users must be FIRST:COUNT.\n");
+                return 1;
+            }
+        } else if (strncmp(argv[a], "--out=", 6) == 0) {
+            out = argv[a] + 6;
+        }
+    }
+
+    double t = omp_get_wtime();
+    svd_model M;
+    int err = svd_model_load(results, &M);
+    if (err) {
+        fprintf(stderr, "Error loading '%s' (code=%d)\n", results, err);
+        return 1;
+    }
+    if (count < 0)
+        count = M.nusers - first;
+    if (n < 1 || first < 0 || count < 0 || first + count > M.nusers) {
+        fprintf(stderr, "Error: need N >= 1 and users within 0..%d.\n", M.nusers);
+        svd_model_free(&M);
+        return 1;
+    }
+    printf("Loaded a rank-%d model of %d users x %d movies in %.6f sec.\n", M.k, M.nusers, M.nmovies, omp_get_wtime() - t);
+
+    // ratings to mask, in the same users x movies shape as the model
+    mat_csr *rated = NULL;
+    mapped_file cache = {NULL, 0, NULL};
+    int from_cache = 0;
+    if (ratings) {
+        t = omp_get_wtime();
+        matrix_cache_header h;
+        int kind = matrix_cache_kind(ratings, &h);
+        if (kind == MATRIX_CACHE_CSR) {
+            rated = csr_matrix_new();
+            from_cache = 1;
+            err = (h.nrows != M.nusers || h.ncols != M.nmovies) ? 1 : matrix_cache_map_csr(ratings, 0, h.nrows, rated, &cache);
+        } else if (kind == MATRIX_CACHE_DENSE) {
+            err = 1; // a dense cache does not tell unrated from a zero rating
+        } else {
+            mat_coo *coo = NULL;
+            err = csv_read_coo(ratings, 0, M.nusers, M.nmovies, &coo);
+            if (!err) {
+                rated = csr_matrix_new();
+                csr_init_from_coo(rated, coo);
+                coo_matrix_delete(coo);
+            }
+        }
+        if (err) {
+            fprintf(stderr, "Error loading the ratings '%s' (code=%d); they must be the CSV or a sparse cache of %dx%d.\n", ratings, err, M.nusers, M.nmovies);
+            if (from_cache)
+                free(rated);
+            else if (rated)
+                csr_matrix_delete(rated);
+            svd_model_free(&M);
+            return 1;
+        }
+        printf("Loaded %lld ratings to mask in %.6f sec.\n", rated->nnz, omp_get_wtime() - t);
+    }
+
+    FILE *fp = fopen(out, "w");
+    if (!fp) {
+        fprintf(stderr, "Error: cannot open '%s' for writing.\n", out);
+        svd_model_free(&M);
+        return 1;
+    }
+    fprintf(fp, "user_id,rank,movie_id,score\n");
+    int chunk = min(USER_CHUNK, max(count, 1));
+    int *movies = (int*)malloc((size_t)chunk * n * sizeof(int));
+    double *scores = (double*)malloc((size_t)chunk * n * sizeof(double));
+    double t_score = 0, t_write = 0;
+    int c0, i, r;
+    for (c0 = first; c0 < first + count; c0 += chunk) {
+        int cn = min(chunk, first + count - c0);
+        t = omp_get_wtime();
+        svd_recommend_top_n(&M, c0, cn, n, batch, rated, movies, scores);
+        t_score += omp_get_wtime() - t;
+        t = omp_get_wtime();
+        for (i = 0; i < cn; i++) {
+            for (r = 0; r < n && movies[(long long)i*n + r] >= 0; r++)
+                fprintf(fp, "%d,%d,%d,%.6f\n", c0 + i, r + 1, movies[(long long)i*n + r], scores[(long long)i*n + r]);
+        }
+        t_write += omp_get_wtime() - t;
+    }
+    fclose(fp);
+    printf("Scored %d users (top %d) in %.6f sec, writing '%s' took %.6f sec.\n", count, n, t_score, out, t_write);
+
+    free(movies);
+    free(scores);
+    if (rated) {
+        if (from_cache) {
+            free(rated);
+            matrix_cache_unmap(&cache);
+        } else {
+            csr_matrix_delete(rated);
+        }
+    }
+    svd_model_free(&M);
+    return 0;
+}
@@ -0,0 +1,41 @@
+#!/bin/bash
+#PBS -l select=1:ncpus=16:mem=16gb
+#PBS -l walltime=0:20:00
+#PBS -q short_cpuQ
+#PBS -N svd_top_n_job
+
+# Output and error file paths
+#PBS -o top_n_output.out
+#PBS -e top_n_error.err
+
+# Load required modules (adjust versions if needed)
+module load lapack-3.8.0
+module load OpenBLAS-0.3.7
+export OMP_NUM_THREADS=16
+export OMP_PROC_BIND=spread
+export OMP_PLACES=cores
+
+cd $PBS_O_WORKDIR
+
+gcc -O2 -fopenmp -o svd_top_n top_n.c ../common/recommend.c ../common/matrix_funcs.c ../common/csv_loader.c ../common/matrix_io.c \
+  -I/apps/OpenBLAS-0.3.7/include \
+  -I/apps/lapack-3.8.0/include \
+  -L/apps/OpenBLAS-0.3.7/lib \
+  -L/apps/lapack-3.8.0/lib \
+  -lopenblas -llapacke -lm
+gcc -O2 -fopenmp -o svd_similar similar.c ../common/recommend.c ../common/matrix_funcs.c ../common/matrix_io.c \
+  -I/apps/OpenBLAS-0.3.7/include \
+  -I/apps/lapack-3.8.0/include \
+  -L/apps/OpenBLAS-0.3.7/lib \
+  -L/apps/lapack-3.8.0/lib \
+  -lopenblas -llapacke -lm
+
+# Top 20 movies for every user of the last factorization, skipping the
+# movies they already rated (pass the CSV, or the .bin cache of a --sparse run).
+# --batch=B sets the users per GEMM (default 4096); --users=FIRST:COUNT scores a slice.
+./svd_top_n svd_mpi_results.dat 20 --ratings=mapped_merged_data_16M.bin --out=recommendations.csv
+
+# The 20 most similar movies of every movie ("more like this"), from a float
+# index of Vk*Sk. For large catalogs add --lists=L --probe=P (inverted lists,
+# approximate) and --recall to measure what the approximation loses.
+./svd_similar svd_mpi_results.dat 20 --precision=float --out=similar_movies.csv
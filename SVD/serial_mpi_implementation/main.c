@@ -5,93 +5,66 @@
  *      user_id,movie_id,rating
  *    mapped so 0 <= user_id < num_rows and 0 <= movie_id < num_cols.
  *
- * 2) Fills a 'mat' structure (from THU-numbda's svds.h), where
- *    mat has fields: int nrows, ncols; double *d;
+ * 2) Splits the users into contiguous row blocks, one per MPI rank. Every
+ *    rank keeps only the ratings of its own rows and fills a local 'mat'
+ *    (from THU-numbda's svds.h), where
+ *    mat has fields: int nrows, ncols; double *d;    // column-major
+ *    With --sparse the local rows go CSV -> mat_coo -> mat_csr instead.
+ *    Each rank mmaps the file and parses it with its OpenMP threads
+ *    (csv_loader.c). --transpose-copy keeps a CSR copy of the local A^T so
+ *    the local part of A^T*u needs no reduction across threads. A binary cache written by the OpenMP driver's
+ *    --save-cache (matrix_io.c) may be passed instead of the CSV: every
+ *    rank then maps its own rows of it, in the format it was saved with.
  *
- * 3) Calls the function:
- *    void svds_C_dense(mat *A, mat **Uk, mat **Sk, mat **Vk, int k);
- *    which is provided by THU-numbda's svds.c (HPC code).
+ * 3) Calls the distributed solver:
+ *    void svds_C_dense_mpi_opt(mat *A, mat **Uk, mat **Sk, mat **Vk, int k, ..., MPI_Comm comm);
+ *    (svds_C_mpi_opt for --sparse) from svds_mpi.c, the shared-memory
+ *    Lanczos solver on the local rows. A*v is local to each rank; with
+ *    --reorth=full (the default) each Lanczos step does one batched
+ *    MPI_Allreduce (U reorthogonalization coefficients and norm) and one
+ *    for A^T*u, and --reorth=cgs2|partial work as in the OpenMP driver.
+ *    The log reports the collectives and the time spent in them.
+ *
+ *    Hybrid runs use one rank per node (or socket) and OpenMP threads
+ *    inside it; MPI is initialized with MPI_THREAD_FUNNELED since only the
+ *    master thread communicates, outside the parallel regions.
  *
  * 4) Logs time taken for each step and a success message to "svd_mpi.log".
  *
- * 5) Saves Uk, Sk, Vk to a single binary file "svd_mpi_results.dat" in row-major format.
+ * 5) Gathers Uk on rank 0 and saves Uk, Sk, Vk to a single binary file
+ *    "svd_mpi_results.dat" (each matrix column-major).
  *
  * Compilation (example):
- *   mpicc main.c svds.c matrix_funcs.c -o svd_mpi -lm -lblas -llapack
+ *   mpicc -fopenmp main.c svds.c svds_mpi.c matrix_funcs.c csv_loader.c matrix_io.c -o svd_mpi -lm -lblas -llapack
  * or include other THU-numbda files (LOBPCG_C.c, etc.) as needed.
  *
- * Run (serial HPC approach):
- *   mpirun -np 1 ./svd_mpi svd_data.csv NUM_ROWS NUM_COLS K
+ * Run (distributed, one row block per rank):
+ *   mpirun -np P ./svd_mpi svd_data.csv NUM_ROWS NUM_COLS K [--sparse] [--transpose-copy] [--reorth=full|cgs2|partial]
+ * Hybrid (P nodes, T cores each):
+ *   OMP_NUM_THREADS=T mpirun -np P -ppn 1 ./svd_mpi ...
  *****************************************************************************/
 
  #include <mpi.h>
  #include <stdio.h>
  #include <stdlib.h>
  #include <string.h>
+ #include <omp.h>
  
  /*
     Include THU-numbda's "svds.h", which itself includes "matrix_funcs.h".
     'mat' is defined as:
       typedef struct {
           int nrows, ncols;
-          double * d;    // row-major
+          double * d;    // column-major
       } mat;
  
-    and:
-      void svds_C_dense(mat *A, mat **Uk, mat **Sk, mat **Vk, int k);
+    "svds_mpi.h" adds the row-distributed solvers on top of it:
+      void svds_C_dense_mpi(mat *A, mat **Uk, mat **Sk, mat **Vk, int k, MPI_Comm comm);
+    (and the _opt variants taking the options of svds_C_opt).
  */
- #include "../common/svds.h"
- 
- /*****************************************************************************
-  * fill_matrix_from_csv:
-  *   Reads lines "user_id,movie_id,rating" from 'filename',
-  *   places each rating in row-major order:
-  *     A->d[row * A->ncols + col] = rating
-  *   Skips one header line if present.
-  * Return 0 on success, nonzero on error.
-  *****************************************************************************/
- static int fill_matrix_from_csv(const char *filename, mat *A,
-                                 int num_rows, int num_cols)
- {
-     if (!A || !A->d) {
-         fprintf(stderr, "[fill_matrix_from_csv] Error: invalid 'mat' pointer.\n");
-         return 1;
-     }
-     // Double-check dimensions
-     if (A->nrows != num_rows || A->ncols != num_cols) {
-         fprintf(stderr, "[fill_matrix_from_csv] Mismatch: A->nrows/ncols vs. function args.\n");
-         return 2;
-     }
- 
-     FILE *fp = fopen(filename, "r");
-     if (!fp) {
-         fprintf(stderr, "Error: cannot open CSV file '%s'\n", filename);
-         return 3;
-     }
- 
-     // Skip the first line if it's a header
-     char line[256];
-     if (fgets(line, sizeof(line), fp) == NULL) {
-         fclose(fp);
-         return 4; // Possibly empty file
-     }
- 
-     // Read each subsequent line
-     while (fgets(line, sizeof(line), fp)) {
-         int uid, mid;
-         double rating;
-         if (sscanf(line, "%d,%d,%lf", &uid, &mid, &rating) == 3) {
-             if (uid >= 0 && uid < num_rows &&
-                 mid >= 0 && mid < num_cols)
-             {
-                 int idx = uid * A->ncols + mid;
-                 A->d[idx] = rating;
-             }
-         }
-     }
-     fclose(fp);
-     return 0;
- }
+ #include "../common/svds_mpi.h"
+ #include "../common/csv_loader.h"
+ #include "../common/matrix_io.h"
  
  static void save_one_matrix(const mat *M, FILE *fp) {
     if (!M || !M->d) {
@@ -102,7 +75,7 @@
     }
     fwrite(&M->nrows, sizeof(int), 1, fp);
     fwrite(&M->ncols, sizeof(int), 1, fp);
-    fwrite(M->d, sizeof(double), (size_t)(M->nrows * M->ncols), fp);
+    fwrite(M->d, sizeof(double), (size_t)M->nrows * M->ncols, fp);
 }
 
  static void save_matrices(const mat *Uk, const mat *Sk, const mat *Vk)
@@ -123,105 +96,212 @@
  
  int main(int argc, char *argv[])
  {
-     MPI_Init(&argc, &argv);
+     int provided;
+     MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
      int rank, size;
      MPI_Comm_rank(MPI_COMM_WORLD, &rank);
      MPI_Comm_size(MPI_COMM_WORLD, &size);
+     if (rank == 0 && provided < MPI_THREAD_FUNNELED) {
+         fprintf(stderr, "Warning: MPI provides no thread support, OpenMP regions must not call MPI.\n");
+     }
  
      if (argc < 5) {
          if (rank == 0) {
-             fprintf(stderr, "Usage: %s <csv_file> <num_rows> <num_cols> <K>\n", argv[0]);
+             fprintf(stderr, "Usage: %s <csv_file> <num_rows> <num_cols> <K> [--sparse] [--transpose-copy] [--reorth=full|cgs2|partial]\n", argv[0]);
          }
          MPI_Finalize();
          return 1;
      }
  
-     if (rank == 0) {
-         printf("MPI size=%d (serial HPC approach: only rank 0 does the SVD)\n", size);
-     }
+     // Timing
+     double total_time_start = MPI_Wtime();
  
-     if (rank == 0) {
-         // Timing
-         double total_time_start = MPI_Wtime();
+     // Parse arguments
+     const char *csv_file = argv[1];
+     int num_rows = atoi(argv[2]);
+     int num_cols = atoi(argv[3]);
+     int K        = atoi(argv[4]);
+     int sparse   = 0;
+     int transpose_copy = 0;
+     const char *reorth_name = "full";
+     for (int a = 5; a < argc; a++) {
+         if (strcmp(argv[a], "--sparse") == 0) {
+             sparse = 1;
+         } else if (strcmp(argv[a], "--transpose-copy") == 0) {
+             transpose_copy = 1;
+         } else if (strncmp(argv[a], "--reorth=", 9) == 0) {
+             reorth_name = argv[a] + 9;
+         }
+     }
+     svds_reorth reorth;
+     if (strcmp(reorth_name, "full") == 0) {
+         reorth = SVDS_REORTH_FULL;
+     } else if (strcmp(reorth_name, "cgs2") == 0) {
+         reorth = SVDS_REORTH_CGS2;
+     } else if (strcmp(reorth_name, "partial") == 0) {
+         reorth = SVDS_REORTH_PARTIAL;
+     } else {
+         if (rank == 0) {
+             fprintf(stderr, "Error: --reorth must be 'full', 'cgs2' or 'partial'.\n");
+         }
+         MPI_Finalize();
+         return 1;
+     }
+     // A binary cache carries its own format, which overrides --sparse
+     matrix_cache_header cache_hdr;
+     int cache_kind = matrix_cache_kind(csv_file, &cache_hdr);
+     if (cache_kind >= 0) {
+         if (cache_hdr.nrows != num_rows || cache_hdr.ncols != num_cols) {
+             if (rank == 0) {
+                 fprintf(stderr, "Error: cache '%s' holds a %dx%d matrix, expected %dx%d.\n",
+                         csv_file, cache_hdr.nrows, cache_hdr.ncols, num_rows, num_cols);
+             }
+             MPI_Finalize();
+             return 1;
+         }
+         sparse = cache_kind == MATRIX_CACHE_CSR;
+     }
+     if (num_rows < size) {
+         if (rank == 0) {
+             fprintf(stderr, "Error: %d rows cannot be split across %d ranks.\n", num_rows, size);
+         }
+         MPI_Finalize();
+         return 1;
+     }
  
-         // Parse arguments
-         const char *csv_file = argv[1];
-         int num_rows = atoi(argv[2]);
-         int num_cols = atoi(argv[3]);
-         int K        = atoi(argv[4]);
+     // Contiguous row block owned by this rank
+     int row_begin = (int)((long long)num_rows * rank / size);
+     int row_end   = (int)((long long)num_rows * (rank + 1) / size);
+     int local_rows = row_end - row_begin;
  
-         // Open log file
-         FILE *log_fp = fopen("svd_mpi.log", "w");
+     // Only rank 0 writes the log file
+     FILE *log_fp = NULL;
+     if (rank == 0) {
+         printf("MPI size=%d x %d OpenMP threads (distributed: rows of A and U split across ranks)\n", size, omp_get_max_threads());
+         log_fp = fopen("svd_mpi.log", "w");
          if (!log_fp) {
              fprintf(stderr, "Error: cannot open svd_mpi.log for writing.\n");
              MPI_Abort(MPI_COMM_WORLD, 1);
          }
+         fprintf(log_fp, "%d ranks: reading '%s', building %s %dx%d matrix, K=%d\n",
+                 size, csv_file, sparse ? "sparse" : "dense", num_rows, num_cols, K);
+     }
  
-         fprintf(log_fp, "Rank 0: reading '%s', building %dx%d matrix, K=%d\n",
-                 csv_file, num_rows, num_cols, K);
- 
-         // 1) Allocate mat A
-         mat A;
-         A.nrows = num_rows;
+     mat A;
+     A.d = NULL;
+     mat_csr *Acsr = NULL;
+     mapped_file cache = {NULL, 0, NULL};
+     double t_csv = MPI_Wtime();
+     int err;
+     if (cache_kind == MATRIX_CACHE_CSR) {
+         // 1-2) Map the local rows straight from the cache
+         Acsr = csr_matrix_new();
+         err = matrix_cache_map_csr(csv_file, row_begin, row_end, Acsr, &cache);
+     } else if (cache_kind == MATRIX_CACHE_DENSE) {
+         err = matrix_cache_map_dense(csv_file, row_begin, row_end, &A, &cache);
+     } else if (sparse) {
+         // 1-2) Read the local ratings as triplets and convert them to CSR
+         mat_coo *Acoo = NULL;
+         err = csv_read_coo(csv_file, row_begin, row_begin + local_rows, num_cols, &Acoo);
+         if (!err) {
+             Acsr = csr_matrix_new();
+             csr_init_from_coo(Acsr, Acoo);
+             coo_matrix_delete(Acoo);
+         }
+     } else {
+         // 1) Allocate the local block of A
+         A.nrows = local_rows;
          A.ncols = num_cols;
-         A.d = (double*) calloc((size_t)(A.nrows * A.ncols), sizeof(double));
+         A.d = matrix_alloc_placed(A.nrows, A.ncols);
          if (!A.d) {
-             fprintf(log_fp, "Error: allocation failed for A->d\n");
-             fclose(log_fp);
+             fprintf(stderr, "Rank %d: allocation failed for A->d\n", rank);
              MPI_Abort(MPI_COMM_WORLD, 1);
          }
  
-         // 2) Fill matrix from CSV
-         double t_csv = MPI_Wtime();
-         int err = fill_matrix_from_csv(csv_file, &A, A.nrows, A.ncols);
-         t_csv = MPI_Wtime() - t_csv;
-         if (err) {
-             fprintf(log_fp, "Error reading CSV (code=%d)\n", err);
-             free(A.d);
-             fclose(log_fp);
-             MPI_Abort(MPI_COMM_WORLD, 1);
+         // 2) Fill the local rows from CSV
+         err = csv_read_dense(csv_file, row_begin, &A);
+     }
+     if (err) {
+         fprintf(stderr, "Rank %d: error reading %s (code=%d)\n", rank, cache_kind >= 0 ? "cache" : "CSV", err);
+         MPI_Abort(MPI_COMM_WORLD, 1);
+     }
+     MPI_Barrier(MPI_COMM_WORLD);
+     t_csv = MPI_Wtime() - t_csv;
+     if (rank == 0) {
+         fprintf(log_fp, "%s took %.6f sec.\n", cache_kind >= 0 ? "Mapping the binary cache" : "CSV reading & matrix fill", t_csv);
+     }
+     if (sparse) {
+         long long nnz = Acsr->nnz;
+         MPI_Allreduce(MPI_IN_PLACE, &nnz, 1, MPI_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
+         if (rank == 0) {
+             fprintf(log_fp, "Sparse matrix holds %lld nonzeros (density %.4f%%).\n",
+                     nnz, 100.0 * nnz / ((double)num_rows * num_cols));
+         }
+         if (transpose_copy) {
+             double t_tr = MPI_Wtime();
+             csr_matrix_build_transpose(Acsr);
+             MPI_Barrier(MPI_COMM_WORLD);
+             t_tr = MPI_Wtime() - t_tr;
+             if (rank == 0) {
+                 fprintf(log_fp, "Building the local transposed copies took %.6f sec.\n", t_tr);
+             }
          }
-         fprintf(log_fp, "CSV reading & matrix fill took %.6f sec.\n", t_csv);
+     }
  
-         // 3) Prepare placeholders for HPC partial SVD
-         mat *Uk = NULL, *Sk = NULL, *Vk = NULL;
+     // 3) Prepare placeholders for HPC partial SVD
+     mat *Uk = NULL, *Sk = NULL, *Vk = NULL;
  
-         // 4) SVD
-         double t_svd = MPI_Wtime();
-         svds_C_dense(&A, &Uk, &Sk, &Vk, K); // HPC code from svds.c
-         t_svd = MPI_Wtime() - t_svd;
+     // 4) SVD
+     double t_svd = MPI_Wtime();
+     if (sparse) {
+         svds_C_mpi_opt(Acsr, &Uk, &Sk, &Vk, K, 1e-10, max(3*K, 15), 10, 0, reorth, NULL, NULL, MPI_COMM_WORLD);
+     } else {
+         svds_C_dense_mpi_opt(&A, &Uk, &Sk, &Vk, K, 1e-10, max(3*K, 15), 10, 0, reorth, NULL, NULL, MPI_COMM_WORLD);
+     }
+     t_svd = MPI_Wtime() - t_svd;
+     svds_mpi_stats st;
+     svds_mpi_get_stats(&st);
+     double comm_max = st.comm_seconds;
+     MPI_Allreduce(MPI_IN_PLACE, &comm_max, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+     if (rank == 0) {
          fprintf(log_fp, "SVD computation took %.6f sec.\n", t_svd);
+         fprintf(log_fp, "%lld collectives reducing %lld doubles, %.6f sec in collectives (max over ranks).\n",
+                 st.collectives, st.doubles, comm_max);
+     }
  
-         // 5) Save the SVD results to a file
-         double t_save = MPI_Wtime();
-         save_matrices(Uk, Sk, Vk);
+     // 5) Collect Uk on rank 0 and save the SVD results to a file
+     double t_save = MPI_Wtime();
+     mat *Uk_all = matrix_gather_rows(Uk, 0, MPI_COMM_WORLD);
+     if (rank == 0) {
+         save_matrices(Uk_all, Sk, Vk);
+         matrix_delete(Uk_all);
          t_save = MPI_Wtime() - t_save;
-         fprintf(log_fp, "Saving Uk, Sk, Vk took %.6f sec.\n", t_save);
+         fprintf(log_fp, "Gathering and saving Uk, Sk, Vk took %.6f sec.\n", t_save);
+     }
  
-         // 6) Free memory
+     // 6) Free memory
+     if (cache_kind >= 0) {
+         // A points into the mapping (or its local copy), only the CSR shell (and A^T) is ours
+         if (Acsr && Acsr->At) csr_matrix_delete(Acsr->At);
+         free(Acsr);
+         matrix_cache_unmap(&cache);
+     } else {
          free(A.d);
-         if (Uk) {
-             if (Uk->d) free(Uk->d);
-             free(Uk);
-         }
-         if (Sk) {
-             if (Sk->d) free(Sk->d);
-             free(Sk);
-         }
-         if (Vk) {
-             if (Vk->d) free(Vk->d);
-             free(Vk);
-         }
+         if (Acsr) csr_matrix_delete(Acsr);
+     }
+     if (Uk) matrix_delete(Uk);
+     if (Sk) matrix_delete(Sk);
+     if (Vk) matrix_delete(Vk);
  
+     if (rank == 0) {
          double total_time = MPI_Wtime() - total_time_start;
          fprintf(log_fp, "Total program time: %.6f sec.\n", total_time);
  
          // Done
-         fprintf(log_fp, "svds_C_dense call completed successfully!\n");
+         fprintf(log_fp, "%s call completed successfully!\n", sparse ? "svds_C_mpi_opt" : "svds_C_dense_mpi_opt");
          fclose(log_fp);
      }
  
      MPI_Finalize();
      return 0;
  }
- 
\ No newline at end of file
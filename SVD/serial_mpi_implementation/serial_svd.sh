@@ -16,7 +16,7 @@ cd $PBS_O_WORKDIR
 
 # Compile the code
 # -I. adds current directory to the include path (if svds.h or matrix_funcs.h are in current dir)
-mpicc -o svd_mpi_serial_32M main.c svds.c matrix_funcs.c \
+mpicc -fopenmp -o svd_mpi_serial_32M main.c svds.c svds_mpi.c matrix_funcs.c csv_loader.c matrix_io.c \
   -I/apps/OpenBLAS-0.3.7/include \
   -I/apps/lapack-3.8.0/include \
   -L/apps/OpenBLAS-0.3.7/lib \
@@ -30,9 +30,24 @@ MAPPED_DATA="mapped_merged_data_32M.csv"
 NUM_USERS=142255
 NUM_MOVIES=1321
 K_value=100
-# Run the compiled executable with 1 MPI process (serial)
+# Run the compiled executable with 1 MPI process (serial).
+# Rows of A are split across ranks, so raising -np (and select/mpiprocs
+# above) distributes the matrix and the U basis over more processes.
+# Append --sparse to build CSR row blocks and call svds_C_mpi instead of svds_C_dense_mpi.
+# A .bin cache written by the OpenMP driver's --save-cache can replace the CSV.
 mpirun.actual -np 1 ./svd_mpi_serial_32M $MAPPED_DATA $NUM_USERS $NUM_MOVIES $K_value
 
+# Multi-node hybrid run: one rank per node and OpenMP threads inside it, so
+# each Lanczos step pays two collectives per node instead of per core
+# (the log reports collectives per step and the time spent in them):
+#   #PBS -l select=4:ncpus=64:mpiprocs=1:ompthreads=64:mem=200gb
+#   #PBS -l place=scatter:excl
+#   export OMP_NUM_THREADS=64 OMP_PROC_BIND=spread OMP_PLACES=cores
+#   export MPICH_ASYNC_PROGRESS=1   # lets the A^T*u MPI_Iallreduce progress during local work
+#   mpirun.actual -np 4 -ppn 1 ./svd_mpi_serial_32M $MAPPED_DATA $NUM_USERS $NUM_MOVIES $K_value --sparse
+# With two sockets per node, -np 8 -ppn 2 and OMP_NUM_THREADS=32 keep every
+# rank on one socket.
+
 # You can also run simply:
 # ./svd_mpi_serial_2M $MAPPED_DATA $NUM_USERS $NUM_MOVIES
 # depending on your HPC environment. Some systems require mpirun or mpiexec explicitly.